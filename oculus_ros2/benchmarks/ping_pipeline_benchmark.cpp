@@ -0,0 +1,511 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Benchmarks of the ping pipeline: raw message conversion, fan rendering (each resolution and interpolation), gain
+// compensation, CFAR detection, temporal filter, ping compression and the handoff from the driver thread to the publishing
+// thread. Each case reports its throughput, p50 / p99 latency and heap allocations per ping, on synthetic pings and on
+// pings recorded in .oculus files given on the command line.
+//
+// Usage: ping_pipeline_benchmark [--iterations N] [file.oculus ...]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <oculus_interfaces/msg/compressed_ping.hpp>
+#include <oculus_interfaces/msg/ping.hpp>
+#include <oculus_ros2/conversions.hpp>
+#include <oculus_ros2/cfar.hpp>
+#include <oculus_ros2/fan_interpolation.hpp>
+#include <oculus_ros2/fan_remap_cache.hpp>
+#include <oculus_ros2/gain_compensation.hpp>
+#include <oculus_ros2/oculus_file_reader.hpp>
+#include <oculus_ros2/ping_codec.hpp>
+#include <oculus_ros2/ping_queue.hpp>
+#include <oculus_ros2/pipeline_stats.hpp>
+#include <oculus_ros2/sonar_viewer.hpp>
+#include <oculus_ros2/temporal_filter.hpp>
+#include <rclcpp/rclcpp.hpp>
+#include <sensor_msgs/msg/image.hpp>
+
+// Heap allocations made by the benchmarked code are counted by replacing the global allocation functions.
+static std::atomic<std::size_t> allocation_count{0};
+
+void* operator new(std::size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Ping {
+  std::string name;
+  std::vector<uint8_t> data;  // Raw simple ping message
+};
+
+void printHeader() {
+  std::printf("%-44s %-26s %12s %10s %10s %12s\n", "benchmark", "ping", "pings/s", "p50 (us)", "p99 (us)", "allocs/ping");
+}
+
+// Runs f iterations times after a short warm up and prints the statistics of the runs.
+template <class F>
+void run(const std::string& benchmark, const std::string& ping, int iterations, F&& f) {
+  for (int i = 0; i < std::min(iterations, 10); ++i) {
+    f();
+  }
+
+  std::vector<double> durations(iterations);
+  const std::size_t allocations_before = allocation_count.load();
+  const Clock::time_point start = Clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    const Clock::time_point t0 = Clock::now();
+    f();
+    durations[i] = std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+  }
+  const double total = std::chrono::duration<double>(Clock::now() - start).count();
+  const std::size_t allocations = allocation_count.load() - allocations_before;
+
+  std::sort(durations.begin(), durations.end());
+  std::printf("%-44s %-26s %12.0f %10.1f %10.1f %12.1f\n", benchmark.c_str(), ping.c_str(), iterations / total,
+      durations[iterations / 2], durations[std::min(iterations - 1, iterations * 99 / 100)],
+      static_cast<double>(allocations) / iterations);
+}
+
+// Simple ping (version 1) as sent by the sonar, with a non uniform bearing table and a gain at the start of each row.
+Ping syntheticPing(int n_beams, int n_ranges, int master_mode, int sample_size) {
+  const int step = n_beams * sample_size + 4;
+  const std::size_t image_offset = sizeof(OculusSimplePingResult) + n_beams * sizeof(int16_t);
+  const std::size_t size = image_offset + static_cast<std::size_t>(n_ranges) * step;
+
+  OculusSimplePingResult ping;
+  std::memset(&ping, 0, sizeof(ping));
+  ping.fireMessage.head.oculusId = OCULUS_CHECK_ID;
+  ping.fireMessage.head.msgId = messageSimplePingResult;
+  ping.fireMessage.head.msgVersion = 1;
+  ping.fireMessage.head.payloadSize = static_cast<uint32_t>(size - sizeof(OculusMessageHeader));
+  ping.fireMessage.masterMode = static_cast<uint8_t>(master_mode);
+  ping.fireMessage.flags = 0x04 | (sample_size == 2 ? 0x02 : 0x00);  // Gains sent, 8 or 16 bits
+  ping.fireMessage.range = 20.;
+  ping.fireMessage.gainPercent = 50.;
+  ping.frequency = master_mode == 1 ? 1.2e6 : 2.1e6;
+  ping.speeedOfSoundUsed = 1500.;
+  ping.dataSize = sample_size == 2 ? dataSize16Bit : dataSize8Bit;
+  ping.rangeResolution = 20. / n_ranges;
+  ping.nRanges = static_cast<uint16_t>(n_ranges);
+  ping.nBeams = static_cast<uint16_t>(n_beams);
+  ping.imageOffset = static_cast<uint32_t>(image_offset);
+  ping.imageSize = static_cast<uint32_t>(size - image_offset);
+  ping.messageSize = static_cast<uint32_t>(size);
+
+  Ping result;
+  result.name = std::to_string(n_beams) + "x" + std::to_string(n_ranges) + (master_mode == 1 ? " LF " : " HF ") +
+                std::to_string(8 * sample_size) + "bit";
+  result.data.resize(size);
+  std::memcpy(result.data.data(), &ping, sizeof(ping));
+
+  // Beams are denser at the center of the fan, as on the real sonars
+  const double half_aperture = master_mode == 1 ? 65. : 40.;
+  int16_t* bearings = reinterpret_cast<int16_t*>(result.data.data() + sizeof(ping));
+  for (int i = 0; i < n_beams; ++i) {
+    const double x = 2. * i / (n_beams - 1) - 1.;
+    bearings[i] = static_cast<int16_t>(std::lround(100. * half_aperture * std::sin(x * M_PI / 2.)));
+  }
+
+  uint8_t* rows = result.data.data() + image_offset;
+  for (int r = 0; r < n_ranges; ++r) {
+    uint8_t* row = rows + static_cast<std::size_t>(r) * step;
+    const uint32_t gain = 1 + static_cast<uint32_t>(r) * 16;
+    std::memcpy(row, &gain, sizeof(gain));  // Little-endian, as the sonar
+    for (int b = 0; b < n_beams * sample_size; ++b) {
+      row[4 + b] = static_cast<uint8_t>((r * 31 + b * 7) ^ (b >> 3));
+    }
+  }
+  return result;
+}
+
+std::vector<Ping> syntheticPings() {
+  std::vector<Ping> pings;
+  for (const int n_beams : {256, 512}) {
+    for (const int n_ranges : {300, 700, 1500}) {
+      for (const int master_mode : {1, 2}) {
+        for (const int sample_size : {1, 2}) {
+          pings.push_back(syntheticPing(n_beams, n_ranges, master_mode, sample_size));
+        }
+      }
+    }
+  }
+  return pings;
+}
+
+// The first distinct ping geometries of a recording, so that a long file does not multiply the cases.
+std::vector<Ping> recordedPings(const std::string& path) {
+  std::vector<Ping> pings;
+  oculus::OculusFileReader reader(path);
+  oculus::RecordedMessage message;
+  oculus_interfaces::msg::Ping msg;
+  std::vector<std::string> names;
+  while (reader.next(message) && pings.size() < 8) {
+    if (!oculus::toMsg(msg, message.data.data(), message.data.size(), rclcpp::Time(0, 0))) {
+      continue;
+    }
+    const std::string name = std::to_string(msg.n_beams) + "x" + std::to_string(msg.n_ranges) +
+                             (msg.master_mode == 1 ? " LF " : " HF ") + std::to_string(8 * msg.sample_size) + "bit (file)";
+    if (std::find(names.begin(), names.end(), name) == names.end()) {
+      names.push_back(name);
+      pings.push_back(Ping{name, message.data});
+    }
+  }
+  if (pings.empty()) {
+    std::fprintf(stderr, "No simple ping in %s\n", path.c_str());
+  }
+  return pings;
+}
+
+void benchmarkToMsg(const std::vector<Ping>& pings, int iterations) {
+  oculus_interfaces::msg::Ping msg;
+  const rclcpp::Time stamp(0, 0);
+  for (const Ping& ping : pings) {
+    run("oculus::toMsg (raw message)", ping.name, iterations,
+        [&] { oculus::toMsg(msg, ping.data.data(), ping.data.size(), stamp); });
+  }
+}
+
+// Renders the fan of each ping through SonarViewer, with a subscriber on its outputs so that nothing is skipped. With
+// pipeline_stats the stage probes are enabled, to compare with their cost when disabled.
+void benchmarkPublishFan(
+    const std::vector<Ping>& pings, int iterations, const std::string& gain_compensation, bool pipeline_stats = false) {
+  rclcpp::NodeOptions options;
+  options.parameter_overrides({rclcpp::Parameter("gain_compensation", gain_compensation)});
+  auto node = std::make_shared<rclcpp::Node>("ping_pipeline_benchmark", options);
+  SonarViewer viewer(node.get());
+  PipelineStats stats;
+  if (pipeline_stats) {
+    viewer.setStats(&stats);
+  }
+  auto ignore = [](const sensor_msgs::msg::Image::ConstSharedPtr&) {};
+  auto image_subscription = node->create_subscription<sensor_msgs::msg::Image>("image", 1, ignore);
+  auto compensated_subscription = node->create_subscription<sensor_msgs::msg::Image>("compensated", 1, ignore);
+
+  const std::string name =
+      "SonarViewer::publishFan (compensation " + gain_compensation + (pipeline_stats ? ", pipeline stats)" : ")");
+  oculus_interfaces::msg::Ping msg;
+  for (const Ping& ping : pings) {
+    oculus::toMsg(msg, ping.data.data(), ping.data.size(), node->now());
+    run(name, ping.name, iterations, [&] { viewer.publishFan(msg); });
+  }
+}
+
+// Renders a single resolution of the fan of each ping with the given interpolation, only its topic being subscribed
+void benchmarkPublishFanLevel(
+    const std::vector<Ping>& pings, int iterations, const std::string& topic, const std::string& interpolation = "cubic") {
+  rclcpp::NodeOptions options;
+  options.parameter_overrides({rclcpp::Parameter("interpolation", interpolation)});
+  auto node = std::make_shared<rclcpp::Node>("ping_pipeline_benchmark", options);
+  SonarViewer viewer(node.get());
+  auto subscription = node->create_subscription<sensor_msgs::msg::Image>(
+      topic, 1, [](const sensor_msgs::msg::Image::ConstSharedPtr&) {});
+
+  oculus_interfaces::msg::Ping msg;
+  for (const Ping& ping : pings) {
+    oculus::toMsg(msg, ping.data.data(), ping.data.size(), node->now());
+    run("SonarViewer::publishFan (" + topic + " only, " + interpolation + ")", ping.name, iterations,
+        [&] { viewer.publishFan(msg); });
+  }
+}
+
+template <class Sample>
+void benchmarkInterpolation(const Ping& ping, const oculus_interfaces::msg::Ping& msg, int iterations) {
+  const uint8_t* polar = msg.ping_data.data() + msg.image_offset + (msg.step - msg.n_beams * sizeof(Sample));
+  const int16_t* bearings = msg.bearings.size() == msg.n_beams ? msg.bearings.data() : nullptr;
+  for (const fan_interpolation::Method method : {fan_interpolation::Method::NEAREST, fan_interpolation::Method::BILINEAR}) {
+    FanGeometry geometry{msg.n_beams, msg.n_ranges, msg.master_mode, msg.master_mode == 1 ? 65. : 40.,
+        FanRemapCache::hashBearings(bearings, msg.n_beams)};
+    geometry.interpolation = method;
+    const std::shared_ptr<const FanRemap> remap = FanRemapCache::build(geometry, bearings);
+    std::vector<Sample> out(remap->table.cells.size());
+    const std::string name = method == fan_interpolation::Method::NEAREST ? "nearest" : "bilinear";
+    run("fan_interpolation::remap " + name, ping.name, iterations,
+        [&] { fan_interpolation::remap<Sample>(remap->table, method, polar, msg.step, 0, out.data()); });
+    run("fan_interpolation::remapScalar " + name, ping.name, iterations,
+        [&] { fan_interpolation::remapScalar<Sample>(remap->table, method, polar, msg.step, 0, out.data()); });
+  }
+}
+
+// Integer table kernels of the fan rendering, vectorized and scalar. The cv::remap of the cubic interpolation is timed
+// by benchmarkPublishFanLevel.
+void benchmarkInterpolation(const std::vector<Ping>& pings, int iterations) {
+  oculus_interfaces::msg::Ping msg;
+  for (const Ping& ping : pings) {
+    oculus::toMsg(msg, ping.data.data(), ping.data.size(), rclcpp::Time(0, 0));
+    if (msg.sample_size == 1) {
+      benchmarkInterpolation<uint8_t>(ping, msg, iterations);
+    } else {
+      benchmarkInterpolation<uint16_t>(ping, msg, iterations);
+    }
+  }
+}
+
+template <class In, class Out>
+void benchmarkCompensation(const Ping& ping, const oculus_interfaces::msg::Ping& msg, int iterations, const char* name) {
+  const uint8_t* rows = msg.ping_data.data() + msg.image_offset;
+  std::vector<Out> out(static_cast<std::size_t>(msg.n_ranges) * msg.n_beams);
+  run(std::string("gain_compensation::compensate ") + name, ping.name, iterations,
+      [&] { gain_compensation::compensate<In>(rows, msg.step, msg.n_ranges, msg.n_beams, out.data()); });
+  run(std::string("gain_compensation::compensateScalar ") + name, ping.name, iterations,
+      [&] { gain_compensation::compensateScalar<In>(rows, msg.step, msg.n_ranges, msg.n_beams, out.data()); });
+}
+
+void benchmarkCompensation(const std::vector<Ping>& pings, int iterations) {
+  oculus_interfaces::msg::Ping msg;
+  for (const Ping& ping : pings) {
+    oculus::toMsg(msg, ping.data.data(), ping.data.size(), rclcpp::Time(0, 0));
+    if (!msg.has_gains) {
+      continue;
+    }
+    if (msg.sample_size == 1) {
+      benchmarkCompensation<uint8_t, float>(ping, msg, iterations, "float");
+      benchmarkCompensation<uint8_t, uint8_t>(ping, msg, iterations, "8bit");
+    } else {
+      benchmarkCompensation<uint16_t, float>(ping, msg, iterations, "float");
+      benchmarkCompensation<uint16_t, uint16_t>(ping, msg, iterations, "16bit");
+    }
+  }
+}
+
+// CFAR detection over the float compensated image of each ping, with the default window and false alarm rate.
+void benchmarkCfar(const std::vector<Ping>& pings, int iterations) {
+  oculus_interfaces::msg::Ping msg;
+  std::vector<float> image;
+  std::vector<cfar::Detection> detections;
+  for (const Ping& ping : pings) {
+    oculus::toMsg(msg, ping.data.data(), ping.data.size(), rclcpp::Time(0, 0));
+    if (!msg.has_gains) {
+      continue;
+    }
+    const uint8_t* rows = msg.ping_data.data() + msg.image_offset;
+    image.resize(static_cast<std::size_t>(msg.n_ranges) * msg.n_beams);
+    if (msg.sample_size == 1) {
+      gain_compensation::compensate<uint8_t>(rows, msg.step, msg.n_ranges, msg.n_beams, image.data());
+    } else {
+      gain_compensation::compensate<uint16_t>(rows, msg.step, msg.n_ranges, msg.n_beams, image.data());
+    }
+    for (const cfar::Method method : {cfar::Method::CA, cfar::Method::OS}) {
+      cfar::Parameters parameters;
+      parameters.method = method;
+      cfar::Detector detector(parameters);
+      run(std::string("cfar::Detector::detect ") + (method == cfar::Method::CA ? "ca" : "os"), ping.name, iterations,
+          [&] { detector.detect(image.data(), msg.n_ranges, msg.n_beams, detections); });
+    }
+  }
+}
+
+// Temporal filter of each ping in its steady state (after the first ping of the geometry), in place on a copy of the ping
+// data as done by the sonar node.
+void benchmarkTemporalFilter(const std::vector<Ping>& pings, int iterations) {
+  oculus_interfaces::msg::Ping msg;
+  std::vector<uint8_t> data;
+  for (const Ping& ping : pings) {
+    oculus::toMsg(msg, ping.data.data(), ping.data.size(), rclcpp::Time(0, 0));
+    const std::size_t offset = msg.image_offset;
+    const temporal_filter::Geometry geometry{
+        msg.n_ranges, msg.n_beams, static_cast<int>(msg.step), msg.sample_size, msg.has_gains, msg.master_mode, msg.range};
+    for (const std::string& mode : {"ema", "median", "speckle"}) {
+      temporal_filter::Parameters parameters;
+      temporal_filter::modeFromString(mode, parameters.mode);
+      temporal_filter::Filter filter(parameters);
+      data = msg.ping_data;
+      filter.apply(data.data() + offset, geometry);
+      run("temporal_filter::Filter::apply " + mode, ping.name, iterations, [&] {
+        data.assign(msg.ping_data.begin(), msg.ping_data.end());
+        filter.apply(data.data() + offset, geometry);
+      });
+    }
+  }
+}
+
+// Encoding and decoding of each ping by the ping/compressed codecs, with their compression ratio. The ratio of the
+// synthetic pings, made of regular patterns, is not representative: run on recorded pings.
+void benchmarkCodec(const std::vector<Ping>& pings, int iterations) {
+  struct Codec {
+    std::string name;
+    ping_codec::Parameters parameters;
+  };
+  std::vector<Codec> codecs;
+  for (const ping_codec::Format format : {ping_codec::Format::LZ4, ping_codec::Format::ZSTD}) {
+    for (const int bits : {0, 6, 4}) {
+      for (const bool delta : {true, false}) {
+        ping_codec::Parameters parameters;
+        parameters.format = format;
+        parameters.bits = bits;
+        parameters.delta = delta;
+        const std::string lossy = bits > 0 ? " " + std::to_string(bits) + " bits" : "";
+        codecs.push_back(Codec{ping_codec::toString(format) + lossy + (delta ? " delta" : ""), parameters});
+      }
+    }
+  }
+
+  oculus_interfaces::msg::Ping msg;
+  oculus_interfaces::msg::Ping decoded;
+  oculus_interfaces::msg::CompressedPing compressed;
+  for (const Ping& ping : pings) {
+    oculus::toMsg(msg, ping.data.data(), ping.data.size(), rclcpp::Time(0, 0));
+    for (const Codec& codec : codecs) {
+      ping_codec::Encoder encoder(codec.parameters);
+      ping_codec::Decoder decoder;
+      run("ping_codec::Encoder " + codec.name, ping.name, iterations, [&] { encoder.encode(msg, compressed); });
+      run("ping_codec::Decoder " + codec.name, ping.name, iterations, [&] { decoder.decode(compressed, decoded); });
+      std::printf("%-44s %-26s ratio %.2f (%zu -> %zu bytes)\n", ("ping_codec " + codec.name).c_str(), ping.name.c_str(),
+          static_cast<double>(msg.ping_data.size()) / compressed.data.size(), msg.ping_data.size(), compressed.data.size());
+    }
+  }
+}
+
+// Handoff of the pings from the driver thread (OculusSonarNode::enqueuePing) to the publishing thread
+// (OculusSonarNode::processPings). The latency is measured from the push to the pop, one ping in flight at a time as
+// when the sonar pings slower than the pipeline.
+void benchmarkHandoff(const std::vector<Ping>& pings, int iterations) {
+  struct Item {
+    Clock::time_point pushed;
+    std::shared_ptr<const Ping> ping;
+  };
+  for (const Ping& ping : pings) {
+    PingQueue<Item> queue(4, DropPolicy::DROP_OLDEST);
+    std::atomic<bool> received{false};
+    std::vector<double> latencies;
+    latencies.reserve(iterations + 10);
+    std::thread consumer([&] {
+      Item item;
+      while (queue.pop(item)) {
+        latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - item.pushed).count());
+        item.ping.reset();
+        received.store(true, std::memory_order_release);
+      }
+    });
+
+    auto shared_ping = std::make_shared<const Ping>(ping);
+    const std::size_t allocations_before = allocation_count.load();
+    const Clock::time_point start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+      received.store(false, std::memory_order_relaxed);
+      queue.push(Item{Clock::now(), shared_ping});
+      while (!received.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+    }
+    const double total = std::chrono::duration<double>(Clock::now() - start).count();
+    const std::size_t allocations = allocation_count.load() - allocations_before;
+    queue.close();
+    consumer.join();
+
+    std::sort(latencies.begin(), latencies.end());
+    std::printf("%-44s %-26s %12.0f %10.1f %10.1f %12.1f\n", "PingQueue handoff (driver -> publisher)", ping.name.c_str(),
+        iterations / total, latencies[iterations / 2], latencies[std::min(iterations - 1, iterations * 99 / 100)],
+        static_cast<double>(allocations) / iterations);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  rclcpp::init(argc, argv);
+  const std::vector<std::string> args = rclcpp::remove_ros_arguments(argc, argv);
+
+  int iterations = 200;
+  std::vector<Ping> pings = syntheticPings();
+  for (std::size_t i = 1; i < args.size(); ++i) {
+    if (args[i] == "--iterations" && i + 1 < args.size()) {
+      iterations = std::max(1, std::atoi(args[++i].c_str()));
+      continue;
+    }
+    try {
+      const std::vector<Ping> recorded = recordedPings(args[i]);
+      pings.insert(pings.end(), recorded.begin(), recorded.end());
+    } catch (const std::exception& e) {
+      std::fprintf(stderr, "%s\n", e.what());
+      return 1;
+    }
+  }
+
+  printHeader();
+  benchmarkToMsg(pings, iterations);
+  benchmarkCompensation(pings, iterations);
+  benchmarkCfar(pings, iterations);
+  benchmarkTemporalFilter(pings, iterations);
+  benchmarkCodec(pings, iterations);
+  benchmarkPublishFan(pings, iterations, "off");
+  benchmarkPublishFan(pings, iterations, "8bit");
+  benchmarkPublishFan(pings, iterations, "off", true);
+  benchmarkInterpolation(pings, iterations);
+  for (const std::string& interpolation : {"nearest", "bilinear", "cubic", "area"}) {
+    benchmarkPublishFanLevel(pings, iterations, "image", interpolation);
+  }
+  benchmarkPublishFanLevel(pings, iterations, "image_2");
+  benchmarkPublishFanLevel(pings, iterations, "image_4");
+  benchmarkHandoff(pings, iterations);
+
+  rclcpp::shutdown();
+  return 0;
+}
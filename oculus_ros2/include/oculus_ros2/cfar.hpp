@@ -0,0 +1,93 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef OCULUS_ROS2__CFAR_HPP_
+#define OCULUS_ROS2__CFAR_HPP_
+
+#include <string>
+#include <vector>
+
+namespace cfar {
+
+// Estimate of the noise level around each cell.
+enum class Method {
+  OFF,  // No detection
+  CA,  // Cell averaging: mean of the training cells
+  OS  // Ordered statistic: os_rank quantile of the training cells, robust to neighbouring targets
+};
+
+// "off", "ca" or "os". Returns false if the string is not a known method.
+bool methodFromString(const std::string& name, Method& method);
+
+struct Parameters {
+  Method method = Method::OFF;
+  int guard_ranges = 2;  // Guard cells on each side of the cell under test, excluded from the noise estimate
+  int guard_beams = 1;
+  int training_ranges = 8;  // Training cells on each side, beyond the guard cells
+  int training_beams = 3;
+  double pfa = 1e-4;  // Probability of false alarm on exponentially distributed noise, sets the threshold factor
+  double os_rank = .75;  // Rank of the OS noise estimate among the training cells, in ]0, 1]
+};
+
+struct Detection {
+  int range;  // Row of the polar image
+  int beam;  // Column of the polar image
+  float value;
+};
+
+// 2D CFAR detector over a gain compensated polar image (ranges x beams). A cell is detected when its value exceeds the
+// noise estimate of its training window times a factor set by pfa and the number of training cells, which is smaller
+// near the borders of the image. The threshold factors and the buffers are kept from one ping to the other.
+class Detector {
+public:
+  explicit Detector(const Parameters& parameters = Parameters());
+
+  const Parameters& parameters() const { return parameters_; }
+
+  // image is dense, row major. detections is cleared.
+  void detect(const float* image, int n_ranges, int n_beams, std::vector<Detection>& detections);
+
+private:
+  Parameters parameters_;
+  std::vector<float> factors_;  // Threshold factor on the noise estimate, by number of training cells
+  std::vector<int> ranks_;  // OS: rank (0 based) of the noise estimate, by number of training cells
+  std::vector<double> integral_;  // Summed area table of the image, (n_ranges + 1) x (n_beams + 1)
+  std::vector<double> squares_;  // OS: summed area table of the squares of the image
+  std::vector<float> thresholds_;  // CA: detection thresholds of a row
+
+  void detectCa(const float* image, int n_ranges, int n_beams, std::vector<Detection>& detections);
+  void detectOs(const float* image, int n_ranges, int n_beams, std::vector<Detection>& detections);
+};
+
+}  // namespace cfar
+
+#endif  // OCULUS_ROS2__CFAR_HPP_
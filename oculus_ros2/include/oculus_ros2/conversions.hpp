@@ -37,6 +37,8 @@
 #include <oculus_driver/OculusMessage.h>
 #include <oculus_driver/SonarDriver.h>
 
+#include <cstring>
+
 #include <oculus_interfaces/msg/oculus_fire_config.hpp>
 #include <oculus_interfaces/msg/oculus_header.hpp>
 #include <oculus_interfaces/msg/oculus_ping.hpp>
@@ -138,7 +140,8 @@ inline void toMsg(oculus_interfaces::msg::OculusPing& msg, const OculusSimplePin
   msg.message_size = ping.messageSize;
 }
 
-inline void toMsg(oculus_interfaces::msg::Ping& msg, const oculus::PingMessage::ConstPtr& ping) {
+// Without copy_data, ping_data is left empty (the ping data is compressed instead, see ping_codec.hpp).
+inline void toMsg(oculus_interfaces::msg::Ping& msg, const oculus::PingMessage::ConstPtr& ping, bool copy_data = true) {
   msg.header.stamp = toMsg(ping->timestamp());
 
   msg.ping_id = ping->ping_index();
@@ -156,9 +159,111 @@ inline void toMsg(oculus_interfaces::msg::Ping& msg, const oculus::PingMessage::
   msg.n_beams = ping->bearing_count();
   msg.step = ping->step();
   msg.sample_size = ping->sample_size();
+  msg.image_offset = ping->ping_data_offset();
 
+  // assign() keeps the capacity of a reused message, only the payload is copied
   msg.bearings.assign(ping->bearing_data(), ping->bearing_data() + ping->bearing_count());
-  msg.ping_data = ping->data();
+  if (copy_data) {
+    msg.ping_data.assign(ping->data().begin(), ping->data().end());
+  } else {
+    msg.ping_data.clear();
+  }
+}
+
+// Fields shared by OculusSimplePingResult and OculusSimplePingResult2, data is the whole message.
+template <class PingResult>
+inline bool toMsg(oculus_interfaces::msg::Ping& msg,
+    const PingResult& ping,
+    double range,
+    double speed_of_sound_used,
+    uint32_t ping_firing_date,
+    const uint8_t* data,
+    std::size_t size) {
+  msg.ping_id = ping.pingId;
+  msg.ping_firing_date = ping_firing_date;
+  msg.range = range;
+  msg.gain_percent = ping.fireMessage.gainPercent;
+  msg.frequency = ping.frequency;
+  msg.speed_of_sound_used = speed_of_sound_used;
+  msg.range_resolution = ping.rangeResolution;
+  msg.temperature = ping.temperature;
+  msg.pressure = ping.pressure;
+  msg.master_mode = ping.fireMessage.masterMode;
+  msg.has_gains = ping.fireMessage.flags & 0x04;
+  msg.n_ranges = ping.nRanges;
+  msg.n_beams = ping.nBeams;
+  msg.sample_size = static_cast<uint8_t>(ping.dataSize) + 1;  // dataSize8Bit = 0, dataSize16Bit = 1, ...
+  msg.step = msg.n_beams * msg.sample_size + (msg.has_gains ? 4 : 0);
+  msg.image_offset = ping.imageOffset;
+
+  // The bearings follow the ping result, the image starts at imageOffset
+  const std::size_t bearings_size = msg.n_beams * sizeof(int16_t);
+  if (size < sizeof(PingResult) + bearings_size || size < ping.imageOffset + static_cast<std::size_t>(msg.n_ranges) * msg.step) {
+    return false;
+  }
+  msg.bearings.resize(msg.n_beams);
+  std::memcpy(msg.bearings.data(), data + sizeof(PingResult), bearings_size);
+  msg.ping_data.assign(data, data + size);
+  return true;
+}
+
+// Fills a Ping message from a raw simple ping message (header included) as sent by the sonar or stored in a .oculus file,
+// without going through oculus::PingMessage. Returns false if the message is not a simple ping or is truncated.
+inline bool toMsg(oculus_interfaces::msg::Ping& msg, const uint8_t* data, std::size_t size, const rclcpp::Time& stamp) {
+  OculusMessageHeader header;
+  if (size < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if (header.oculusId != OCULUS_CHECK_ID || header.msgId != messageSimplePingResult) {
+    return false;
+  }
+
+  msg.header.stamp = stamp;
+  if (header.msgVersion == 2) {
+    OculusSimplePingResult2 ping;
+    if (size < sizeof(ping)) {
+      return false;
+    }
+    std::memcpy(&ping, data, sizeof(ping));
+    return toMsg(msg, ping, ping.fireMessage.rangePercent, ping.speedOfSoundUsed, static_cast<uint32_t>(ping.pingStartTime),
+        data, size);
+  }
+  OculusSimplePingResult ping;
+  if (size < sizeof(ping)) {
+    return false;
+  }
+  std::memcpy(&ping, data, sizeof(ping));
+  return toMsg(msg, ping, ping.fireMessage.range, ping.speeedOfSoundUsed, ping.pingStartTime, data, size);
+}
+
+// Firing date (Ping.ping_firing_date) of a raw simple ping message, without converting it. Returns false if the message
+// is not a simple ping.
+inline bool pingFiringDate(const uint8_t* data, std::size_t size, uint32_t& firing_date) {
+  OculusMessageHeader header;
+  if (size < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if (header.oculusId != OCULUS_CHECK_ID || header.msgId != messageSimplePingResult) {
+    return false;
+  }
+  if (header.msgVersion == 2) {
+    OculusSimplePingResult2 ping;
+    if (size < sizeof(ping)) {
+      return false;
+    }
+    std::memcpy(&ping, data, sizeof(ping));
+    firing_date = static_cast<uint32_t>(ping.pingStartTime);
+    return true;
+  }
+  OculusSimplePingResult ping;
+  if (size < sizeof(ping)) {
+    return false;
+  }
+  std::memcpy(&ping, data, sizeof(ping));
+  firing_date = ping.pingStartTime;
+  return true;
 }
 
 }  // namespace oculus
@@ -0,0 +1,89 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef OCULUS_ROS2__FAN_INTERPOLATION_HPP_
+#define OCULUS_ROS2__FAN_INTERPOLATION_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace fan_interpolation {
+
+// Interpolation of the polar image at the source coordinates of the fan pixels.
+enum class Method {
+  NEAREST,  // Closest sample
+  BILINEAR,  // 2x2 neighbourhood
+  CUBIC,  // 4x4 neighbourhood (cv::remap), sharpest but overshoots on speckle
+  AREA  // Bilinear over the polar image averaged over the beams covered by a pixel, which drops the aliasing of the speckle
+        // near the sonar where a pixel covers several beams
+};
+
+// "nearest", "bilinear", "cubic" or "area". Returns false if the string is not a known method.
+bool methodFromString(const std::string& name, Method& method);
+
+// Integer remap table of the NEAREST, BILINEAR and AREA methods, one entry per pixel of the fan image.
+struct Table {
+  int n_beams = 0;
+  int n_ranges = 0;
+  std::vector<int32_t> cells;  // (range << 16) | beam of the top left sample of the 2x2 neighbourhood, -1 outside
+  std::vector<uint32_t> weights;  // (range weight << 16) | beam weight of the second range and beam, in 1/256
+  std::vector<int> half_beams;  // AREA: half width (in beams) of the beam average of each range
+};
+
+// The table needs a 2x2 neighbourhood, and 4 bytes of a row for the gathers of the 8 bits samples.
+bool supported(int n_beams, int n_ranges);
+
+// Fills the cells and weights of table from the source coordinates of each pixel (size (beam, range) pairs), a negative
+// beam marking the pixels outside of the fan. Coordinates beyond the last beam or range are clamped to it.
+void buildTable(const float* coordinates, std::size_t size, int n_beams, int n_ranges, Table& table);
+
+// Fills out (one Sample per entry of table) from the polar image of n_ranges rows of step bytes, each holding n_beams
+// samples of type Sample (uint8_t or uint16_t). method is NEAREST or BILINEAR, pixels outside of the fan are set to
+// border.
+// Uses AVX2 gathers when available at runtime, scalar loads otherwise.
+template <class Sample>
+void remap(const Table& table, Method method, const uint8_t* polar, int step, Sample border, Sample* out);
+
+// Scalar implementation, reference for the vectorized one.
+template <class Sample>
+void remapScalar(const Table& table, Method method, const uint8_t* polar, int step, Sample border, Sample* out);
+
+// Averages each sample of the polar image (same layout as remap) with the half_beams[range] samples on each side of it
+// along the beams. out is a dense n_ranges x n_beams image.
+template <class Sample>
+void averageBeams(const uint8_t* polar, int step, int n_beams, int n_ranges, const std::vector<int>& half_beams, Sample* out);
+
+}  // namespace fan_interpolation
+
+#endif  // OCULUS_ROS2__FAN_INTERPOLATION_HPP_
@@ -0,0 +1,117 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef OCULUS_ROS2__FAN_REMAP_CACHE_HPP_
+#define OCULUS_ROS2__FAN_REMAP_CACHE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include <oculus_ros2/fan_interpolation.hpp>
+#include <opencv2/core.hpp>
+
+// Part of the fan rendered and size of the fan image. Distances are in ranges (rows of the polar image), bearings in
+// radians. The default region is the whole fan at one pixel per range.
+struct FanRegion {
+  float min_range = 0.f;
+  float max_range = 0.f;  // 0 for the last range
+  float min_bearing = 0.f;  // min_bearing == max_bearing for the whole aperture
+  float max_bearing = 0.f;
+  int width = 0;  // Image size in pixels, 0 to fit the region. A fixed size is centered on the region.
+  int height = 0;
+  float pixel_size = 0.f;  // 0 to fit the region in the fixed size, or one pixel per range if there is none
+
+  bool operator==(const FanRegion& other) const {
+    return min_range == other.min_range && max_range == other.max_range && min_bearing == other.min_bearing &&
+           max_bearing == other.max_bearing && width == other.width && height == other.height &&
+           pixel_size == other.pixel_size;
+  }
+};
+
+// Everything the polar to cartesian remap tables depend on. Two pings with the same geometry share the same tables.
+struct FanGeometry {
+  int n_beams;
+  int n_ranges;
+  int master_mode;
+  double aperture;  // Half aperture of the fan (in degrees), only used when the ping has no bearing table
+  std::uint64_t bearings_hash;  // Hash of the bearing table, 0 if the ping has no bearing table
+  FanRegion region = {};
+  fan_interpolation::Method interpolation = fan_interpolation::Method::CUBIC;
+
+  bool operator==(const FanGeometry& other) const {
+    return n_beams == other.n_beams && n_ranges == other.n_ranges && master_mode == other.master_mode &&
+           aperture == other.aperture && bearings_hash == other.bearings_hash && region == other.region &&
+           interpolation == other.interpolation;
+  }
+};
+
+// Precomputed remap tables projecting the polar ping image onto the fan image. Only the pixels of the region are
+// computed, the ones outside of it get the border value.
+struct FanRemap {
+  cv::Size image_size;
+  fan_interpolation::Method method;  // CUBIC when the geometry asks for it or the ping is too small for the integer table
+  cv::Mat map1;  // CUBIC: CV_16SC2, integer source coordinates (see cv::convertMaps)
+  cv::Mat map2;  // CUBIC: CV_16UC1, interpolation table indices
+  fan_interpolation::Table table;  // NEAREST, BILINEAR and AREA
+  bool bearings_ignored = false;  // The bearing table is not monotonic, the beams are spread over the aperture instead
+};
+
+// Least recently used cache of remap tables. Tables are only rebuilt when the ping geometry changes, and keeping a few
+// entries avoids rebuilding them each time the sonar is switched between low and high frequency.
+class FanRemapCache {
+public:
+  explicit FanRemapCache(std::size_t capacity = 4);
+
+  // bearings (in 100th of a degree, n_beams values, increasing or decreasing) is only read when the tables have to be
+  // built. nullptr means the beams are assumed uniformly spread over the aperture.
+  std::shared_ptr<const FanRemap> get(const FanGeometry& geometry, const int16_t* bearings = nullptr);
+
+  std::size_t hits() const;
+  std::size_t misses() const;
+
+  static std::uint64_t hashBearings(const int16_t* bearings, int n_beams);
+  // A geometry without beams or ranges gives an empty image.
+  static std::shared_ptr<const FanRemap> build(const FanGeometry& geometry, const int16_t* bearings = nullptr);
+
+private:
+  const std::size_t capacity_;
+  std::list<std::pair<FanGeometry, std::shared_ptr<const FanRemap>>> entries_;  // Most recently used first
+  std::size_t hits_ = 0;
+  std::size_t misses_ = 0;
+  mutable std::mutex mutex_;
+};
+
+#endif  // OCULUS_ROS2__FAN_REMAP_CACHE_HPP_
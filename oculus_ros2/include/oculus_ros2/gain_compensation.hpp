@@ -0,0 +1,89 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef OCULUS_ROS2__GAIN_COMPENSATION_HPP_
+#define OCULUS_ROS2__GAIN_COMPENSATION_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace gain_compensation {
+
+// Output of the gain compensation stage.
+enum class Mode {
+  OFF,  // No compensation
+  FLOAT,  // value / sqrt(gain), as float
+  UINT8,  // 255 * value / sqrt(gain), rounded and saturated to uint8
+  UINT16  // 65535 * value / sqrt(gain), rounded and saturated to uint16
+};
+
+// "off", "float", "8bit" or "16bit". Returns false if the string is not a known mode.
+bool modeFromString(const std::string& name, Mode& mode);
+
+// Gain of a ping row, stored as a little-endian uint32 in the first 4 bytes of the row.
+inline uint32_t rowGain(const uint8_t* row) {
+  return static_cast<uint32_t>(row[0]) | (static_cast<uint32_t>(row[1]) << 8) | (static_cast<uint32_t>(row[2]) << 16) |
+         (static_cast<uint32_t>(row[3]) << 24);
+}
+
+// Sample i of a row of samples of type Sample (uint8_t or uint16_t, little-endian). The ping rows follow their gain at any
+// offset of the sonar message, the samples are not aligned.
+template <class Sample>
+inline Sample loadSample(const uint8_t* samples, int i) {
+  Sample sample;
+  std::memcpy(&sample, samples + static_cast<std::ptrdiff_t>(i) * sizeof(Sample), sizeof(Sample));
+  return sample;
+}
+
+template <class Sample>
+inline void storeSample(Sample sample, int i, uint8_t* samples) {
+  std::memcpy(samples + static_cast<std::ptrdiff_t>(i) * sizeof(Sample), &sample, sizeof(Sample));
+}
+
+// Factor applied to the samples of a row with the given gain, for the output scale (1, 255 or 65535).
+float rowScale(uint32_t gain, float output_scale);
+
+// Compensate the gain of each row of a ping image. rows points to the gain of the first row, each row is step bytes long
+// and holds its gain followed by n_beams samples of type In (uint8_t or uint16_t), rows and step need no alignment. out is
+// a dense n_ranges x n_beams image of type Out (float, uint8_t or uint16_t).
+// Uses the widest SIMD instruction set available at runtime (AVX2, SSE2 or NEON).
+template <class In, class Out>
+void compensate(const uint8_t* rows, int step, int n_ranges, int n_beams, Out* out);
+
+// Scalar implementation, reference for the vectorized one.
+template <class In, class Out>
+void compensateScalar(const uint8_t* rows, int step, int n_ranges, int n_beams, Out* out);
+
+}  // namespace gain_compensation
+
+#endif  // OCULUS_ROS2__GAIN_COMPENSATION_HPP_
@@ -0,0 +1,106 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef OCULUS_ROS2__OCULUS_FILE_READER_HPP_
+#define OCULUS_ROS2__OCULUS_FILE_READER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace oculus {
+
+// Blueprint Subsea log files (.oculus) are a file header followed by items, each item being an item header followed by
+// its payload. Sonar items hold a raw sonar message (header included).
+const uint32_t LOG_FILE_MAGIC = 0x11223344;
+const uint32_t LOG_ITEM_MAGIC = 0xaabbccdd;
+
+// A sonar message read from a .oculus file.
+struct RecordedMessage {
+  std::vector<uint8_t> data;  // Raw message, starting with its OculusMessageHeader
+  double time;  // Recording date (seconds since epoch)
+};
+
+// A sonar message in the mapped file, valid as long as its OculusFileReader.
+struct RecordedMessageView {
+  const uint8_t* data;
+  std::size_t size;
+  double time;
+};
+
+// Reader of the sonar messages of a .oculus file. The file is memory-mapped and the position of its messages is indexed
+// on opening. The index is saved next to the file (<file>.idx) and reused as long as the file is unchanged, so that
+// reopening a multi-GB recording does not scan it again.
+class OculusFileReader {
+public:
+  // Throws std::runtime_error if the file cannot be opened or is not a .oculus file.
+  explicit OculusFileReader(const std::string& path, bool persist_index = true);
+  ~OculusFileReader();
+  OculusFileReader(const OculusFileReader&) = delete;
+  OculusFileReader& operator=(const OculusFileReader&) = delete;
+
+  // Number of uncompressed messages (compressed items are not supported and are skipped)
+  std::size_t size() const { return index_.size(); }
+  RecordedMessageView message(std::size_t i) const;
+
+  // Sequential reading, copies the next message. Returns false at the end of the file.
+  bool next(RecordedMessage& message);
+  void rewind() { next_ = 0; }
+
+  const std::string& path() const { return path_; }
+  static std::string indexPath(const std::string& path) { return path + ".idx"; }
+  bool indexWasLoaded() const { return index_loaded_; }  // false if the file has been scanned
+
+  struct IndexEntry {
+    uint64_t offset;  // Of the message in the file
+    uint64_t size;
+    double time;
+  };
+
+private:
+  const std::string path_;
+  const uint8_t* data_ = nullptr;
+  std::size_t size_ = 0;
+  int64_t mtime_ = 0;
+  std::vector<IndexEntry> index_;
+  bool index_loaded_ = false;
+  std::size_t next_ = 0;
+
+  void buildIndex();
+  bool loadIndex();
+  void saveIndex() const;
+};
+
+}  // namespace oculus
+
+#endif  // OCULUS_ROS2__OCULUS_FILE_READER_HPP_
@@ -0,0 +1,77 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef OCULUS_ROS2__OCULUS_REPLAY_NODE_HPP_
+#define OCULUS_ROS2__OCULUS_REPLAY_NODE_HPP_
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <oculus_interfaces/msg/ping.hpp>
+#include <oculus_ros2/oculus_file_reader.hpp>
+#include <oculus_ros2/sonar_clock.hpp>
+#include <oculus_ros2/sonar_viewer.hpp>
+#include <rclcpp/rclcpp.hpp>
+
+namespace params {
+
+const double REPLAY_RATE_DEFAULT_VALUE = 1.;
+const int REPLAY_QUEUE_SIZE_DEFAULT_VALUE = 10;
+
+}  // namespace params
+
+// Publishes the pings recorded in a .oculus file on the same topics as OculusSonarNode (ping and the fan image).
+class OculusReplayNode : public rclcpp::Node {
+public:
+  explicit OculusReplayNode(const rclcpp::NodeOptions& options = rclcpp::NodeOptions());
+  ~OculusReplayNode();
+
+private:
+  std::unique_ptr<oculus::OculusFileReader> reader_;
+  SonarViewer sonar_viewer_;
+  const std::string frame_id_;
+  const double rate_;  // Replay speed relative to the recording, <= 0 for as fast as possible
+  const bool loop_;
+  const bool use_recording_stamp_;
+  rclcpp::Publisher<oculus_interfaces::msg::Ping>::SharedPtr ping_publisher_{nullptr};
+  oculus_interfaces::msg::Ping ping_msg_;  // Reused when intra-process communication is disabled
+  SonarClock sonar_clock_;  // Unwraps the firing dates, with the recording dates as reception dates
+  std::atomic<bool> stop_{false};
+  std::thread replay_thread_;
+
+  void replay();
+  void publishPing(const oculus::RecordedMessageView& message);
+};
+
+#endif  // OCULUS_ROS2__OCULUS_REPLAY_NODE_HPP_
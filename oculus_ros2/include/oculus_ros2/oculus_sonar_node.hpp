@@ -36,134 +36,115 @@
 #include <oculus_driver/AsyncService.h>
 #include <oculus_driver/SonarDriver.h>
 
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <future>
 #include <iostream>
 #include <memory>
 #include <sstream>
 #include <string>
 #include <thread>
+#include <utility>
 #include <vector>
 
+#include <diagnostic_msgs/msg/diagnostic_array.hpp>
+#include <oculus_interfaces/msg/compressed_ping.hpp>
 #include <oculus_interfaces/msg/oculus_status.hpp>
 #include <oculus_interfaces/msg/ping.hpp>
 #include <oculus_ros2/conversions.hpp>
+#include <oculus_ros2/ping_codec.hpp>
+#include <oculus_ros2/ping_queue.hpp>
+#include <oculus_ros2/pipeline_stats.hpp>
+#include <oculus_ros2/sonar_clock.hpp>
+#include <oculus_ros2/sonar_config.hpp>
 #include <oculus_ros2/sonar_viewer.hpp>
+#include <oculus_ros2/temporal_filter.hpp>
 #include <rcl_interfaces/msg/parameter_descriptor.hpp>
 #include <rclcpp/rclcpp.hpp>
 #include <sensor_msgs/msg/fluid_pressure.hpp>
 #include <sensor_msgs/msg/temperature.hpp>
 
-struct SonarParameters {
-  int frequency_mode;
-  int ping_rate;
-  int nbeams;
-  bool gain_assist;
-  double range;
-  int gamma_correction;
-  double gain_percent;
-  double sound_speed;
-  bool use_salinity;
-  double salinity;
+// Sonar values reported in each ping, written by the ping thread and applied to the ROS parameters by the connection timer
+struct PingEcho {
+  std::atomic<bool> valid{false};
+  std::atomic<int> frequency_mode{0};
+  std::atomic<double> range{0.};
+  std::atomic<double> gain_percent{0.};
+  std::atomic<double> sound_speed{0.};
+  std::atomic<int> data_depth{0};
 };
 
-namespace flagByte {
-const int RANGE_AS_METERS = 0x01;  // bit 0: 0 = interpret range as percent, 1 = interpret range as meters
-// const int ?? = 0x02;  // bit 1: ?? const int DATA_DEPTH = 0x02;  // bit 1: 0 = 8 bit data, 1 = 16 bit data  // inverted ?
-// TODO(hugoyvrn)
-const int SEND_GAINS = 0x04;  // bit 2: 0 = won't send gain, 1 = send gain
-const int SIMPLE_PING = 0x08;  // bit 3: 0 = send full return message, 1 = send simple return message
-const int GAIN_ASSIST = 0x10;  // bit 4: gain assist?
-// const int ?? = 0x20;  // bit 5: ?
-const int NBEAMS = 0x40;  // bit 6: enable 512 beams
-// const int ?? = 0x80;  // bit 7: ?
-}  // namespace flagByte
-
 namespace params {
 
 const double TEMPERATURE_WARN_DEFAULT_VALUE = 30.;
 const double TEMPERATURE_STOP_DEFAULT_VALUE = 35.;
 const bool RUN_MODE_DEFAULT_VALUE = false;
+const int PING_QUEUE_SIZE_DEFAULT_VALUE = 4;
+const int PING_QUEUE_SIZE_MAX_VALUE = 1024;
+const std::string PING_QUEUE_POLICY_DEFAULT_VALUE = "drop_oldest";
+const double CONNECTION_TIMEOUT_DEFAULT_VALUE = 3.;
+const double PARAMETER_ECHO_PERIOD_DEFAULT_VALUE = 1.;
+const bool PIPELINE_STATS_DEFAULT_VALUE = false;
+const std::string STAMP_DEFAULT_VALUE = "firing";
+const std::string COMPRESSION_DEFAULT_VALUE = "zstd";
+const int COMPRESSION_LEVEL_DEFAULT_VALUE = 1;
+const int COMPRESSION_BITS_DEFAULT_VALUE = 0;
+const bool COMPRESSION_DELTA_DEFAULT_VALUE = true;
+const std::string TEMPORAL_FILTER_DEFAULT_VALUE = "off";
+const double TEMPORAL_FILTER_ALPHA_DEFAULT_VALUE = .3;
+const int TEMPORAL_FILTER_FRAMES_DEFAULT_VALUE = 3;
+const double TEMPORAL_FILTER_SPECKLE_DEFAULT_VALUE = .5;
 
-struct BoolParam {
-  const std::string name;
-  const bool default_val;
-  const std::string desc;
-};
-
-const BoolParam GAIN_ASSIT = {"gain_assist", true, ""};
-const BoolParam USE_SALINITY = {"use_salinity", true, "Use salinity to calculate sound_speed."};
-
-const std::vector<BoolParam> BOOL = {GAIN_ASSIT, USE_SALINITY};
+}  // namespace params
 
-struct IntParam {
-  const std::string name;
-  const int min;
-  const int max;
-  const int default_val;
-  const std::string desc;
+// Connection to the sonar, advanced by OculusSonarNode::updateConnectionState and the driver callbacks.
+enum class ConnectionState {
+  DISCOVERING,  // Waiting for the status broadcast by the sonar
+  CONNECTING,  // The sonar is known, waiting for the driver to connect to it
+  CONFIGURING,  // The ROS parameters are being applied to the sonar
+  STREAMING,  // Configured, receiving pings (or dummy messages in standby)
+  LOST  // Connection lost or silent for connection_timeout seconds, the driver reconnects
 };
 
-const IntParam FREQUENCY_MODE = {"frequency_mode", 1, 2, 1,
-    "Sonar beam frequency mode.\n"
-    "\t1: Low frequency (1.2MHz, wide aperture).\n"
-    "\t2: High frequency (2.1Mhz, narrow aperture)."};
-
-const IntParam PING_RATE = {"ping_rate", 0, 5, 1,
-    "Frequency of ping fires.\n\t" + std::to_string(pingRateNormal) + ": 10Hz max ping rate.\n\t" + std::to_string(pingRateHigh) +
-        ": 15Hz max ping rate.\n\t" + std::to_string(pingRateHighest) + ": 40Hz max ping rate.\n\t" +
-        std::to_string(pingRateLow) + ": 5Hz max ping rate.\n\t" + std::to_string(pingRateLowest) + ": 2Hz max ping rate.\n\t" +
-        std::to_string(pingRateStandby) + ": Standby mode (no ping fire)"};
-
-const IntParam NBEAMS = {"nbeams", 0, 1, 1,
-    "Number of ping beams.\n"
-    "\t0: Oculus outputs 256 beams.\n"
-    "\t1: Oculus outputs 512 beams."};
-
-const IntParam GAMMA_CORRECTION = {"gamma_correction", 1, 255, 153, "Gamma correction, min=1, max=255."};
-
-const std::vector<IntParam> INT = {FREQUENCY_MODE, PING_RATE, NBEAMS, GAMMA_CORRECTION};
-
-struct DoubleParam {
-  const std::string name;
-  const double min;
-  const double max;
-  const double step;
-  const double default_val;
-  const std::string desc;
+// Run mode change wanted by the ping or driver thread. "run" is set by the connection timer, on the executor thread, since
+// set_parameter calls setConfigCallback synchronously.
+enum class RunModeRequest {
+  NONE,
+  STANDBY,  // disableRunMode()
+  RESUME  // enableRunMode()
 };
 
-const DoubleParam RANGE = {"range", .1, 120., .1, 5., "Sonar range (in meters), min=0.1, max=120.0."};
-const DoubleParam GAIN_PERCENT = {"gain_percent", .1, 100., .1, 50., "Gain percentage (%), min=0.1, max=100.0."};
-const DoubleParam SOUND_SPEED = {"sound_speed", 1400., 1600., .1, 1500.,
-    "Sound speed (in m/s, set to 0 for it to be calculated using salinity), min=1400.0, max=1600.0."};
-const DoubleParam SALINITY = {"salinity", 0., 100., .1, 0.,
-    "Salinity (in parts per thousand (ppt,ppm,g/kg), "
-    "used to calculate sound speed if needed), min=0.0, max=100"};
-
-const std::vector<DoubleParam> DOUBLE = {RANGE, GAIN_PERCENT, SOUND_SPEED, SALINITY};
-
-}  // namespace params
+// Configuration sent to the sonar. The driver waits for the sonar feedback, so the request runs on a separate thread.
+struct ConfigRequest {
+  std::vector<rclcpp::Parameter> parameters;  // Parameters changed by the request, empty when the whole config is applied
+  oculus::SonarDriver::PingConfig config;
+  std::future<std::pair<oculus::SonarDriver::PingConfig, double>> feedback;  // With the round trip duration (s)
+};
 
 class OculusSonarNode : public rclcpp::Node {
 public:
-  OculusSonarNode();
+  explicit OculusSonarNode(const rclcpp::NodeOptions& options = rclcpp::NodeOptions());
   ~OculusSonarNode();
 
 protected:
   const std::vector<std::string> dynamic_parameters_names_{params::FREQUENCY_MODE.name, params::PING_RATE.name,
       params::NBEAMS.name, params::GAIN_ASSIT.name, params::RANGE.name, params::GAMMA_CORRECTION.name, params::GAIN_PERCENT.name,
-      params::SOUND_SPEED.name, params::USE_SALINITY.name, params::SALINITY.name, "run"};
+      params::SOUND_SPEED.name, params::USE_SALINITY.name, params::SALINITY.name, params::DATA_DEPTH.name, "run"};
 
-  SonarParameters currentSonarParameters_;
-  SonarParameters currentRosParameters_;
+  // Immutable snapshot of the sonar parameters, read by the ping thread without lock and replaced (std::atomic_store) by the
+  // executor thread only, see sonarParameters() and setSonarParameters()
+  std::shared_ptr<const SonarParameters> currentSonarParameters_;
+  sonar_config::ParameterBatch ros_parameters_;  // Values of the ROS parameters and changes not sent yet, executor thread only
   oculus::SonarDriver::PingConfig currentConfig_;
 
-  bool is_running_;  // State value. Same value as ros parameter "run"
-  bool is_overheating_ = false;  // State value
-
-  mutable std::shared_mutex param_mutex_;  // multithreading protection
+  std::atomic<bool> is_running_;  // State value. Same value as ros parameter "run"
+  std::atomic<bool> is_overheating_{false};  // State value, written by the ping thread
+  std::atomic<RunModeRequest> run_mode_request_{RunModeRequest::NONE};  // Applied by updateConnectionState
 
   int get_subscription_count() const;
+  std::shared_ptr<const SonarParameters> sonarParameters() const;
+  void setSonarParameters(const SonarParameters& parameters);
 
 private:
   std::shared_ptr<oculus::SonarDriver> sonar_driver_;
@@ -173,67 +154,79 @@ private:
   const std::string frame_id_;
   const double temperature_warn_limit_;
   const double temperature_stop_limit_;
+  PingQueue<oculus::PingMessage::ConstPtr> ping_queue_;  // Hand pings over from the driver thread to ping_worker_
+  std::thread ping_worker_;
+  std::size_t reported_dropped_pings_ = 0;
+  bool stamp_firing_ = true;  // Pings stamped with their estimated firing time, instead of their reception time
+  SonarClock sonar_clock_;  // Ping thread only
+  std::atomic<double> clock_drift_{0.};
+  std::atomic<std::size_t> clock_resets_{0};
+  temporal_filter::Filter temporal_filter_;  // Ping thread only
+  std::vector<uint8_t> filtered_data_;  // Ping data with the filtered image, ping thread only
+  std::atomic<std::size_t> temporal_filter_resets_{0};
+  std::unique_ptr<PipelineStats> pipeline_stats_;  // Stage latencies published on /diagnostics, null if disabled
   rclcpp::Publisher<oculus_interfaces::msg::OculusStatus>::SharedPtr status_publisher_{nullptr};
   rclcpp::Publisher<oculus_interfaces::msg::Ping>::SharedPtr ping_publisher_{nullptr};
+  oculus_interfaces::msg::Ping ping_msg_;  // Reused when intra-process communication is disabled
+  rclcpp::Publisher<oculus_interfaces::msg::CompressedPing>::SharedPtr compressed_ping_publisher_{nullptr};
+  oculus_interfaces::msg::CompressedPing compressed_ping_msg_;  // Reused when intra-process communication is disabled
+  ping_codec::Encoder ping_encoder_;  // Ping thread only
   rclcpp::Publisher<sensor_msgs::msg::Temperature>::SharedPtr temperature_publisher_{nullptr};
   rclcpp::Publisher<sensor_msgs::msg::FluidPressure>::SharedPtr pressure_publisher_{nullptr};
 
   rclcpp::node_interfaces::OnSetParametersCallbackHandle::SharedPtr param_cb_{nullptr};
 
-  template <class T>
-  void updateRosConfigForParam(T& currentSonar_param, const T& new_param, const std::string& param_name);
-  void updateRosConfig();
-  template <class T>
-  void handleFeedbackForParam(rcl_interfaces::msg::SetParametersResult& result,
-      const rclcpp::Parameter& param,
-      const T& old_val,
-      const T& new_val,
-      const std::string& param_name) const;
-  void updateLocalParameters(SonarParameters& parameters, const std::vector<rclcpp::Parameter>& new_parameters);
-  void updateLocalParameters(SonarParameters& parameters, oculus::SonarDriver::PingConfig feedback);
-  void sendParamToSonar(rclcpp::Parameter param, rcl_interfaces::msg::SetParametersResult result);
+  // Connection state machine, the dates are steady clock nanoseconds (0 before the first event)
+  const double connection_timeout_;
+  std::atomic<ConnectionState> connection_state_{ConnectionState::DISCOVERING};
+  std::atomic<int64_t> last_status_date_{0};
+  std::atomic<int64_t> last_message_date_{0};
+  std::atomic<bool> waiting_first_ping_{true};
+  std::atomic<double> time_to_first_ping_{-1.};  // Since the start of the connection (node start or loss), < 0 before
+  std::atomic<int64_t> connection_start_date_{0};
+  std::atomic<int64_t> state_date_{0};
+  int64_t last_diagnostics_date_ = 0;
+  std::size_t connection_losses_ = 0;
+
+  // Parameter changes are merged (ros_parameters_) and sent in a single config, one request at a time
+  std::unique_ptr<ConfigRequest> config_request_;
+  double last_round_trip_ = -1.;  // Sonar config round trip (s), < 0 before the first one
+  double max_round_trip_ = 0.;
+
+  // Sonar values echoed in the pings, applied to the ROS parameters at most once every parameter_echo_period seconds
+  const double parameter_echo_period_;
+  PingEcho ping_echo_;
+  int64_t last_echo_date_ = 0;
+  rclcpp::TimerBase::SharedPtr connection_timer_{nullptr};
+  rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr diagnostics_publisher_{nullptr};
+
+  void updateRosConfig(const SonarParameters& sonar_parameters);
+  void applyPingEcho(int64_t now);
+  void setRosParameters(const std::vector<rclcpp::Parameter>& parameters);
+  void requestConfig(std::vector<rclcpp::Parameter> parameters);
+  void sendQueuedParameters();
+  bool handleConfigFeedback();
+  void reconcileFeedback(const ConfigRequest& request, const oculus::SonarDriver::PingConfig& feedback);
   rcl_interfaces::msg::SetParametersResult setConfigCallback(const std::vector<rclcpp::Parameter>& parameters);
 
   void enableRunMode();
   void disableRunMode();
+  void requestRunMode(RunModeRequest request);
+  void applyRunModeRequest();
   void checkOverheating(const double& new_temperature);
   void setMinimalFlags(uint8_t& flags) const;
   void checkMinimalFlags(const uint8_t& flags) const;
   void publishStatus(const OculusStatusMsg& status);
+  void enqueuePing(const oculus::PingMessage::ConstPtr& ping);
+  void processPings();
   void publishPing(const oculus::PingMessage::ConstPtr& pingMetadata);
   void handleDummy();
-};
 
-template <class T>
-void OculusSonarNode::updateRosConfigForParam(T& currentSonar_param, const T& new_param, const std::string& param_name) {
-  if (currentSonar_param != new_param) {
-    this->remove_on_set_parameters_callback(this->param_cb_.get());
-    RCLCPP_WARN_STREAM(this->get_logger(),
-        "The parameter " << param_name << " has change by it self from " << currentSonar_param << " to " << new_param);
-    currentSonar_param = new_param;
-    this->set_parameter(rclcpp::Parameter(param_name, new_param));
-    this->param_cb_ =
-        this->add_on_set_parameters_callback(std::bind(&OculusSonarNode::setConfigCallback, this, std::placeholders::_1));
-  }
-}
-
-template <class T>
-void OculusSonarNode::handleFeedbackForParam(rcl_interfaces::msg::SetParametersResult& result,
-    const rclcpp::Parameter& param,
-    const T& old_val,
-    const T& new_val,
-    const std::string& param_name) const {
-  if (old_val != new_val) {
-    if (param.get_name() == param_name) {
-      result.successful = false;
-      RCLCPP_WARN_STREAM(this->get_logger(), "Could not update " << param_name);
-      result.reason.append("Could not update " + param_name + ".\n");
-    } else {
-      RCLCPP_WARN_STREAM(this->get_logger(),
-          param_name << " change from " << old_val << " to " << new_val << " when updating the parameter " << param.get_name());
-      result.reason.append(param_name + " change.\n");
-    }
-  }
-}
+  static int64_t steadyNow();
+  void updateConnectionState();
+  void setConnectionState(ConnectionState state);
+  void publishDiagnostics();
+  oculus::SonarDriver::PingConfig configFromParameters(const SonarParameters& parameters) const;
+};
 
 #endif  // OCULUS_ROS2__OCULUS_SONAR_NODE_HPP_
@@ -37,20 +37,26 @@
 
 #include <memory>
 
+#include <oculus_interfaces/msg/compressed_ping.hpp>
 #include <oculus_interfaces/msg/ping.hpp>
+#include <oculus_ros2/ping_codec.hpp>
 #include <oculus_ros2/sonar_viewer.hpp>
 #include <rclcpp/rclcpp.hpp>
 
 class OculusViewerNode : public rclcpp::Node {
 public:
-  OculusViewerNode();
+  explicit OculusViewerNode(const rclcpp::NodeOptions& options = rclcpp::NodeOptions());
   ~OculusViewerNode();
 
 private:
   // rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr image_publisher_;
   SonarViewer sonar_viewer_;
   rclcpp::Subscription<oculus_interfaces::msg::Ping>::SharedPtr ping_subscription_;
-  void pingCallback(const oculus_interfaces::msg::Ping& ping_msg) const;
+  rclcpp::Subscription<oculus_interfaces::msg::CompressedPing>::SharedPtr compressed_ping_subscription_;
+  ping_codec::Decoder ping_decoder_;
+  oculus_interfaces::msg::Ping decoded_ping_;  // Reused from one compressed ping to the other
+  void pingCallback(const oculus_interfaces::msg::Ping::ConstSharedPtr& ping_msg) const;
+  void compressedPingCallback(const oculus_interfaces::msg::CompressedPing::ConstSharedPtr& compressed_ping_msg);
 };
 
 #endif  // OCULUS_ROS2__OCULUS_VIEWER_NODE_HPP_
@@ -0,0 +1,142 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef OCULUS_ROS2__PING_CODEC_HPP_
+#define OCULUS_ROS2__PING_CODEC_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <oculus_interfaces/msg/compressed_ping.hpp>
+#include <oculus_interfaces/msg/ping.hpp>
+
+struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
+
+namespace ping_codec {
+
+// General purpose compressor applied after the ping transform.
+enum class Format {
+  LZ4,  // Fastest, lowest ratio
+  ZSTD  // Better ratio, slower at high levels
+};
+
+// "lz4" or "zstd". Returns false if the string is not a known format.
+bool formatFromString(const std::string& name, Format& format);
+const char* toString(Format format);
+
+struct Parameters {
+  Format format = Format::ZSTD;
+  int level = 1;  // zstd compression level, or lz4 acceleration (higher is faster with a lower ratio)
+  int bits = 0;  // Bits kept per sample by the lossy mode, 0 (or the sample size) for lossless
+  bool delta = true;  // Samples replaced by their difference with the previous row (for correlated ranges)
+};
+
+// Geometry of a ping data buffer (Ping.ping_data): the sonar message, ending with n_ranges rows of step bytes, each one
+// made of its gain (4 bytes, if has_gains) and n_beams samples of sample_size bytes.
+struct Layout {
+  int n_ranges;
+  int n_beams;
+  int step;
+  int sample_size;
+  bool has_gains;
+  int offset = -1;  // Offset of the image in the buffer, -1 if unknown. The image must end the buffer to be transformed.
+};
+
+Layout layout(const oculus_interfaces::msg::Ping& ping);
+
+// Copies all the fields of a ping but its ping_data.
+void copyMetadata(const oculus_interfaces::msg::Ping& from, oculus_interfaces::msg::Ping& to);
+
+// The gains and, with delta, the samples of the image are replaced by their difference with the previous row (the echoes
+// of neighbouring ranges are close when the range resolution is finer than the pulse), the 16 bits samples and the gains
+// are split in byte planes, so that the compressor sees long runs of small values. On uncorrelated speckle the delta
+// lowers the ratio, it can be disabled. The lossy mode rounds the samples to their bits most significant bits before the
+// transform. The message header and the bearings are compressed as they are. A buffer whose layout is not consistent is
+// compressed without transform (and losslessly).
+// The buffers are kept from one ping to the other.
+class Encoder {
+public:
+  explicit Encoder(const Parameters& parameters = Parameters());
+
+  const Parameters& parameters() const { return parameters_; }
+
+  // Compresses size bytes of data into out (resized). Returns the bits kept per sample, 0 if lossless.
+  int encode(const uint8_t* data, std::size_t size, const Layout& layout, std::vector<uint8_t>& out);
+
+  // Compresses the ping data described by msg.ping (filled beforehand, with an empty ping_data) into msg.
+  void encode(const uint8_t* data, std::size_t size, oculus_interfaces::msg::CompressedPing& msg);
+
+  // Fills msg with ping, ping.ping_data compressed.
+  void encode(const oculus_interfaces::msg::Ping& ping, oculus_interfaces::msg::CompressedPing& msg);
+
+private:
+  struct ZstdContextDeleter {
+    void operator()(ZSTD_CCtx_s* context) const;
+  };
+
+  Parameters parameters_;
+  std::vector<uint8_t> planes_;  // Transformed buffer
+  std::unique_ptr<ZSTD_CCtx_s, ZstdContextDeleter> zstd_context_;
+};
+
+// Inverse of Encoder. Throws std::runtime_error if the data is corrupted or does not match the layout.
+class Decoder {
+public:
+  Decoder();
+
+  // Decompresses data, encoded with parameters (but its level), into out (resized to size bytes).
+  void decode(const uint8_t* data,
+      std::size_t data_size,
+      const Parameters& parameters,
+      const Layout& layout,
+      std::size_t size,
+      std::vector<uint8_t>& out);
+
+  // Fills ping with msg.ping and its decoded ping_data. The capacity of ping.ping_data is reused.
+  void decode(const oculus_interfaces::msg::CompressedPing& msg, oculus_interfaces::msg::Ping& ping);
+
+private:
+  struct ZstdContextDeleter {
+    void operator()(ZSTD_DCtx_s* context) const;
+  };
+
+  std::vector<uint8_t> planes_;
+  std::unique_ptr<ZSTD_DCtx_s, ZstdContextDeleter> zstd_context_;
+};
+
+}  // namespace ping_codec
+
+#endif  // OCULUS_ROS2__PING_CODEC_HPP_
@@ -0,0 +1,126 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef OCULUS_ROS2__PING_QUEUE_HPP_
+#define OCULUS_ROS2__PING_QUEUE_HPP_
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// What to do when a ping arrives while the queue is full.
+enum class DropPolicy {
+  DROP_OLDEST,  // Keep the latest pings, the consumer always works on the freshest data
+  DROP_NEWEST  // Keep the queued pings, the incoming one is discarded
+};
+
+// Bounded single producer / single consumer queue handing pings from the driver network thread to a worker thread. The
+// producer never blocks: when the queue is full a ping is dropped according to the DropPolicy and counted.
+template <class T>
+class PingQueue {
+public:
+  PingQueue(std::size_t capacity, DropPolicy policy) : buffer_(std::max<std::size_t>(capacity, 1)), policy_(policy) {}
+
+  // Returns false if a ping has been dropped
+  bool push(T item) {
+    {
+      std::lock_guard<std::mutex> l(mutex_);
+      if (closed_) {
+        return false;
+      }
+      if (size_ == buffer_.size()) {
+        ++dropped_;
+        if (policy_ == DropPolicy::DROP_NEWEST) {
+          return false;
+        }
+        head_ = (head_ + 1) % buffer_.size();  // Drop the oldest
+        --size_;
+      }
+      buffer_[(head_ + size_) % buffer_.size()] = std::move(item);
+      ++size_;
+    }
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // Blocks until a ping is available. Returns false once the queue is closed and empty.
+  bool pop(T& item) {
+    std::unique_lock<std::mutex> l(mutex_);
+    not_empty_.wait(l, [this] { return size_ > 0 || closed_; });
+    if (size_ == 0) {
+      return false;
+    }
+    item = std::move(buffer_[head_]);
+    buffer_[head_] = T();  // Release the ping as soon as possible
+    head_ = (head_ + 1) % buffer_.size();
+    --size_;
+    return true;
+  }
+
+  // Wakes up the consumer, following push() are ignored
+  void close() {
+    {
+      std::lock_guard<std::mutex> l(mutex_);
+      closed_ = true;
+    }
+    not_empty_.notify_all();
+  }
+
+  std::size_t size() const {
+    std::lock_guard<std::mutex> l(mutex_);
+    return size_;
+  }
+
+  std::size_t dropped() const {
+    std::lock_guard<std::mutex> l(mutex_);
+    return dropped_;
+  }
+
+  std::size_t capacity() const { return buffer_.size(); }
+
+  DropPolicy policy() const { return policy_; }
+
+private:
+  std::vector<T> buffer_;  // Ring buffer, preallocated
+  const DropPolicy policy_;
+  std::size_t head_ = 0;
+  std::size_t size_ = 0;
+  std::size_t dropped_ = 0;
+  bool closed_ = false;
+  mutable std::mutex mutex_;
+  std::condition_variable not_empty_;
+};
+
+#endif  // OCULUS_ROS2__PING_QUEUE_HPP_
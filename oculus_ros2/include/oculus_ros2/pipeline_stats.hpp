@@ -0,0 +1,131 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef OCULUS_ROS2__PIPELINE_STATS_HPP_
+#define OCULUS_ROS2__PIPELINE_STATS_HPP_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Stages of the ping pipeline, from the sonar firing to the published images.
+enum class PipelineStage {
+  TRANSPORT,  // Sonar firing to host reception, above the minimum of the window (the sonar clock is not synchronized)
+  QUEUE,  // Host reception to the start of the processing by the ping thread
+  FILTER,  // Temporal filter of the ping image
+  CONVERSION,  // Driver message to ROS ping message
+  PUBLISH,  // Ping message publication
+  COMPRESSION,  // Encoding of the compressed ping
+  FAN_RENDER,  // Fan images remap (each resolution)
+  DETECTION,  // CFAR detection of the points output
+  IMAGE_PUBLISH,  // Publication of the image outputs
+  TOTAL,  // Host reception to the end of the processing
+  COUNT
+};
+
+const char* toString(PipelineStage stage);
+
+// Latencies of the last samples (ring buffer), summarized by percentiles.
+class LatencyWindow {
+public:
+  struct Summary {
+    std::size_t count = 0;
+    double p50 = 0.;
+    double p95 = 0.;
+    double p99 = 0.;
+    double max = 0.;
+  };
+
+  explicit LatencyWindow(std::size_t capacity);
+
+  void add(double seconds);
+  // relative_to_min removes the smallest sample from all of them (latencies measured with an unknown offset)
+  Summary summary(bool relative_to_min = false) const;
+
+private:
+  std::vector<double> samples_;
+  std::size_t next_ = 0;
+  std::size_t size_ = 0;
+};
+
+// Rolling latency statistics of the ping pipeline, ping throughput and pings missing from the ping_id sequence.
+// The probes lock a mutex which is only contended by report(), called at 1 Hz from a single thread, for the copy of the
+// windows: they are sorted out of the lock.
+class PipelineStats {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit PipelineStats(std::size_t window = 512);
+
+  void record(PipelineStage stage, double seconds);
+  void recordPing(uint32_t ping_id, std::size_t size);
+
+  // Percentiles of each stage (ms), pings and bytes per second since the previous report, and ping_id gaps
+  std::vector<std::pair<std::string, std::string>> report();
+
+private:
+  mutable std::mutex mutex_;
+  std::vector<LatencyWindow> stages_;  // Indexed by PipelineStage
+  std::vector<LatencyWindow> report_stages_;  // Copy of stages_ sorted by report() out of the lock, reused
+  bool has_ping_id_ = false;
+  uint32_t last_ping_id_ = 0;
+  std::size_t missing_pings_ = 0;
+  std::size_t ping_id_resets_ = 0;
+  std::size_t pings_ = 0;  // Since the last report
+  std::size_t bytes_ = 0;
+  Clock::time_point last_report_;
+};
+
+// Times its scope as a stage of the pipeline. Does nothing, not even reading the clock, if stats is null.
+class StageProbe {
+public:
+  StageProbe(PipelineStats* stats, PipelineStage stage)
+    : stats_(stats), stage_(stage), start_(stats ? PipelineStats::Clock::now() : PipelineStats::Clock::time_point()) {}
+  ~StageProbe() {
+    if (stats_) {
+      stats_->record(stage_, std::chrono::duration<double>(PipelineStats::Clock::now() - start_).count());
+    }
+  }
+  StageProbe(const StageProbe&) = delete;
+  StageProbe& operator=(const StageProbe&) = delete;
+
+private:
+  PipelineStats* stats_;
+  const PipelineStage stage_;
+  const PipelineStats::Clock::time_point start_;
+};
+
+#endif  // OCULUS_ROS2__PIPELINE_STATS_HPP_
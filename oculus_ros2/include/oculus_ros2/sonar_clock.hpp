@@ -0,0 +1,90 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef OCULUS_ROS2__SONAR_CLOCK_HPP_
+#define OCULUS_ROS2__SONAR_CLOCK_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+// Relation between the sonar clock, which dates the ping firings in microseconds on 32 bits (wrapping every ~71 min), and
+// the host clock, which dates their reception with the network and queueing jitter.
+//
+// The firing dates are unwrapped to 64 bits with the help of the reception dates, so that a wrap during a long silence
+// (standby) is not missed. The host time of the firings is estimated by a linear fit (offset and drift) of the lower
+// envelope of reception - firing: the minimum of each bin of bin_duration seconds, over the last n_bins bins. The
+// estimate follows the sonar clock, it is only late by the minimum transport delay, which cannot be observed.
+class SonarClock {
+public:
+  explicit SonarClock(double bin_duration = 1., std::size_t n_bins = 60);
+
+  // Adds a ping fired at firing_date (sonar clock, us) and received at reception (host clock, ns). Returns the unwrapped
+  // firing date (us): the firing_date of the first ping (or of the first one after a sonar restart) plus the sonar time
+  // elapsed since, wraps included.
+  uint64_t update(uint32_t firing_date, int64_t reception);
+
+  // Host time (ns) of an unwrapped firing date, reception times before the first update
+  int64_t toHost(uint64_t firing_date) const;
+
+  bool initialized() const { return initialized_; }
+  double drift() const { return drift_; }  // Host seconds per sonar second - 1
+  std::size_t resets() const { return resets_; }  // Sonar restarts or host clock jumps
+
+private:
+  struct Bin {
+    int64_t index;
+    double x;  // Sonar time since the reference (s)
+    double y;  // Minimum of reception - firing in the bin, minus the reference offset (s)
+  };
+
+  const double bin_duration_;
+  const std::size_t n_bins_;
+
+  bool initialized_ = false;
+  uint32_t last_date_ = 0;
+  int64_t last_reception_ = 0;
+  uint64_t unwrapped_ = 0;
+
+  uint64_t reference_date_ = 0;  // Unwrapped sonar date (us) and host time (ns) of the first ping since the last reset
+  int64_t reference_reception_ = 0;
+  std::deque<Bin> bins_;
+  double offset_ = 0.;  // Fit of the bin minima: y = offset_ + drift_ * x
+  double drift_ = 0.;
+  std::size_t resets_ = 0;
+
+  void reset(uint64_t date, int64_t reception);
+  void fit();
+  double x(uint64_t date) const { return 1e-6 * static_cast<double>(date - reference_date_); }
+};
+
+#endif  // OCULUS_ROS2__SONAR_CLOCK_HPP_
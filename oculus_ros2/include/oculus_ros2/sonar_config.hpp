@@ -0,0 +1,194 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef OCULUS_ROS2__SONAR_CONFIG_HPP_
+#define OCULUS_ROS2__SONAR_CONFIG_HPP_
+
+#include <oculus_driver/SonarDriver.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <rclcpp/parameter.hpp>
+
+// Values of the ROS parameters of the sonar configuration
+struct SonarParameters {
+  int frequency_mode;
+  int ping_rate;
+  int nbeams;
+  int data_depth;
+  bool gain_assist;
+  double range;
+  int gamma_correction;
+  double gain_percent;
+  double sound_speed;
+  bool use_salinity;
+  double salinity;
+};
+
+namespace flagByte {
+const int RANGE_AS_METERS = 0x01;  // bit 0: 0 = interpret range as percent, 1 = interpret range as meters
+const int DATA_DEPTH = 0x02;  // bit 1: 0 = 8 bit data, 1 = 16 bit data
+const int SEND_GAINS = 0x04;  // bit 2: 0 = won't send gain, 1 = send gain
+const int SIMPLE_PING = 0x08;  // bit 3: 0 = send full return message, 1 = send simple return message
+const int GAIN_ASSIST = 0x10;  // bit 4: gain assist?
+// const int ?? = 0x20;  // bit 5: ?
+const int NBEAMS = 0x40;  // bit 6: enable 512 beams
+// const int ?? = 0x80;  // bit 7: ?
+}  // namespace flagByte
+
+namespace params {
+
+struct BoolParam {
+  const std::string name;
+  const bool default_val;
+  const std::string desc;
+};
+
+const BoolParam GAIN_ASSIT = {"gain_assist", true, ""};
+const BoolParam USE_SALINITY = {"use_salinity", true, "Use salinity to calculate sound_speed."};
+
+const std::vector<BoolParam> BOOL = {GAIN_ASSIT, USE_SALINITY};
+
+struct IntParam {
+  const std::string name;
+  const int min;
+  const int max;
+  const int default_val;
+  const std::string desc;
+  const int step = 1;  // The values are min + k * step
+};
+
+const IntParam FREQUENCY_MODE = {"frequency_mode", 1, 2, 1,
+    "Sonar beam frequency mode.\n"
+    "\t1: Low frequency (1.2MHz, wide aperture).\n"
+    "\t2: High frequency (2.1Mhz, narrow aperture)."};
+
+const IntParam PING_RATE = {"ping_rate", 0, 5, 1,
+    "Frequency of ping fires.\n\t" + std::to_string(pingRateNormal) + ": 10Hz max ping rate.\n\t" + std::to_string(pingRateHigh) +
+        ": 15Hz max ping rate.\n\t" + std::to_string(pingRateHighest) + ": 40Hz max ping rate.\n\t" +
+        std::to_string(pingRateLow) + ": 5Hz max ping rate.\n\t" + std::to_string(pingRateLowest) + ": 2Hz max ping rate.\n\t" +
+        std::to_string(pingRateStandby) + ": Standby mode (no ping fire)"};
+
+const IntParam NBEAMS = {"nbeams", 0, 1, 1,
+    "Number of ping beams.\n"
+    "\t0: Oculus outputs 256 beams.\n"
+    "\t1: Oculus outputs 512 beams."};
+
+const IntParam GAMMA_CORRECTION = {"gamma_correction", 1, 255, 153, "Gamma correction, min=1, max=255."};
+
+const IntParam DATA_DEPTH = {"data_depth", 8, 16, 8,
+    "Size of the ping samples (in bits).\n"
+    "\t8: 8 bits samples, the fan image is mono8.\n"
+    "\t16: 16 bits samples, the fan image is mono16.",
+    8};
+
+const std::vector<IntParam> INT = {FREQUENCY_MODE, PING_RATE, NBEAMS, GAMMA_CORRECTION, DATA_DEPTH};
+
+struct DoubleParam {
+  const std::string name;
+  const double min;
+  const double max;
+  const double step;
+  const double default_val;
+  const std::string desc;
+};
+
+const DoubleParam RANGE = {"range", .1, 120., .1, 5., "Sonar range (in meters), min=0.1, max=120.0."};
+const DoubleParam GAIN_PERCENT = {"gain_percent", .1, 100., .1, 50., "Gain percentage (%), min=0.1, max=100.0."};
+const DoubleParam SOUND_SPEED = {"sound_speed", 1400., 1600., .1, 1500.,
+    "Sound speed (in m/s, set to 0 for it to be calculated using salinity), min=1400.0, max=1600.0."};
+const DoubleParam SALINITY = {"salinity", 0., 100., .1, 0.,
+    "Salinity (in parts per thousand (ppt,ppm,g/kg), "
+    "used to calculate sound speed if needed), min=0.0, max=100"};
+
+const std::vector<DoubleParam> DOUBLE = {RANGE, GAIN_PERCENT, SOUND_SPEED, SALINITY};
+
+}  // namespace params
+
+namespace sonar_config {
+
+// ROS side of the sonar configuration (executor thread): the values of the sonar parameters and the changes not sent to the
+// sonar yet. The changes are merged by name, the last value of each parameter is sent, in a single config.
+class ParameterBatch {
+public:
+  explicit ParameterBatch(const SonarParameters& parameters = SonarParameters());
+
+  const SonarParameters& parameters() const { return parameters_; }
+
+  // Applies the parameters (ROS parameter callback). The sonar ones are queued, unless they are the values set by
+  // applySonarValues(). Returns the parameters which are not sonar ones ("run" excepted).
+  std::vector<rclcpp::Parameter> set(const std::vector<rclcpp::Parameter>& parameters);
+
+  // Sets the parameters which differ from the values applied by the sonar (the doubles by more than half their step)
+  // through set_parameters, which calls set() back synchronously: they are not sent back to the sonar. Returns them.
+  std::vector<rclcpp::Parameter> applySonarValues(const SonarParameters& sonar,
+      const std::function<void(const std::vector<rclcpp::Parameter>&)>& set_parameters);
+  bool applyingSonarValues() const { return applying_sonar_values_; }
+
+  bool hasQueued() const { return !queued_.empty(); }
+  std::vector<rclcpp::Parameter> takeQueued();  // The queue is left empty
+  void clearQueued() { queued_.clear(); }
+
+private:
+  SonarParameters parameters_;
+  std::vector<rclcpp::Parameter> queued_;  // Changed while a request was in flight or the sonar not connected
+  bool applying_sonar_values_ = false;
+};
+
+// Sets the field of a sonar parameter. Returns false if it is not one.
+bool setParameter(SonarParameters& parameters, const rclcpp::Parameter& parameter);
+
+// Sonar configuration from the parameters, the other fields (and flags) are taken from base
+oculus::SonarDriver::PingConfig toConfig(const SonarParameters& parameters, oculus::SonarDriver::PingConfig base);
+
+// Parameters applied by the sonar, use_salinity is taken from base (not part of the config)
+SonarParameters fromConfig(const oculus::SonarDriver::PingConfig& config, SonarParameters base);
+
+// Value of a parameter the sonar did not apply as requested
+struct Mismatch {
+  std::string name;
+  double requested;
+  double applied;
+  bool changed;  // Part of the changed parameters, otherwise changed by the sonar as a side effect
+};
+
+// Compares the config requested for the changed parameters with the one applied by the sonar. The values are matched with
+// the parameters by name. Empty if changed is empty (whole config).
+std::vector<Mismatch> compareFeedback(const std::vector<rclcpp::Parameter>& changed,
+    const oculus::SonarDriver::PingConfig& requested,
+    const oculus::SonarDriver::PingConfig& feedback);
+
+}  // namespace sonar_config
+
+#endif  // OCULUS_ROS2__SONAR_CONFIG_HPP_
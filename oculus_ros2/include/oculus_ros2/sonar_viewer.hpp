@@ -33,7 +33,6 @@
 #ifndef OCULUS_ROS2__SONAR_VIEWER_HPP_
 #define OCULUS_ROS2__SONAR_VIEWER_HPP_
 
-#include <cv_bridge/cv_bridge.hpp>
 #include <oculus_driver/AsyncService.h>
 #include <oculus_driver/SonarDriver.h>
 
@@ -41,41 +40,209 @@
 #include <climits>
 #include <iostream>
 #include <limits>
+#include <memory>
 #include <string>
 #include <type_traits>
 #include <vector>
 
 #include <oculus_interfaces/msg/ping.hpp>
+#include <oculus_ros2/cfar.hpp>
 #include <oculus_ros2/conversions.hpp>
+#include <oculus_ros2/fan_interpolation.hpp>
+#include <oculus_ros2/fan_remap_cache.hpp>
+#include <oculus_ros2/gain_compensation.hpp>
+#include <oculus_ros2/pipeline_stats.hpp>
 #include <opencv2/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <rclcpp/rclcpp.hpp>
+#include <sensor_msgs/image_encodings.hpp>
 #include <sensor_msgs/msg/image.hpp>
+#include <sensor_msgs/msg/point_cloud2.hpp>
 #include <std_msgs/msg/header.hpp>
 
+// OpenCV type and ROS encoding of the ping samples, the sonar sends 8 or 16 bits samples.
+template <class Sample>
+struct SampleEncoding;
+
+template <>
+struct SampleEncoding<uint8_t> {
+  static constexpr int CV_TYPE = CV_8U;
+  static constexpr const char* ROS_ENCODING = "mono8";
+};
+
+template <>
+struct SampleEncoding<uint16_t> {
+  static constexpr int CV_TYPE = CV_16U;
+  static constexpr const char* ROS_ENCODING = "mono16";
+};
+
 class SonarViewer {
 public:
   explicit SonarViewer(rclcpp::Node* node);
   ~SonarViewer();
   void publishFan(const oculus::PingMessage::ConstPtr& ping, const std::string& frame_id = "sonar") const;
+  void publishFan(const oculus::PingMessage::ConstPtr& ping, const std_msgs::msg::Header& header) const;
+  // ping_data replaces the data of ping (same layout, filtered image)
+  void publishFan(const oculus::PingMessage::ConstPtr& ping,
+      const std::vector<uint8_t>& ping_data,
+      const std_msgs::msg::Header& header) const;
   void publishFan(const oculus_interfaces::msg::Ping& ros_ping_msg) const;
   void publishFan(const int& width,
       const int& height,
       const int& offset,
       const std::vector<uint8_t>& ping_data,
       const int& master_mode,
-      const std_msgs::msg::Header& header) const;
+      const int16_t* bearings,
+      const int& step,
+      const int& sample_size,
+      const std_msgs::msg::Header& header,
+      const double& range_resolution = 0.) const;  // Needed by the points output, not published if 0
+
+  // Renders the fan of a ping into image without publishing it. Returns false if the ping layout is not supported.
+  // Can be called concurrently.
+  bool renderFan(const oculus_interfaces::msg::Ping& ros_ping_msg, sensor_msgs::msg::Image& image) const;
+
+  // Subscribers to the image outputs (fan images, polar, raw and compensated when enabled) and to the points when enabled
+  std::size_t subscriptionCount() const;
+
+  // Times the fan rendering and the image publications into stats, nullptr (default) to disable
+  void setStats(PipelineStats* stats);
+
+  // Remap tables of the full resolution fan
+  std::size_t remapCacheHits() const;
+  std::size_t remapCacheMisses() const;
 
   rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr image_publisher_;
+  rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr compensated_publisher_;
+  rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr polar_publisher_;  // ranges x beams samples, gains stripped
+  rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr raw_publisher_;  // Ping rows as sent by the sonar, gains included
+  rclcpp::Publisher<sensor_msgs::msg::PointCloud2>::SharedPtr points_publisher_;  // CFAR detections (x, y, z, intensity)
 
 protected:
   const double LOW_FREQUENCY_BEARING_APERTURE_ = 65.;
   const double HIGHT_FREQUENCY_BEARING_APERTURE_ = 40.;
   const int SIZE_OF_GAIN_ = 4;
+  static constexpr int MAX_IMAGE_LEVELS_ = 5;  // Down to 1/16 of the full resolution
 
 private:
+  // Reduced resolution fan (1/divisor of the full resolution fan in each dimension), published on image_<divisor>. It is
+  // rendered with its own remap tables from the polar image averaged over divisor ranges, not by downscaling the fan.
+  struct FanLevel {
+    int divisor;
+    rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr publisher;
+    FanRemapCache remap_cache;
+    sensor_msgs::msg::Image msg;
+    std::vector<uint8_t> polar;  // Reduced polar image (height / divisor ranges x width beams)
+  };
+
   const rclcpp::Node* node_;
+  gain_compensation::Mode gain_compensation_mode_ = gain_compensation::Mode::OFF;
+  mutable FanRemapCache remap_cache_;
+  PipelineStats* stats_ = nullptr;
+  mutable sensor_msgs::msg::Image image_msg_;  // Preallocated fan image, filled in place by cv::remap
+  mutable sensor_msgs::msg::Image compensated_msg_;
+  mutable sensor_msgs::msg::Image polar_msg_;
+  mutable sensor_msgs::msg::Image raw_msg_;
+  mutable cfar::Detector detector_;  // Method OFF if the points are disabled
+  mutable std::vector<float> detector_image_;  // Gain compensated polar image given to the detector
+  mutable std::vector<cfar::Detection> detections_;
+  mutable sensor_msgs::msg::PointCloud2 points_msg_;
+  std::vector<std::unique_ptr<FanLevel>> levels_;  // Levels below the full resolution, divisors 2, 4, 8...
+  // Region of interest and size of the full resolution fan (image_* parameters), 0 for the whole fan and a fitted size
+  double image_min_range_ = 0.;  // In meters
+  double image_max_range_ = 0.;
+  double image_min_bearing_ = 0.;  // In degrees
+  double image_max_bearing_ = 0.;
+  int image_width_ = 0;  // In pixels
+  int image_height_ = 0;
+  double image_resolution_ = 0.;  // In meters per pixel
+  fan_interpolation::Method interpolation_ = fan_interpolation::Method::CUBIC;
+
+  // Checks that height rows of step bytes, each with an optional gain and width samples, fit in data_size bytes from offset.
+  // An image without beams or ranges is rejected.
+  bool checkLayout(const int& width,
+      const int& height,
+      const int& offset,
+      const std::size_t& data_size,
+      const int& step,
+      const int& sample_size,
+      int& gain_size) const;
+  // Region of the image_* parameters for a polar image reduced divisor times along the ranges
+  FanRegion fanRegion(const double& range_resolution, const int& divisor) const;
+  std::shared_ptr<const FanRemap> fanRemap(FanRemapCache& cache,
+      const int& width,
+      const int& height,
+      const int& master_mode,
+      const int16_t* bearings,
+      const FanRegion& region) const;
+
+  template <class Sample>
+  static void fillFan(const FanRemap& remap,
+      const int& width,
+      const int& height,
+      const uint8_t* rows,
+      const int& step,
+      const int& gain_size,
+      const std_msgs::msg::Header& header,
+      sensor_msgs::msg::Image& msg);
+  template <class Sample>
+  void renderPing(const int& width,
+      const int& height,
+      const uint8_t* rows,
+      const int& step,
+      const int& gain_size,
+      const int& master_mode,
+      const int16_t* bearings,
+      const std_msgs::msg::Header& header,
+      const double& range_resolution) const;
+  template <class Sample>
+  void publishLevel(FanLevel& level,
+      const int& width,
+      const int& height,
+      const uint8_t* rows,
+      const int& step,
+      const int& gain_size,
+      const int& master_mode,
+      const int16_t* bearings,
+      const std_msgs::msg::Header& header,
+      const double& range_resolution) const;
+  template <class Sample>
+  void publishPoints(const int& width,
+      const int& height,
+      const uint8_t* rows,
+      const int& step,
+      const int& gain_size,
+      const int& master_mode,
+      const int16_t* bearings,
+      const std_msgs::msg::Header& header,
+      const double& range_resolution) const;
+  template <class Sample>
+  void publishCompensated(const int& width,
+      const int& height,
+      const uint8_t* rows,
+      const int& step,
+      const std_msgs::msg::Header& header) const;
+
+  // fill(msg) is given the message to publish: a new one handed over to rclcpp with intra-process communication
+  // (publish(const T&) would copy it), reused_msg otherwise, whose buffer is only reallocated when the data grows. The
+  // intra-process path allocates the message and its buffer on each publication, as the subscribers keep them.
+  template <class Msg, class Fill>
+  void publishMessage(rclcpp::Publisher<Msg>& publisher, Msg& reused_msg, Fill&& fill) const;
 };
 
+template <class Msg, class Fill>
+void SonarViewer::publishMessage(rclcpp::Publisher<Msg>& publisher, Msg& reused_msg, Fill&& fill) const {
+  if (node_->get_node_options().use_intra_process_comms()) {
+    auto msg = std::make_unique<Msg>();
+    fill(*msg);
+    StageProbe probe(stats_, PipelineStage::IMAGE_PUBLISH);
+    publisher.publish(std::move(msg));
+  } else {
+    fill(reused_msg);
+    StageProbe probe(stats_, PipelineStage::IMAGE_PUBLISH);
+    publisher.publish(reused_msg);
+  }
+}
+
 #endif  // OCULUS_ROS2__SONAR_VIEWER_HPP_
@@ -0,0 +1,114 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef OCULUS_ROS2__TEMPORAL_FILTER_HPP_
+#define OCULUS_ROS2__TEMPORAL_FILTER_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace temporal_filter {
+
+// Combination of the consecutive pings.
+enum class Mode {
+  OFF,  // Pings published as received
+  EMA,  // Exponential moving average, weight alpha on the last ping
+  MEDIAN,  // Median of the last frames pings, robust to a single bright ping
+  SPECKLE  // Temporal Lee filter: the moving average where the ping varies as speckle, the ping where it varies more
+};
+
+// "off", "ema", "median" or "speckle". Returns false if the string is not a known mode.
+bool modeFromString(const std::string& name, Mode& mode);
+
+struct Parameters {
+  Mode mode = Mode::OFF;
+  double alpha = .3;  // EMA and SPECKLE: weight of the last ping, in ]0, 1]
+  int frames = 3;  // MEDIAN: number of pings, odd, up to MAX_FRAMES
+  double speckle = .5;  // SPECKLE: coefficient of variation (std / mean) of the speckle of a static scene
+};
+
+const int MAX_FRAMES = 15;
+
+// Geometry of the pings, the filter restarts from the last ping when it changes.
+struct Geometry {
+  int n_ranges;
+  int n_beams;
+  int step;
+  int sample_size;
+  bool has_gains;
+  int master_mode;
+  double range;
+
+  bool operator==(const Geometry& other) const;
+  bool operator!=(const Geometry& other) const { return !(*this == other); }
+};
+
+// Temporal filter of the ping images. The pings are filtered in the gain compensated domain (value / sqrt(gain), the
+// gains vary from one ping to the other with gain_assist), and written back with the gains of the last ping. The frames
+// are preallocated on the first ping of a geometry, the kernels use the widest SIMD instruction set available at
+// runtime (AVX2, SSE2 or NEON).
+class Filter {
+public:
+  explicit Filter(const Parameters& parameters = Parameters());
+
+  const Parameters& parameters() const { return parameters_; }
+  std::size_t resets() const { return resets_; }
+
+  // Filters in place the image of a ping: n_ranges rows of step bytes, each one made of its gain (if has_gains) and
+  // n_beams samples of sample_size bytes (1 or 2). Does nothing if the mode is OFF or the layout is not supported.
+  void apply(uint8_t* rows, const Geometry& geometry);
+
+  // The next ping restarts the filter.
+  void reset() { initialized_ = false; }
+
+private:
+  Parameters parameters_;
+  Geometry geometry_{};
+  bool initialized_ = false;
+  std::size_t resets_ = 0;
+  std::vector<float> frame_;  // Last ping, gain compensated
+  std::vector<float> mean_;  // EMA and SPECKLE: moving average of the pings
+  std::vector<float> squares_;  // SPECKLE: moving average of the squared pings
+  std::vector<float> ring_;  // MEDIAN: last frames pings, frames x cells
+  int ring_next_ = 0;
+  std::vector<std::pair<int, int>> network_;  // MEDIAN: compare-exchanges between frames leading to the median
+  std::vector<float> sorted_;  // MEDIAN: ring values of a block of cells, sorted in place
+  std::array<bool, MAX_FRAMES> loaded_{};  // MEDIAN: frames of the block already read into sorted_
+};
+
+}  // namespace temporal_filter
+
+#endif  // OCULUS_ROS2__TEMPORAL_FILTER_HPP_
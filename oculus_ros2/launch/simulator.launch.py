@@ -0,0 +1,78 @@
+# BSD 3-Clause License
+#
+# Copyright (c) 2022, ENSTA-Bretagne
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice, this
+#    list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its
+#    contributors may be used to endorse or promote products derived from
+#    this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+# OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+import os
+
+from ament_index_python.packages import get_package_share_directory
+from launch import LaunchDescription
+from launch.actions import DeclareLaunchArgument
+from launch.substitutions import LaunchConfiguration
+from launch_ros.actions import Node
+
+
+def generate_launch_description():
+
+    ld = LaunchDescription()
+
+    config = os.path.join(
+        get_package_share_directory("oculus_ros2"), "cfg", "default.yaml"
+    )
+
+    # Simulated sonar on this machine, the status is sent to localhost so that
+    # no network is needed. file:=<path/to/file.oculus> replays a recording
+    # instead of synthetic pings, rate:=40.0 forces the ping rate.
+    ld.add_action(DeclareLaunchArgument("file", default_value=""))
+    ld.add_action(DeclareLaunchArgument("rate", default_value="0"))
+
+    oculus_simulator = Node(
+        package="oculus_ros2",
+        executable="oculus_simulator",
+        name="oculus_simulator",
+        arguments=[
+            "--status-address", "127.0.0.1",
+            "--rate", LaunchConfiguration("rate"),
+            "--file", LaunchConfiguration("file"),
+        ],
+        output="screen",
+    )
+
+    oculus_sonar_node = Node(
+        package="oculus_ros2",
+        executable="oculus_sonar_node",
+        name="oculus_sonar",
+        parameters=[config],
+        namespace="sonar",
+        output="screen",
+    )
+
+    ld.add_action(oculus_simulator)
+    ld.add_action(oculus_sonar_node)
+
+    return ld
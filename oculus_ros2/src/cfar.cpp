@@ -0,0 +1,282 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <oculus_ros2/cfar.hpp>
+
+namespace cfar {
+
+namespace {
+
+// Threshold factor on the sum of n training cells, for the cell averaging detector
+double caFactor(int n, double pfa) {
+  return std::pow(pfa, -1. / n) - 1.;
+}
+
+// Threshold factor on the rank k (0 based) statistic of n training cells: pfa = prod_i<=k (n - i) / (n - i + factor)
+double osFactor(int n, int k, double pfa) {
+  auto logPfa = [n, k](double factor) {
+    double log_pfa = 0.;
+    for (int i = 0; i <= k; ++i) {
+      log_pfa += std::log((n - i) / (n - i + factor));
+    }
+    return log_pfa;
+  };
+  const double target = std::log(pfa);
+  double low = 0.;
+  double high = 1.;
+  while (logPfa(high) > target && high < 1e12) {
+    high *= 2.;
+  }
+  for (int i = 0; i < 100; ++i) {
+    const double middle = .5 * (low + high);
+    (logPfa(middle) > target ? low : high) = middle;
+  }
+  return high;
+}
+
+// Bounds of the window and of the guard cells of a cell, clamped to the image
+struct Window {
+  int r0, r1, g_r0, g_r1;  // Rows [r0, r1[, guard rows [g_r0, g_r1[
+  int c0, c1, g_c0, g_c1;
+
+  int cells() const { return (r1 - r0) * (c1 - c0) - (g_r1 - g_r0) * (g_c1 - g_c0); }
+};
+
+inline double rectangleSum(const double* integral, std::size_t stride, int r0, int r1, int c0, int c1) {
+  return integral[r1 * stride + c1] - integral[r0 * stride + c1] - integral[r1 * stride + c0] + integral[r0 * stride + c0];
+}
+
+inline double trainingSum(const double* integral, std::size_t stride, const Window& w) {
+  return rectangleSum(integral, stride, w.r0, w.r1, w.c0, w.c1) - rectangleSum(integral, stride, w.g_r0, w.g_r1, w.g_c0, w.g_c1);
+}
+
+inline void setColumns(Window& w, int c, int n_beams, const Parameters& p) {
+  const int half = p.guard_beams + p.training_beams;
+  w.c0 = std::max(c - half, 0);
+  w.c1 = std::min(c + half + 1, n_beams);
+  w.g_c0 = std::max(c - p.guard_beams, 0);
+  w.g_c1 = std::min(c + p.guard_beams + 1, n_beams);
+}
+
+inline Window rowWindow(int r, int n_ranges, const Parameters& p) {
+  const int half = p.guard_ranges + p.training_ranges;
+  Window w;
+  w.r0 = std::max(r - half, 0);
+  w.r1 = std::min(r + half + 1, n_ranges);
+  w.g_r0 = std::max(r - p.guard_ranges, 0);
+  w.g_r1 = std::min(r + p.guard_ranges + 1, n_ranges);
+  return w;
+}
+
+}  // namespace
+
+bool methodFromString(const std::string& name, Method& method) {
+  if (name == "off") {
+    method = Method::OFF;
+  } else if (name == "ca") {
+    method = Method::CA;
+  } else if (name == "os") {
+    method = Method::OS;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+Detector::Detector(const Parameters& parameters) : parameters_(parameters) {
+  Parameters& p = parameters_;
+  p.guard_ranges = std::max(p.guard_ranges, 0);
+  p.guard_beams = std::max(p.guard_beams, 0);
+  p.training_ranges = std::max(p.training_ranges, 0);
+  p.training_beams = std::max(p.training_beams, 0);
+  p.pfa = std::min(std::max(p.pfa, 1e-12), 1.);
+  p.os_rank = std::min(std::max(p.os_rank, 1e-3), 1.);
+
+  // The number of training cells only depends on the position of the window in the image, the factors are tabulated
+  const int max_cells = (2 * (p.guard_ranges + p.training_ranges) + 1) * (2 * (p.guard_beams + p.training_beams) + 1);
+  factors_.assign(max_cells + 1, 0.f);
+  ranks_.assign(max_cells + 1, 0);
+  for (int n = 1; n <= max_cells; ++n) {
+    if (p.method == Method::OS) {
+      ranks_[n] = std::min(n - 1, std::max(0, static_cast<int>(std::lround(p.os_rank * n)) - 1));
+      factors_[n] = static_cast<float>(osFactor(n, ranks_[n], p.pfa));
+    } else {
+      factors_[n] = static_cast<float>(caFactor(n, p.pfa));
+    }
+  }
+}
+
+void Detector::detect(const float* image, int n_ranges, int n_beams, std::vector<Detection>& detections) {
+  detections.clear();
+  if (parameters_.method == Method::OFF || n_ranges <= 0 || n_beams <= 0) {
+    return;
+  }
+
+  // Summed area table, the sum of the training cells is the sum of the window minus the sum of the guard cells
+  const std::size_t stride = n_beams + 1;
+  integral_.assign((n_ranges + 1) * stride, 0.);
+  for (int r = 0; r < n_ranges; ++r) {
+    const float* row = image + static_cast<std::size_t>(r) * n_beams;
+    const double* above = integral_.data() + r * stride;
+    double* out = integral_.data() + (r + 1) * stride;
+    double row_sum = 0.;
+    for (int c = 0; c < n_beams; ++c) {
+      row_sum += row[c];
+      out[c + 1] = above[c + 1] + row_sum;
+    }
+  }
+
+  if (parameters_.method == Method::OS) {
+    detectOs(image, n_ranges, n_beams, detections);
+  } else {
+    detectCa(image, n_ranges, n_beams, detections);
+  }
+}
+
+void Detector::detectCa(const float* image, int n_ranges, int n_beams, std::vector<Detection>& detections) {
+  const Parameters& p = parameters_;
+  const std::size_t stride = n_beams + 1;
+  const double* integral = integral_.data();
+  const int half_beams = p.guard_beams + p.training_beams;
+  thresholds_.resize(n_beams);  // Every column is written below
+  float* thresholds = thresholds_.data();
+
+  for (int r = 0; r < n_ranges; ++r) {
+    Window w = rowWindow(r, n_ranges, p);
+    // Columns whose window is inside the image: same number of training cells, the loop is vectorized
+    const int inner0 = std::min(half_beams, n_beams);
+    const int inner1 = std::max(n_beams - half_beams, inner0);
+    if (inner1 > inner0) {
+      setColumns(w, inner0, n_beams, p);
+      const float factor = factors_[w.cells()];
+      const int width = w.c1 - w.c0;
+      const int guard_width = w.g_c1 - w.g_c0;
+      const double* o0 = integral + w.r0 * stride + w.c0;  // Window corners of the first inner column
+      const double* o1 = integral + w.r1 * stride + w.c0;
+      const double* g0 = integral + w.g_r0 * stride + w.g_c0;
+      const double* g1 = integral + w.g_r1 * stride + w.g_c0;
+      for (int i = 0; i < inner1 - inner0; ++i) {
+        const double window = o1[i + width] - o0[i + width] - o1[i] + o0[i];
+        const double guard = g1[i + guard_width] - g0[i + guard_width] - g1[i] + g0[i];
+        thresholds[inner0 + i] = factor * static_cast<float>(window - guard);
+      }
+    }
+    for (int c = 0; c < n_beams; ++c) {
+      if (c == inner0 && inner1 > inner0) {
+        c = inner1 - 1;
+        continue;
+      }
+      setColumns(w, c, n_beams, p);
+      const int cells = w.cells();
+      thresholds[c] = cells > 0 ? factors_[cells] * static_cast<float>(trainingSum(integral, stride, w))
+                                : std::numeric_limits<float>::max();
+    }
+
+    const float* row = image + static_cast<std::size_t>(r) * n_beams;
+    for (int c = 0; c < n_beams; ++c) {
+      if (row[c] > thresholds[c]) {
+        detections.push_back({r, c, row[c]});
+      }
+    }
+  }
+}
+
+void Detector::detectOs(const float* image, int n_ranges, int n_beams, std::vector<Detection>& detections) {
+  const Parameters& p = parameters_;
+  const std::size_t stride = n_beams + 1;
+  const double* integral = integral_.data();
+
+  // Summed area table of the squares, for the variance of the training cells
+  squares_.assign((n_ranges + 1) * stride, 0.);
+  for (int r = 0; r < n_ranges; ++r) {
+    const float* row = image + static_cast<std::size_t>(r) * n_beams;
+    const double* above = squares_.data() + r * stride;
+    double* out = squares_.data() + (r + 1) * stride;
+    double row_sum = 0.;
+    for (int c = 0; c < n_beams; ++c) {
+      row_sum += static_cast<double>(row[c]) * row[c];
+      out[c + 1] = above[c + 1] + row_sum;
+    }
+  }
+
+  for (int r = 0; r < n_ranges; ++r) {
+    Window w = rowWindow(r, n_ranges, p);
+    const float* row = image + static_cast<std::size_t>(r) * n_beams;
+    for (int c = 0; c < n_beams; ++c) {
+      setColumns(w, c, n_beams, p);
+      const int cells = w.cells();
+      if (cells == 0) {
+        continue;
+      }
+      const double factor = factors_[cells];
+      const int rank = ranks_[cells];
+      const float value = row[c];
+
+      // The noise estimate (rank statistic) is bounded by the mean and standard deviation of the training cells
+      // (Cantelli inequality), the cells are only counted between the two bounds
+      const double mean = trainingSum(integral, stride, w) / cells;
+      const double deviation = std::sqrt(std::max(trainingSum(squares_.data(), stride, w) / cells - mean * mean, 0.));
+      if (value <= factor * (mean - deviation * std::sqrt(static_cast<double>(cells) / (rank + 1) - 1.))) {
+        continue;
+      }
+      if (value > factor * (mean + deviation * std::sqrt(static_cast<double>(cells) / (cells - rank) - 1.))) {
+        detections.push_back({r, c, value});
+        continue;
+      }
+
+      // value > factor * noise estimate <=> more than rank training cells are below value / factor
+      const float level = static_cast<float>(value / factor);
+      int below = 0;
+      for (int i = w.r0; i < w.r1; ++i) {
+        const float* training_row = image + static_cast<std::size_t>(i) * n_beams;
+        for (int j = w.c0; j < w.c1; ++j) {
+          below += training_row[j] < level;
+        }
+      }
+      for (int i = w.g_r0; i < w.g_r1; ++i) {
+        const float* guard_row = image + static_cast<std::size_t>(i) * n_beams;
+        for (int j = w.g_c0; j < w.g_c1; ++j) {
+          below -= guard_row[j] < level;
+        }
+      }
+      if (below > rank) {
+        detections.push_back({r, c, value});
+      }
+    }
+  }
+}
+
+}  // namespace cfar
@@ -0,0 +1,284 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <oculus_ros2/fan_interpolation.hpp>
+#include <oculus_ros2/gain_compensation.hpp>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace fan_interpolation {
+
+namespace {
+
+const uint32_t WEIGHT_ONE = 256;  // Weights are in 1/256, the bilinear sum of a uint16 sample fits in 32 bits
+const uint32_t WEIGHT_HALF = WEIGHT_ONE / 2;
+const uint32_t WEIGHT_ROUND = WEIGHT_ONE * WEIGHT_ONE / 2;
+const int WEIGHT_SHIFT = 16;  // log2(WEIGHT_ONE * WEIGHT_ONE)
+
+// The rows follow a 4 bytes gain in the ping buffer, the samples are read through memcpy as they may not be aligned
+inline const uint8_t* polarRow(const uint8_t* polar, int step, int range) {
+  return polar + static_cast<std::size_t>(range) * step;
+}
+
+using gain_compensation::loadSample;
+
+// Scalar kernel, also used for the tail of the table by the SIMD one.
+template <class Sample>
+void remapRangeScalar(const Table& table,
+    bool nearest,
+    const uint8_t* polar,
+    int step,
+    Sample border,
+    std::size_t begin,
+    std::size_t end,
+    Sample* out) {
+  for (std::size_t i = begin; i < end; ++i) {
+    const int32_t cell = table.cells[i];
+    if (cell < 0) {
+      out[i] = border;
+      continue;
+    }
+    const int range = cell >> 16;
+    const int beam = cell & 0xffff;
+    const uint32_t fx = table.weights[i] & 0xffff;
+    const uint32_t fy = table.weights[i] >> 16;
+    if (nearest) {
+      out[i] = loadSample<Sample>(polarRow(polar, step, range + (fy >= WEIGHT_HALF)), beam + (fx >= WEIGHT_HALF));
+      continue;
+    }
+    const uint8_t* row0 = polarRow(polar, step, range);
+    const uint8_t* row1 = polarRow(polar, step, range + 1);
+    const uint32_t top = loadSample<Sample>(row0, beam) * (WEIGHT_ONE - fx) + loadSample<Sample>(row0, beam + 1) * fx;
+    const uint32_t bottom = loadSample<Sample>(row1, beam) * (WEIGHT_ONE - fx) + loadSample<Sample>(row1, beam + 1) * fx;
+    out[i] = static_cast<Sample>((top * (WEIGHT_ONE - fy) + bottom * fy + WEIGHT_ROUND) >> WEIGHT_SHIFT);
+  }
+}
+
+template <class Sample>
+void remapKernelScalar(const Table& table, bool nearest, const uint8_t* polar, int step, Sample border, Sample* out) {
+  remapRangeScalar(table, nearest, polar, step, border, 0, table.cells.size(), out);
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("avx2"))) inline void storeAvx2(__m256i values, uint8_t* out) {
+  const __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1));
+  _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(words, words));
+}
+
+__attribute__((target("avx2"))) inline void storeAvx2(__m256i values, uint16_t* out) {
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+      _mm_packus_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1)));
+}
+
+// 8 pixels at once: each 2 samples of a row are gathered by a 32 bits load. The load of the last beams of a row starts at
+// the last 4 bytes of the row (never reading past the ping data), a variable shift then brings the samples down.
+template <class Sample>
+__attribute__((target("avx2"))) void remapAvx2(
+    const Table& table, bool nearest, const uint8_t* polar, int step, Sample border, Sample* out) {
+  constexpr int BITS = 8 * sizeof(Sample);
+  const int* base = reinterpret_cast<const int*>(polar);
+  const __m256i step_v = _mm256_set1_epi32(step);
+  const __m256i last_start = _mm256_set1_epi32(table.n_beams - 4 / static_cast<int>(sizeof(Sample)));
+  const __m256i low_mask = _mm256_set1_epi32(0xffff);
+  const __m256i sample_mask = _mm256_set1_epi32((1 << BITS) - 1);
+  const __m256i below_half = _mm256_set1_epi32(WEIGHT_HALF - 1);
+  const __m256i one = _mm256_set1_epi32(WEIGHT_ONE);
+  const __m256i round = _mm256_set1_epi32(WEIGHT_ROUND);
+  const __m256i border_v = _mm256_set1_epi32(border);
+  const __m256i outside = _mm256_set1_epi32(-1);
+
+  const std::size_t size = table.cells.size();
+  std::size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    const __m256i cell = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(table.cells.data() + i));
+    const __m256i weight = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(table.weights.data() + i));
+    const __m256i inside = _mm256_cmpgt_epi32(cell, outside);  // The gathers skip the pixels outside of the fan
+    __m256i range = _mm256_srai_epi32(cell, 16);
+    __m256i beam = _mm256_and_si256(cell, low_mask);
+    const __m256i fx = _mm256_and_si256(weight, low_mask);
+    const __m256i fy = _mm256_srli_epi32(weight, 16);
+    if (nearest) {
+      // The comparisons are -1 where the weight rounds to the next sample
+      range = _mm256_sub_epi32(range, _mm256_cmpgt_epi32(fy, below_half));
+      beam = _mm256_sub_epi32(beam, _mm256_cmpgt_epi32(fx, below_half));
+    }
+
+    const __m256i start = _mm256_min_epi32(beam, last_start);
+    const __m256i shift = _mm256_slli_epi32(_mm256_sub_epi32(beam, start), sizeof(Sample) == 1 ? 3 : 4);
+    const __m256i offset =
+        _mm256_add_epi32(_mm256_mullo_epi32(range, step_v), _mm256_slli_epi32(start, sizeof(Sample) == 1 ? 0 : 1));
+    const __m256i top =
+        _mm256_srlv_epi32(_mm256_mask_i32gather_epi32(_mm256_setzero_si256(), base, offset, inside, 1), shift);
+
+    __m256i values;
+    if (nearest) {
+      values = _mm256_and_si256(top, sample_mask);
+    } else {
+      const __m256i bottom = _mm256_srlv_epi32(
+          _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), base, _mm256_add_epi32(offset, step_v), inside, 1), shift);
+      const __m256i fx_complement = _mm256_sub_epi32(one, fx);
+      const __m256i top_sum =
+          _mm256_add_epi32(_mm256_mullo_epi32(_mm256_and_si256(top, sample_mask), fx_complement),
+              _mm256_mullo_epi32(_mm256_and_si256(_mm256_srli_epi32(top, BITS), sample_mask), fx));
+      const __m256i bottom_sum =
+          _mm256_add_epi32(_mm256_mullo_epi32(_mm256_and_si256(bottom, sample_mask), fx_complement),
+              _mm256_mullo_epi32(_mm256_and_si256(_mm256_srli_epi32(bottom, BITS), sample_mask), fx));
+      const __m256i sum = _mm256_add_epi32(
+          _mm256_mullo_epi32(top_sum, _mm256_sub_epi32(one, fy)), _mm256_mullo_epi32(bottom_sum, fy));
+      values = _mm256_srli_epi32(_mm256_add_epi32(sum, round), WEIGHT_SHIFT);
+    }
+    storeAvx2(_mm256_blendv_epi8(border_v, values, inside), out + i);
+  }
+  remapRangeScalar(table, nearest, polar, step, border, i, size, out);
+}
+
+#endif
+
+// Gathers only exist from AVX2 on: without them the loads are scalar, and the compiler vectorizes the rest as well as
+// SSE2 or NEON intrinsics would.
+template <class Sample>
+using RemapKernel = void (*)(const Table&, bool, const uint8_t*, int, Sample, Sample*);
+
+template <class Sample>
+RemapKernel<Sample> selectRemapKernel() {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    return remapAvx2<Sample>;
+  }
+#endif
+  return remapKernelScalar<Sample>;
+}
+
+}  // namespace
+
+bool methodFromString(const std::string& name, Method& method) {
+  if (name == "nearest") {
+    method = Method::NEAREST;
+  } else if (name == "bilinear") {
+    method = Method::BILINEAR;
+  } else if (name == "cubic") {
+    method = Method::CUBIC;
+  } else if (name == "area") {
+    method = Method::AREA;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool supported(int n_beams, int n_ranges) {
+  return n_beams >= 4 && n_ranges >= 2 && n_beams <= 0xffff && n_ranges <= 0x7fff;
+}
+
+void buildTable(const float* coordinates, std::size_t size, int n_beams, int n_ranges, Table& table) {
+  table.n_beams = n_beams;
+  table.n_ranges = n_ranges;
+  table.cells.resize(size);
+  table.weights.resize(size);
+
+  const float last_beam = n_beams - 1;
+  const float last_range = n_ranges - 1;
+  for (std::size_t i = 0; i < size; ++i) {
+    if (coordinates[2 * i] < 0.f || coordinates[2 * i + 1] < 0.f) {
+      table.cells[i] = -1;
+      table.weights[i] = 0;
+      continue;
+    }
+    // The neighbourhood stays inside of the image, the last beam and range are reached with a weight of one
+    const float beam = std::min(coordinates[2 * i], last_beam);
+    const float range = std::min(coordinates[2 * i + 1], last_range);
+    const int beam_cell = std::min(static_cast<int>(beam), n_beams - 2);
+    const int range_cell = std::min(static_cast<int>(range), n_ranges - 2);
+    const auto fx = static_cast<uint32_t>(std::lround((beam - beam_cell) * WEIGHT_ONE));
+    const auto fy = static_cast<uint32_t>(std::lround((range - range_cell) * WEIGHT_ONE));
+    table.cells[i] = (range_cell << 16) | beam_cell;
+    table.weights[i] = (fy << 16) | fx;
+  }
+}
+
+template <class Sample>
+void remap(const Table& table, Method method, const uint8_t* polar, int step, Sample border, Sample* out) {
+  static const RemapKernel<Sample> kernel = selectRemapKernel<Sample>();  // CPU features are only checked once
+  kernel(table, method == Method::NEAREST, polar, step, border, out);
+}
+
+template <class Sample>
+void remapScalar(const Table& table, Method method, const uint8_t* polar, int step, Sample border, Sample* out) {
+  remapKernelScalar(table, method == Method::NEAREST, polar, step, border, out);
+}
+
+template <class Sample>
+void averageBeams(const uint8_t* polar, int step, int n_beams, int n_ranges, const std::vector<int>& half_beams, Sample* out) {
+  for (int r = 0; r < n_ranges; ++r) {
+    const uint8_t* in = polarRow(polar, step, r);
+    Sample* row_out = out + static_cast<std::size_t>(r) * n_beams;
+    const int half = std::min(half_beams[r], n_beams - 1);
+    if (half <= 0) {
+      std::memcpy(row_out, in, n_beams * sizeof(Sample));
+      continue;
+    }
+
+    // Sliding sum over the beams [b - half, b + half], clipped to the row
+    uint32_t sum = 0;
+    for (int b = 0; b < half; ++b) {
+      sum += loadSample<Sample>(in, b);
+    }
+    for (int b = 0; b < n_beams; ++b) {
+      if (b + half < n_beams) {
+        sum += loadSample<Sample>(in, b + half);
+      }
+      if (b - half > 0) {
+        sum -= loadSample<Sample>(in, b - half - 1);
+      }
+      const uint32_t count = std::min(b + half, n_beams - 1) - std::max(b - half, 0) + 1;
+      row_out[b] = static_cast<Sample>((sum + count / 2) / count);
+    }
+  }
+}
+
+template void remap<uint8_t>(const Table&, Method, const uint8_t*, int, uint8_t, uint8_t*);
+template void remap<uint16_t>(const Table&, Method, const uint8_t*, int, uint16_t, uint16_t*);
+
+template void remapScalar<uint8_t>(const Table&, Method, const uint8_t*, int, uint8_t, uint8_t*);
+template void remapScalar<uint16_t>(const Table&, Method, const uint8_t*, int, uint16_t, uint16_t*);
+
+template void averageBeams<uint8_t>(const uint8_t*, int, int, int, const std::vector<int>&, uint8_t*);
+template void averageBeams<uint16_t>(const uint8_t*, int, int, int, const std::vector<int>&, uint16_t*);
+
+}  // namespace fan_interpolation
@@ -0,0 +1,221 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
+
+#include <oculus_ros2/fan_remap_cache.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+FanRemapCache::FanRemapCache(std::size_t capacity) : capacity_(std::max<std::size_t>(capacity, 1)) {}
+
+std::shared_ptr<const FanRemap> FanRemapCache::get(const FanGeometry& geometry, const int16_t* bearings) {
+  std::lock_guard<std::mutex> l(mutex_);
+
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    if (it->first == geometry) {
+      ++hits_;
+      entries_.splice(entries_.begin(), entries_, it);  // Mark as most recently used
+      return entries_.front().second;
+    }
+  }
+
+  ++misses_;
+  entries_.emplace_front(geometry, build(geometry, bearings));
+  if (entries_.size() > capacity_) {
+    entries_.pop_back();
+  }
+  return entries_.front().second;
+}
+
+std::size_t FanRemapCache::hits() const {
+  std::lock_guard<std::mutex> l(mutex_);
+  return hits_;
+}
+
+std::size_t FanRemapCache::misses() const {
+  std::lock_guard<std::mutex> l(mutex_);
+  return misses_;
+}
+
+std::uint64_t FanRemapCache::hashBearings(const int16_t* bearings, int n_beams) {
+  if (bearings == nullptr) {
+    return 0;
+  }
+  // FNV-1a, the table is a few hundred values so this is negligible compared to a ping
+  std::uint64_t hash = 14695981039346656037ULL;
+  for (int i = 0; i < n_beams; ++i) {
+    hash = (hash ^ static_cast<uint16_t>(bearings[i])) * 1099511628211ULL;
+  }
+  return hash == 0 ? 1 : hash;
+}
+
+std::shared_ptr<const FanRemap> FanRemapCache::build(const FanGeometry& geometry, const int16_t* bearings) {
+  const int width = geometry.n_beams;
+  const int height = geometry.n_ranges;
+  if (width <= 0 || height <= 0) {
+    // No beam to take the bearings from, the fan is an empty image
+    auto remap = std::make_shared<FanRemap>();
+    remap->method = fan_interpolation::Method::NEAREST;
+    return remap;
+  }
+
+  // The bearing table is inverted by a binary search: a decreasing table is searched reversed, a table which is not
+  // monotonic cannot be inverted and is replaced by the linear aperture
+  const bool has_bearings = bearings != nullptr && geometry.bearings_hash != 0;
+  bool use_bearings = has_bearings;
+  bool reversed = false;
+  if (has_bearings && !std::is_sorted(bearings, bearings + width)) {
+    reversed = std::is_sorted(bearings, bearings + width, std::greater<int16_t>());
+    use_bearings = reversed;
+  }
+
+  // Bearing of each beam in radians, sorted in increasing order (beam width - 1 - i when reversed)
+  std::vector<float> beam_bearings(width);
+  for (int i = 0; i < width; ++i) {
+    if (use_bearings) {
+      beam_bearings[i] = bearings[reversed ? width - 1 - i : i] * 0.01 * M_PI / 180;
+    } else {
+      // Linear interpolation over the aperture when the sonar does not give the bearings
+      const double aperture = geometry.aperture * M_PI / 180;
+      beam_bearings[i] = -aperture + 2 * aperture * i / width;
+    }
+  }
+  const FanRegion& region = geometry.region;
+
+  // Window of the region clipped to the ping, an empty bearing window is reduced to the closest edge of the fan
+  const float min_range = std::clamp(region.min_range, 0.f, static_cast<float>(height));
+  const float max_range = region.max_range > min_range ? std::min<float>(region.max_range, height) : height;
+  float min_bearing = beam_bearings.front();
+  float max_bearing = beam_bearings.back();
+  if (region.max_bearing > region.min_bearing) {
+    min_bearing = std::clamp(region.min_bearing, min_bearing, max_bearing);
+    max_bearing = std::clamp(region.max_bearing, min_bearing, max_bearing);
+  }
+
+  // Bounding box of the region, lateral (x, to the right) and forward (y) distances from the sonar
+  const float left = std::min(min_range * std::sin(min_bearing), max_range * std::sin(min_bearing));
+  const float right = std::max(min_range * std::sin(max_bearing), max_range * std::sin(max_bearing));
+  const bool centered = min_bearing <= 0.f && max_bearing >= 0.f;  // The furthest point is straight ahead
+  const float top = max_range * (centered ? 1.f : std::max(std::cos(min_bearing), std::cos(max_bearing)));
+  const float bottom = min_range * std::min(std::cos(min_bearing), std::cos(max_bearing));
+
+  float pixel_size = region.pixel_size;
+  if (pixel_size <= 0.f && (region.width > 0 || region.height > 0)) {
+    pixel_size = std::max(region.width > 0 ? (right - left) / region.width : 0.f,
+        region.height > 0 ? (top - bottom) / region.height : 0.f);
+  }
+  if (pixel_size <= 0.f) {
+    pixel_size = 1.f;
+  }
+
+  // Size of the image and distances of its first column (x0) and first row (y0), rounded to whole pixels when fitted
+  int image_width;
+  int image_height;
+  float x0;
+  float y0;
+  if (region.width > 0) {
+    image_width = region.width;
+    x0 = (left + right - image_width * pixel_size) / 2;
+  } else {
+    const float first = std::floor(left / pixel_size);
+    image_width = std::max(static_cast<int>(std::ceil(right / pixel_size) - first), 1);
+    x0 = first * pixel_size;
+  }
+  if (region.height > 0) {
+    image_height = region.height;
+    y0 = (top + bottom + image_height * pixel_size) / 2;
+  } else {
+    const float last = std::ceil(top / pixel_size);
+    image_height = std::max(static_cast<int>(last - std::floor(bottom / pixel_size)), 1);
+    y0 = last * pixel_size;
+  }
+
+  auto remap = std::make_shared<FanRemap>();
+  remap->image_size = cv::Size(image_width, image_height);
+  remap->bearings_ignored = has_bearings && !use_bearings;
+
+  cv::Mat map(remap->image_size, CV_32FC2);
+  cv::parallel_for_(cv::Range(0, map.total()), [&](const cv::Range& range) {
+    for (auto i = range.start; i < range.end; i++) {
+      int y = i / map.cols;
+      int x = i % map.cols;
+
+      // Calculate range and bearing of this pixel from origin
+      const float dx = x0 + x * pixel_size;
+      const float dy = y0 - y * pixel_size;
+
+      const float range = sqrt(dx * dx + dy * dy);
+      const float bearing_x_y = atan2(dx, dy);
+
+      const float range_index = range;
+      float beam_index = -1;  // Outside of the region, filled with the border value
+      if (bearing_x_y >= min_bearing && bearing_x_y <= max_bearing && range >= min_range && range <= max_range) {
+        // Invert the (non uniform) bearing table, the beam index is interpolated between the two surrounding beams
+        const auto upper = std::upper_bound(beam_bearings.begin(), beam_bearings.end(), bearing_x_y);
+        const int beam = std::max<int>(std::distance(beam_bearings.begin(), upper) - 1, 0);
+        if (beam + 1 < width && beam_bearings[beam + 1] > beam_bearings[beam]) {
+          beam_index = beam + (bearing_x_y - beam_bearings[beam]) / (beam_bearings[beam + 1] - beam_bearings[beam]);
+        } else {
+          beam_index = beam;
+        }
+        if (reversed) {
+          beam_index = width - 1 - beam_index;
+        }
+      }
+
+      // The polar image is read untransposed (ranges as rows, beams as columns)
+      map.at<cv::Vec2f>(cv::Point(x, y)) = cv::Vec2f(beam_index, range_index);
+    }
+  });
+
+  if (geometry.interpolation == fan_interpolation::Method::CUBIC || !fan_interpolation::supported(width, height)) {
+    remap->method = fan_interpolation::Method::CUBIC;
+    cv::convertMaps(map, cv::Mat(), remap->map1, remap->map2, CV_16SC2);
+    return remap;
+  }
+
+  remap->method = geometry.interpolation;
+  fan_interpolation::buildTable(map.ptr<float>(), map.total(), width, height, remap->table);
+  if (remap->method == fan_interpolation::Method::AREA) {
+    // A pixel covers pixel_size / (range * spacing) beams, the beam spacing being averaged over the aperture
+    const float spacing = std::max((beam_bearings.back() - beam_bearings.front()) / (width - 1), 1e-6f);
+    remap->table.half_beams.resize(height);
+    for (int r = 0; r < height; ++r) {
+      const float covered = pixel_size / (std::max(r, 1) * spacing);
+      remap->table.half_beams[r] = std::clamp(static_cast<int>((covered - 1) / 2), 0, width / 2);
+    }
+  }
+  return remap;
+}
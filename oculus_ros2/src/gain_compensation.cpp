@@ -0,0 +1,325 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+#include <oculus_ros2/gain_compensation.hpp>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace gain_compensation {
+
+namespace {
+
+const int SIZE_OF_GAIN = 4;
+
+template <class Out>
+struct OutputScale;
+
+template <>
+struct OutputScale<float> {
+  static constexpr float value = 1.f;
+};
+
+template <>
+struct OutputScale<uint8_t> {
+  static constexpr float value = 255.f;
+};
+
+template <>
+struct OutputScale<uint16_t> {
+  static constexpr float value = 65535.f;
+};
+
+// Rounds to nearest (even), as the SIMD conversions do with the default rounding mode
+template <class Out>
+inline Out saturate(float value) {
+  if constexpr (std::is_floating_point<Out>::value) {
+    return value;
+  } else {
+    if (!(value > 0.f)) {
+      return 0;
+    }
+    if (value >= static_cast<float>(std::numeric_limits<Out>::max())) {
+      return std::numeric_limits<Out>::max();
+    }
+    return static_cast<Out>(std::lrintf(value));
+  }
+}
+
+// The kernels read the samples of type In from a byte pointer, the rows of the ping are not aligned
+template <class In, class Out>
+void scaleRowScalar(const uint8_t* in, int n, float scale, Out* out) {
+  for (int i = 0; i < n; ++i) {
+    out[i] = saturate<Out>(loadSample<In>(in, i) * scale);
+  }
+}
+
+#if defined(__x86_64__)
+
+template <class In>
+__attribute__((target("avx2"))) inline __m256 loadScaledAvx2(const uint8_t* in, __m256 scale) {
+  __m256i samples;
+  if constexpr (sizeof(In) == 1) {
+    samples = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in)));
+  } else {
+    samples = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)));
+  }
+  return _mm256_mul_ps(_mm256_cvtepi32_ps(samples), scale);
+}
+
+template <class In>
+__attribute__((target("avx2"))) void scaleRowAvx2(const uint8_t* in, int n, float scale, float* out) {
+  const __m256 scale_v = _mm256_set1_ps(scale);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(out + i, loadScaledAvx2<In>(in + i * sizeof(In), scale_v));
+  }
+  scaleRowScalar<In>(in + i * sizeof(In), n - i, scale, out + i);
+}
+
+template <class In>
+__attribute__((target("avx2"))) void scaleRowAvx2(const uint8_t* in, int n, float scale, uint8_t* out) {
+  const __m256 scale_v = _mm256_set1_ps(scale);
+  const __m256 max_v = _mm256_set1_ps(OutputScale<uint8_t>::value);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256i values = _mm256_cvtps_epi32(_mm256_min_ps(loadScaledAvx2<In>(in + i * sizeof(In), scale_v), max_v));
+    const __m128i values16 = _mm_packs_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(values16, values16));
+  }
+  scaleRowScalar<In>(in + i * sizeof(In), n - i, scale, out + i);
+}
+
+template <class In>
+__attribute__((target("avx2"))) void scaleRowAvx2(const uint8_t* in, int n, float scale, uint16_t* out) {
+  const __m256 scale_v = _mm256_set1_ps(scale);
+  const __m256 max_v = _mm256_set1_ps(OutputScale<uint16_t>::value);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256i values = _mm256_cvtps_epi32(_mm256_min_ps(loadScaledAvx2<In>(in + i * sizeof(In), scale_v), max_v));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+        _mm_packus_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1)));
+  }
+  scaleRowScalar<In>(in + i * sizeof(In), n - i, scale, out + i);
+}
+
+// SSE2 is always available on x86-64
+template <class In>
+inline void loadScaledSse2(const uint8_t* in, __m128 scale, __m128& low, __m128& high) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i samples16 = sizeof(In) == 1 ? _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in)), zero)
+                                            : _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+  low = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(samples16, zero)), scale);
+  high = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(samples16, zero)), scale);
+}
+
+template <class In>
+void scaleRowSse2(const uint8_t* in, int n, float scale, float* out) {
+  const __m128 scale_v = _mm_set1_ps(scale);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128 low, high;
+    loadScaledSse2<In>(in + i * sizeof(In), scale_v, low, high);
+    _mm_storeu_ps(out + i, low);
+    _mm_storeu_ps(out + i + 4, high);
+  }
+  scaleRowScalar<In>(in + i * sizeof(In), n - i, scale, out + i);
+}
+
+template <class In>
+void scaleRowSse2(const uint8_t* in, int n, float scale, uint8_t* out) {
+  const __m128 scale_v = _mm_set1_ps(scale);
+  const __m128 max_v = _mm_set1_ps(OutputScale<uint8_t>::value);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128 low, high;
+    loadScaledSse2<In>(in + i * sizeof(In), scale_v, low, high);
+    const __m128i values16 =
+        _mm_packs_epi32(_mm_cvtps_epi32(_mm_min_ps(low, max_v)), _mm_cvtps_epi32(_mm_min_ps(high, max_v)));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(values16, values16));
+  }
+  scaleRowScalar<In>(in + i * sizeof(In), n - i, scale, out + i);
+}
+
+template <class In>
+void scaleRowSse2(const uint8_t* in, int n, float scale, uint16_t* out) {
+  // SSE2 has no unsigned 32 to 16 bits pack: values are clamped, shifted to the signed range, packed and shifted back
+  const __m128 scale_v = _mm_set1_ps(scale);
+  const __m128 max_v = _mm_set1_ps(OutputScale<uint16_t>::value);
+  const __m128i shift32 = _mm_set1_epi32(0x8000);
+  const __m128i shift16 = _mm_set1_epi16(static_cast<int16_t>(0x8000));
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128 low, high;
+    loadScaledSse2<In>(in + i * sizeof(In), scale_v, low, high);
+    const __m128i low32 = _mm_sub_epi32(_mm_cvtps_epi32(_mm_min_ps(low, max_v)), shift32);
+    const __m128i high32 = _mm_sub_epi32(_mm_cvtps_epi32(_mm_min_ps(high, max_v)), shift32);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_xor_si128(_mm_packs_epi32(low32, high32), shift16));
+  }
+  scaleRowScalar<In>(in + i * sizeof(In), n - i, scale, out + i);
+}
+
+#elif defined(__aarch64__)
+
+inline void loadScaledNeon(const uint16x8_t samples16, float scale, float32x4_t& low, float32x4_t& high) {
+  low = vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(samples16))), scale);
+  high = vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(samples16))), scale);
+}
+
+template <class In>
+inline void loadScaledNeon(const uint8_t* in, float scale, float32x4_t& low, float32x4_t& high) {
+  // Byte loads, the 16 bits samples are not aligned
+  loadScaledNeon(sizeof(In) == 1 ? vmovl_u8(vld1_u8(in)) : vreinterpretq_u16_u8(vld1q_u8(in)), scale, low, high);
+}
+
+inline uint16x8_t toUint16Neon(float32x4_t low, float32x4_t high) {
+  // vcvtnq rounds to nearest even and saturates negative values to 0, vqmovn saturates to 16 bits
+  return vcombine_u16(vqmovn_u32(vcvtnq_u32_f32(low)), vqmovn_u32(vcvtnq_u32_f32(high)));
+}
+
+template <class In>
+void scaleRowNeon(const uint8_t* in, int n, float scale, float* out) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    float32x4_t low, high;
+    loadScaledNeon<In>(in + i * sizeof(In), scale, low, high);
+    vst1q_f32(out + i, low);
+    vst1q_f32(out + i + 4, high);
+  }
+  scaleRowScalar<In>(in + i * sizeof(In), n - i, scale, out + i);
+}
+
+template <class In>
+void scaleRowNeon(const uint8_t* in, int n, float scale, uint8_t* out) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    float32x4_t low, high;
+    loadScaledNeon<In>(in + i * sizeof(In), scale, low, high);
+    vst1_u8(out + i, vqmovn_u16(toUint16Neon(low, high)));
+  }
+  scaleRowScalar<In>(in + i * sizeof(In), n - i, scale, out + i);
+}
+
+template <class In>
+void scaleRowNeon(const uint8_t* in, int n, float scale, uint16_t* out) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    float32x4_t low, high;
+    loadScaledNeon<In>(in + i * sizeof(In), scale, low, high);
+    vst1q_u16(out + i, toUint16Neon(low, high));
+  }
+  scaleRowScalar<In>(in + i * sizeof(In), n - i, scale, out + i);
+}
+
+#endif
+
+template <class Out>
+using RowKernel = void (*)(const uint8_t*, int, float, Out*);
+
+template <class In, class Out>
+RowKernel<Out> selectRowKernel() {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    return static_cast<RowKernel<Out>>(scaleRowAvx2<In>);
+  }
+  return static_cast<RowKernel<Out>>(scaleRowSse2<In>);
+#elif defined(__aarch64__)
+  return static_cast<RowKernel<Out>>(scaleRowNeon<In>);
+#else
+  return scaleRowScalar<In, Out>;
+#endif
+}
+
+template <class Out>
+void compensateRows(RowKernel<Out> kernel, const uint8_t* rows, int step, int n_ranges, int n_beams, Out* out) {
+  for (int r = 0; r < n_ranges; ++r) {
+    const uint8_t* row = rows + static_cast<std::ptrdiff_t>(r) * step;
+    kernel(row + SIZE_OF_GAIN, n_beams, rowScale(rowGain(row), OutputScale<Out>::value),
+        out + static_cast<std::ptrdiff_t>(r) * n_beams);
+  }
+}
+
+}  // namespace
+
+bool modeFromString(const std::string& name, Mode& mode) {
+  if (name == "off") {
+    mode = Mode::OFF;
+  } else if (name == "float") {
+    mode = Mode::FLOAT;
+  } else if (name == "8bit") {
+    mode = Mode::UINT8;
+  } else if (name == "16bit") {
+    mode = Mode::UINT16;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+float rowScale(uint32_t gain, float output_scale) {
+  return output_scale / std::sqrt(static_cast<float>(std::max<uint32_t>(gain, 1)));
+}
+
+template <class In, class Out>
+void compensate(const uint8_t* rows, int step, int n_ranges, int n_beams, Out* out) {
+  static const RowKernel<Out> kernel = selectRowKernel<In, Out>();  // CPU features are only checked once
+  compensateRows(kernel, rows, step, n_ranges, n_beams, out);
+}
+
+template <class In, class Out>
+void compensateScalar(const uint8_t* rows, int step, int n_ranges, int n_beams, Out* out) {
+  compensateRows<Out>(scaleRowScalar<In, Out>, rows, step, n_ranges, n_beams, out);
+}
+
+template void compensate<uint8_t, float>(const uint8_t*, int, int, int, float*);
+template void compensate<uint8_t, uint8_t>(const uint8_t*, int, int, int, uint8_t*);
+template void compensate<uint8_t, uint16_t>(const uint8_t*, int, int, int, uint16_t*);
+template void compensate<uint16_t, float>(const uint8_t*, int, int, int, float*);
+template void compensate<uint16_t, uint8_t>(const uint8_t*, int, int, int, uint8_t*);
+template void compensate<uint16_t, uint16_t>(const uint8_t*, int, int, int, uint16_t*);
+
+template void compensateScalar<uint8_t, float>(const uint8_t*, int, int, int, float*);
+template void compensateScalar<uint8_t, uint8_t>(const uint8_t*, int, int, int, uint8_t*);
+template void compensateScalar<uint8_t, uint16_t>(const uint8_t*, int, int, int, uint16_t*);
+template void compensateScalar<uint16_t, float>(const uint8_t*, int, int, int, float*);
+template void compensateScalar<uint16_t, uint8_t>(const uint8_t*, int, int, int, uint8_t*);
+template void compensateScalar<uint16_t, uint16_t>(const uint8_t*, int, int, int, uint16_t*);
+
+}  // namespace gain_compensation
@@ -0,0 +1,219 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <oculus_ros2/oculus_file_reader.hpp>
+
+namespace oculus {
+
+namespace {
+
+// Item header fields. The item header size is given by its second field: the recorders write it either with natural
+// alignment (40 bytes) or packed (30 bytes), which changes the offsets of the following fields.
+const std::size_t ITEM_HEADER_MIN_SIZE = 30;
+const uint32_t ITEM_HEADER_PACKED_SIZE = 30;
+const uint32_t ITEM_HEADER_NATURAL_MIN_SIZE = 36;  // Up to the end of payload_size
+
+// Index file: header then one IndexEntry per message. The size and modification date of the .oculus file invalidate it.
+const uint32_t INDEX_MAGIC = 0x5849434f;  // "OCIX"
+const uint32_t INDEX_VERSION = 1;
+
+struct IndexHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t file_size;
+  int64_t file_mtime;
+  uint64_t count;
+};
+
+template <class T>
+T readField(const uint8_t* data, std::size_t offset) {
+  T value;
+  std::memcpy(&value, data + offset, sizeof(T));
+  return value;
+}
+
+struct ItemHeader {
+  uint32_t size_header;
+  double time;
+  uint16_t compression;  // 0 = none, 1 = qCompress
+  uint32_t payload_size;
+};
+
+// available: bytes of the file from data on, at least ITEM_HEADER_MIN_SIZE.
+bool parseItemHeader(const uint8_t* data, std::size_t available, ItemHeader& header) {
+  if (readField<uint32_t>(data, 0) != LOG_ITEM_MAGIC) {
+    return false;
+  }
+  header.size_header = readField<uint32_t>(data, 4);
+  const bool packed = header.size_header == ITEM_HEADER_PACKED_SIZE;
+  if ((!packed && header.size_header < ITEM_HEADER_NATURAL_MIN_SIZE) || header.size_header > available) {
+    return false;  // The fields below would be read past the header or the end of the file
+  }
+  header.time = readField<double>(data, packed ? 12 : 16);
+  header.compression = readField<uint16_t>(data, packed ? 20 : 24);
+  header.payload_size = readField<uint32_t>(data, packed ? 26 : 32);
+  return true;
+}
+
+}  // namespace
+
+OculusFileReader::OculusFileReader(const std::string& path, bool persist_index) : path_(path) {
+  const int fd = ::open(path_.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Could not open " + path_);
+  }
+  struct stat file_stat;
+  if (::fstat(fd, &file_stat) != 0 || file_stat.st_size < static_cast<off_t>(2 * sizeof(uint32_t))) {
+    ::close(fd);
+    throw std::runtime_error(path_ + " is not a .oculus file");
+  }
+  size_ = static_cast<std::size_t>(file_stat.st_size);
+  mtime_ = static_cast<int64_t>(file_stat.st_mtime);
+
+  void* mapped = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);  // The mapping keeps the file open
+  if (mapped == MAP_FAILED) {
+    throw std::runtime_error("Could not map " + path_);
+  }
+  data_ = static_cast<const uint8_t*>(mapped);
+  ::madvise(mapped, size_, MADV_SEQUENTIAL);  // Replays read the file front to back
+
+  if (readField<uint32_t>(data_, 0) != LOG_FILE_MAGIC) {
+    ::munmap(mapped, size_);
+    throw std::runtime_error(path_ + " is not a .oculus file");
+  }
+
+  index_loaded_ = persist_index && loadIndex();
+  if (!index_loaded_) {
+    buildIndex();
+    if (persist_index) {
+      saveIndex();
+    }
+  }
+}
+
+OculusFileReader::~OculusFileReader() {
+  ::munmap(const_cast<uint8_t*>(data_), size_);
+}
+
+RecordedMessageView OculusFileReader::message(std::size_t i) const {
+  const IndexEntry& entry = index_.at(i);
+  return RecordedMessageView{data_ + entry.offset, static_cast<std::size_t>(entry.size), entry.time};
+}
+
+bool OculusFileReader::next(RecordedMessage& message) {
+  if (next_ >= index_.size()) {
+    return false;
+  }
+  const RecordedMessageView view = this->message(next_++);
+  message.data.assign(view.data, view.data + view.size);
+  message.time = view.time;
+  return true;
+}
+
+void OculusFileReader::buildIndex() {
+  index_.clear();
+  std::size_t offset = readField<uint32_t>(data_, sizeof(uint32_t));  // File header size
+  while (offset + ITEM_HEADER_MIN_SIZE <= size_) {
+    ItemHeader header;
+    if (!parseItemHeader(data_ + offset, size_ - offset, header)) {
+      break;  // Corrupted or truncated file, nothing more can be read
+    }
+    const std::size_t payload = offset + header.size_header;
+    if (payload + header.payload_size > size_) {
+      break;
+    }
+    if (header.compression == 0) {
+      index_.push_back(IndexEntry{payload, header.payload_size, header.time});
+    }
+    offset = payload + header.payload_size;
+  }
+}
+
+bool OculusFileReader::loadIndex() {
+  std::ifstream file(indexPath(path_), std::ios::binary | std::ios::ate);
+  if (!file) {
+    return false;
+  }
+  const std::streamoff index_size = file.tellg();
+  file.seekg(0);
+  IndexHeader header;
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != INDEX_MAGIC ||
+      header.version != INDEX_VERSION || header.file_size != size_ || header.file_mtime != mtime_) {
+    return false;
+  }
+  // A corrupted count must not trigger a huge allocation: the entries have to be in the index file
+  if (header.count != (static_cast<uint64_t>(index_size) - sizeof(header)) / sizeof(IndexEntry)) {
+    return false;
+  }
+  index_.resize(header.count);
+  if (!file.read(reinterpret_cast<char*>(index_.data()), header.count * sizeof(IndexEntry))) {
+    index_.clear();
+    return false;
+  }
+  for (const IndexEntry& entry : index_) {
+    if (entry.offset > size_ || entry.size > size_ - entry.offset) {  // Written so that it cannot overflow
+      index_.clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+// Best effort: the recording may be on a read-only medium, the index is then rebuilt at each opening.
+void OculusFileReader::saveIndex() const {
+  const std::string index_path = indexPath(path_);
+  const std::string tmp_path = index_path + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    const IndexHeader header{INDEX_MAGIC, INDEX_VERSION, size_, mtime_, index_.size()};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(index_.data()), index_.size() * sizeof(IndexEntry));
+    if (!file) {
+      std::remove(tmp_path.c_str());
+      return;
+    }
+  }
+  std::rename(tmp_path.c_str(), index_path.c_str());  // Never leave a partially written index
+}
+
+}  // namespace oculus
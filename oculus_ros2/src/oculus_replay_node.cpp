@@ -0,0 +1,138 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define BOOST_BIND_GLOBAL_PLACEHOLDERS
+
+#include <oculus_ros2/oculus_replay_node.hpp>
+
+#include <algorithm>
+#include <chrono>
+
+OculusReplayNode::OculusReplayNode(const rclcpp::NodeOptions& options)
+  : Node("oculus_replay", options),
+    sonar_viewer_(static_cast<rclcpp::Node*>(this)),
+    frame_id_(this->declare_parameter<std::string>("frame_id", "sonar")),
+    rate_(this->declare_parameter<double>("rate", params::REPLAY_RATE_DEFAULT_VALUE)),
+    loop_(this->declare_parameter<bool>("loop", false)),
+    use_recording_stamp_(this->declare_parameter<bool>("use_recording_stamp", true)) {
+  const std::string file = this->declare_parameter<std::string>("file", "");
+  const int queue_size = this->declare_parameter<int>("queue_size", params::REPLAY_QUEUE_SIZE_DEFAULT_VALUE);
+  this->ping_publisher_ = this->create_publisher<oculus_interfaces::msg::Ping>("ping", std::max(queue_size, 1));
+
+  if (file.empty()) {
+    RCLCPP_ERROR(this->get_logger(), "No .oculus file to replay, set the file parameter.");
+    return;
+  }
+  try {
+    reader_ = std::make_unique<oculus::OculusFileReader>(file);
+  } catch (const std::exception& e) {
+    RCLCPP_ERROR_STREAM(this->get_logger(), e.what());
+    return;
+  }
+  RCLCPP_INFO_STREAM(this->get_logger(), "Replaying " << reader_->size() << " messages of " << file << " ("
+                                                      << (reader_->indexWasLoaded() ? "index loaded from " : "index saved to ")
+                                                      << oculus::OculusFileReader::indexPath(file) << ") at "
+                                                      << (rate_ > 0. ? std::to_string(rate_) + "x" : "full speed"));
+  this->replay_thread_ = std::thread(&OculusReplayNode::replay, this);
+}
+
+OculusReplayNode::~OculusReplayNode() {
+  stop_ = true;
+  if (this->replay_thread_.joinable()) {
+    this->replay_thread_.join();
+  }
+}
+
+void OculusReplayNode::replay() {
+  using Clock = std::chrono::steady_clock;
+  do {
+    // Pings are published at start + (recording date - first recording date) / rate
+    const Clock::time_point start = Clock::now();
+    const double first_time = reader_->size() > 0 ? reader_->message(0).time : 0.;
+    for (std::size_t i = 0; i < reader_->size() && !stop_ && rclcpp::ok(); ++i) {
+      const oculus::RecordedMessageView message = reader_->message(i);
+      if (rate_ > 0.) {
+        // Sleeps are bounded so that the node stops promptly on a long gap in the recording
+        const auto date = start + std::chrono::duration_cast<Clock::duration>(
+                                      std::chrono::duration<double>(std::max(message.time - first_time, 0.) / rate_));
+        while (!stop_ && Clock::now() < date) {
+          std::this_thread::sleep_until(std::min(date, Clock::now() + std::chrono::milliseconds(100)));
+        }
+      }
+      publishPing(message);
+    }
+  } while (loop_ && !stop_ && rclcpp::ok());
+  RCLCPP_INFO_STREAM(this->get_logger(), "End of " << reader_->path());
+}
+
+void OculusReplayNode::publishPing(const oculus::RecordedMessageView& message) {
+  const bool publish_ping = this->ping_publisher_->get_subscription_count() > 0;
+  const bool publish_image = sonar_viewer_.subscriptionCount() > 0;
+  if (!publish_ping && !publish_image) {
+    return;
+  }
+
+  const rclcpp::Time stamp = use_recording_stamp_ ? rclcpp::Time(static_cast<int64_t>(message.time * 1e9)) : this->now();
+  if (publish_ping && this->get_node_options().use_intra_process_comms()) {
+    // The ownership is given to rclcpp, the viewer renders the fan before the message is handed over
+    auto msg = std::make_unique<oculus_interfaces::msg::Ping>();
+    if (!oculus::toMsg(*msg, message.data, message.size, stamp)) {
+      return;  // Not a simple ping (status, user config...)
+    }
+    msg->header.frame_id = frame_id_;
+    msg->ping_firing_date_unwrapped =
+        sonar_clock_.update(msg->ping_firing_date, static_cast<int64_t>(message.time * 1e9));
+    if (publish_image) {
+      sonar_viewer_.publishFan(*msg);
+    }
+    this->ping_publisher_->publish(std::move(msg));
+    return;
+  }
+
+  // The capacity of ping_msg_ buffers is recycled from one ping to the other
+  if (!oculus::toMsg(ping_msg_, message.data, message.size, stamp)) {
+    return;
+  }
+  ping_msg_.header.frame_id = frame_id_;
+  ping_msg_.ping_firing_date_unwrapped =
+      sonar_clock_.update(ping_msg_.ping_firing_date, static_cast<int64_t>(message.time * 1e9));
+  if (publish_image) {
+    sonar_viewer_.publishFan(ping_msg_);
+  }
+  if (publish_ping) {
+    this->ping_publisher_->publish(ping_msg_);
+  }
+}
+
+#include <rclcpp_components/register_node_macro.hpp>
+
+RCLCPP_COMPONENTS_REGISTER_NODE(OculusReplayNode)
@@ -0,0 +1,480 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Simulated Oculus sonar, to run the driver and the nodes without the device. Like the sonar it broadcasts its status
+// on UDP port 52102, accepts a client on TCP port 52100, applies the simple fire messages it receives and sends simple
+// pings at the configured rate. Pings are either synthetic (seabed and moving targets, geometry following the config)
+// or replayed from a .oculus file.
+//
+// Usage: oculus_simulator [options], see --help.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <oculus_driver/Oculus.h>
+#include <oculus_ros2/oculus_file_reader.hpp>
+
+namespace {
+
+const uint16_t TCP_PORT = 52100;
+const uint16_t STATUS_PORT = 52102;
+
+volatile std::sig_atomic_t stop = 0;
+
+struct Options {
+  std::string file;  // Replayed if set, synthetic pings otherwise
+  std::string advertised_ip = "127.0.0.1";  // Address of the simulator given in the status
+  std::string status_address = "255.255.255.255";  // 127.0.0.1 where there is no network (CI)
+  double rate = 0.;  // Ping rate (Hz) forced over the config one if > 0
+  int beams = 512;  // Before the first config
+  int ranges = 0;  // Forced number of ranges of the synthetic pings if > 0, derived from the range otherwise
+};
+
+void printUsage() {
+  std::printf(
+      "Usage: oculus_simulator [options]\n"
+      "  --file FILE              Replay the pings of a .oculus file instead of synthetic ones\n"
+      "  --rate HZ                Ping at this rate whatever the ping_rate of the config\n"
+      "  --beams 256|512          Number of beams until a config is received (default 512)\n"
+      "  --ranges N               Number of ranges of synthetic pings (default: from the range)\n"
+      "  --ip ADDR                Sonar address advertised in the status (default 127.0.0.1)\n"
+      "  --status-address ADDR    Destination of the status messages (default 255.255.255.255)\n");
+}
+
+bool parseArguments(int argc, char** argv, Options& options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--ros-args") {
+      break;  // Added when started by ros2 launch
+    }
+    if (arg == "-h" || arg == "--help" || i + 1 >= argc) {
+      return false;
+    }
+    const std::string value = argv[++i];
+    if (arg == "--file") {
+      options.file = value;
+    } else if (arg == "--rate") {
+      options.rate = std::stod(value);
+    } else if (arg == "--beams") {
+      options.beams = std::stoi(value) == 256 ? 256 : 512;
+    } else if (arg == "--ranges") {
+      options.ranges = std::max(0, std::stoi(value));
+    } else if (arg == "--ip") {
+      options.advertised_ip = value;
+    } else if (arg == "--status-address") {
+      options.status_address = value;
+    } else {
+      std::fprintf(stderr, "Unknown option %s\n", arg.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+double pingRateHz(uint8_t ping_rate) {
+  switch (ping_rate) {
+    case pingRateNormal:
+      return 10.;
+    case pingRateHigh:
+      return 15.;
+    case pingRateHighest:
+      return 40.;
+    case pingRateLow:
+      return 5.;
+    case pingRateLowest:
+      return 2.;
+    default:
+      return 0.;  // pingRateStandby
+  }
+}
+
+OculusMessageHeader header(uint16_t msg_id, uint16_t msg_version, std::size_t message_size) {
+  OculusMessageHeader head;
+  std::memset(&head, 0, sizeof(head));
+  head.oculusId = OCULUS_CHECK_ID;
+  head.srcDeviceId = 1;
+  head.msgId = msg_id;
+  head.msgVersion = msg_version;
+  head.payloadSize = static_cast<uint32_t>(message_size - sizeof(OculusMessageHeader));
+  return head;
+}
+
+// Synthetic simple ping following the config: a sloping seabed and a few targets moving along the range axis, with
+// speckle. Row gains grow with the range.
+class SyntheticScene {
+public:
+  explicit SyntheticScene(int ranges) : forced_ranges_(ranges) {}
+
+  const std::vector<uint8_t>& ping(const OculusSimpleFireMessage& config, uint32_t ping_id, double time) {
+    const int n_beams = (config.flags & 0x40) ? 512 : 256;
+    const int sample_size = (config.flags & 0x02) ? 2 : 1;
+    const bool has_gains = config.flags & 0x04;
+    const double range = std::max(config.range, 0.1);
+    const double resolution = config.masterMode == 1 ? 0.02 : 0.008;  // Close to the M1200d ones
+    const int n_ranges = forced_ranges_ > 0 ? forced_ranges_ : std::clamp(static_cast<int>(range / resolution), 50, 1500);
+    const int step = n_beams * sample_size + (has_gains ? 4 : 0);
+    const std::size_t image_offset = sizeof(OculusSimplePingResult) + n_beams * sizeof(int16_t);
+    const std::size_t size = image_offset + static_cast<std::size_t>(n_ranges) * step;
+
+    OculusSimplePingResult ping;
+    std::memset(&ping, 0, sizeof(ping));
+    ping.fireMessage = config;
+    ping.fireMessage.head = header(messageSimplePingResult, 1, size);
+    ping.pingId = ping_id;
+    ping.frequency = config.masterMode == 1 ? 1.2e6 : 2.1e6;
+    ping.temperature = 15.;
+    ping.pressure = 1.;
+    ping.speeedOfSoundUsed = config.speedOfSound > 0. ? config.speedOfSound : 1500.;
+    ping.pingStartTime = static_cast<uint32_t>(static_cast<uint64_t>(time * 1e6));  // Microseconds, wraps as the sonar clock
+    ping.dataSize = sample_size == 2 ? dataSize16Bit : dataSize8Bit;
+    ping.rangeResolution = range / n_ranges;
+    ping.nRanges = static_cast<uint16_t>(n_ranges);
+    ping.nBeams = static_cast<uint16_t>(n_beams);
+    ping.imageOffset = static_cast<uint32_t>(image_offset);
+    ping.imageSize = static_cast<uint32_t>(size - image_offset);
+    ping.messageSize = static_cast<uint32_t>(size);
+
+    data_.resize(size);
+    std::memcpy(data_.data(), &ping, sizeof(ping));
+
+    // Beams are denser at the center of the fan, as on the real sonars
+    const double half_aperture = config.masterMode == 1 ? 65. : 40.;
+    std::vector<int16_t> bearings(n_beams);
+    for (int b = 0; b < n_beams; ++b) {
+      bearings[b] = static_cast<int16_t>(std::lround(100. * half_aperture * std::sin((2. * b / (n_beams - 1) - 1.) * M_PI / 2.)));
+    }
+    std::memcpy(data_.data() + sizeof(ping), bearings.data(), n_beams * sizeof(int16_t));
+
+    const double max_value = sample_size == 2 ? 65535. : 255.;
+    const double gain_scale = 0.5 + config.gainPercent / 100.;
+    const double targets[] = {0.3 + 0.2 * std::sin(0.5 * time), 0.5 + 0.1 * std::cos(0.3 * time), 0.7};
+    for (int r = 0; r < n_ranges; ++r) {
+      uint8_t* row = data_.data() + image_offset + static_cast<std::size_t>(r) * step;
+      const uint32_t gain = 1 + static_cast<uint32_t>(r);
+      if (has_gains) {
+        std::memcpy(row, &gain, sizeof(gain));  // Little-endian, as the sonar
+        row += 4;
+      }
+      const double x = static_cast<double>(r) / n_ranges;
+      for (int b = 0; b < n_beams; ++b) {
+        const double angle = bearings[b] / (100. * half_aperture);  // -1 .. 1
+        const double seabed = 0.6 + 0.25 * angle;  // Relative range of the seabed on this beam
+        double value = 0.02;
+        if (x > seabed) {
+          value += 0.5 * std::exp(-(x - seabed) * 8.);
+        }
+        for (int t = 0; t < 3; ++t) {
+          const double d = (x - targets[t]) * n_ranges;
+          const double a = (angle - 0.5 * (t - 1)) * n_beams;
+          value += 0.8 * std::exp(-(d * d + a * a) / 40.);
+        }
+        const double sample = std::min(max_value, max_value * value * gain_scale * (0.75 + 0.5 * noise()));
+        if (sample_size == 2) {
+          const uint16_t v = static_cast<uint16_t>(sample);
+          std::memcpy(row + 2 * b, &v, sizeof(v));
+        } else {
+          row[b] = static_cast<uint8_t>(sample);
+        }
+      }
+    }
+    return data_;
+  }
+
+private:
+  const int forced_ranges_;
+  std::vector<uint8_t> data_;
+  uint32_t random_state_ = 2463534242u;
+
+  double noise() {  // xorshift32, uniform in [0, 1)
+    random_state_ ^= random_state_ << 13;
+    random_state_ ^= random_state_ >> 17;
+    random_state_ ^= random_state_ << 5;
+    return random_state_ / 4294967296.;
+  }
+};
+
+bool sendAll(int socket, const uint8_t* data, std::size_t size) {
+  while (size > 0) {
+    const ssize_t sent = ::send(socket, data, size, MSG_NOSIGNAL);
+    if (sent <= 0) {
+      return false;
+    }
+    data += sent;
+    size -= sent;
+  }
+  return true;
+}
+
+class Simulator {
+public:
+  explicit Simulator(const Options& options) : options_(options), scene_(options.ranges) {
+    std::memset(&config_, 0, sizeof(config_));
+    config_.masterMode = 1;
+    config_.pingRate = pingRateNormal;
+    config_.gammaCorrection = 153;
+    config_.flags = 0x01 | 0x04 | 0x08 | (options.beams == 512 ? 0x40 : 0x00);  // meters, gains, simple ping
+    config_.range = 10.;
+    config_.gainPercent = 50.;
+    config_.speedOfSound = 1500.;
+    if (!options_.file.empty()) {
+      reader_ = std::make_unique<oculus::OculusFileReader>(options_.file);
+    }
+  }
+
+  ~Simulator() {
+    for (int fd : {client_, server_, status_socket_}) {
+      if (fd >= 0) {
+        ::close(fd);
+      }
+    }
+  }
+
+  bool open() {
+    server_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    const int yes = 1;
+    ::setsockopt(server_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    sockaddr_in address = socketAddress(INADDR_ANY, TCP_PORT);
+    if (::bind(server_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(server_, 1) != 0) {
+      std::perror("oculus_simulator: TCP port 52100");
+      return false;
+    }
+    status_socket_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+    ::setsockopt(status_socket_, SOL_SOCKET, SO_BROADCAST, &yes, sizeof(yes));
+    return true;
+  }
+
+  void run() {
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point next_status = Clock::now();
+    Clock::time_point next_ping = Clock::now();
+    while (!stop) {
+      const Clock::time_point now = Clock::now();
+      if (now >= next_status) {
+        sendStatus();
+        next_status = now + std::chrono::seconds(1);
+      }
+      const double rate = options_.rate > 0. ? options_.rate : pingRateHz(config_.pingRate);
+      if (client_ >= 0 && now >= next_ping) {
+        if (rate > 0.) {
+          sendPing();
+          const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1. / rate));
+          next_ping += period;
+          if (next_ping < now) {
+            next_ping = now + period;  // Late pings are not caught up, the rate never exceeds the configured one
+          }
+        } else {
+          sendDummy();  // Standby, the sonar keeps the connection alive with dummy messages
+          next_ping = now + std::chrono::seconds(1);
+        }
+      }
+
+      // Wait for the next event or for the client
+      const Clock::time_point next = client_ >= 0 ? std::min(next_status, next_ping) : next_status;
+      const int timeout = static_cast<int>(std::max<int64_t>(0,
+          std::chrono::duration_cast<std::chrono::milliseconds>(next - Clock::now()).count()));
+      pollfd fds[2] = {{server_, POLLIN, 0}, {client_, POLLIN, 0}};
+      if (::poll(fds, client_ >= 0 ? 2 : 1, timeout) <= 0) {
+        continue;
+      }
+      if (fds[0].revents & POLLIN) {
+        accept();
+      }
+      if (client_ >= 0 && (fds[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+        receive();
+      }
+    }
+  }
+
+private:
+  const Options options_;
+  SyntheticScene scene_;
+  std::unique_ptr<oculus::OculusFileReader> reader_;
+  std::size_t next_message_ = 0;
+  OculusSimpleFireMessage config_;
+  uint32_t ping_id_ = 0;
+  int server_ = -1;
+  int client_ = -1;
+  int status_socket_ = -1;
+  std::vector<uint8_t> received_;
+
+  static sockaddr_in socketAddress(uint32_t host_order_address, uint16_t port) {
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(host_order_address);
+    address.sin_port = htons(port);
+    return address;
+  }
+
+  void sendStatus() {
+    OculusStatusMsg status;
+    std::memset(&status, 0, sizeof(status));
+    status.hdr = header(0, 0, sizeof(status));  // The driver identifies status messages by their size
+    status.deviceId = 1;
+    status.ipAddr = ::inet_addr(options_.advertised_ip.c_str());  // Network byte order, as sent by the sonar
+    status.ipMask = ::inet_addr("255.255.255.0");
+    status.connectedIpAddr = client_ >= 0 ? ::inet_addr("127.0.0.1") : 0;
+    status.temperature0 = 15.;
+    status.pressure = 1.;
+
+    sockaddr_in address = socketAddress(0, STATUS_PORT);
+    address.sin_addr.s_addr = ::inet_addr(options_.status_address.c_str());
+    ::sendto(status_socket_, &status, sizeof(status), 0, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+  }
+
+  void accept() {
+    const int client = ::accept(server_, nullptr, nullptr);
+    if (client < 0) {
+      return;
+    }
+    if (client_ >= 0) {
+      ::close(client_);  // The sonar serves a single client, the last one wins
+    }
+    client_ = client;
+    received_.clear();
+    std::printf("oculus_simulator: client connected\n");
+  }
+
+  void disconnect() {
+    ::close(client_);
+    client_ = -1;
+    std::printf("oculus_simulator: client disconnected\n");
+  }
+
+  // Reads the messages of the client, only simple fire messages are meaningful to the sonar
+  void receive() {
+    uint8_t buffer[4096];
+    const ssize_t size = ::recv(client_, buffer, sizeof(buffer), 0);
+    if (size <= 0) {
+      disconnect();
+      return;
+    }
+    received_.insert(received_.end(), buffer, buffer + size);
+    while (received_.size() >= sizeof(OculusMessageHeader)) {
+      OculusMessageHeader head;
+      std::memcpy(&head, received_.data(), sizeof(head));
+      if (head.oculusId != OCULUS_CHECK_ID) {
+        std::fprintf(stderr, "oculus_simulator: invalid message from the client\n");
+        disconnect();
+        return;
+      }
+      const std::size_t message_size = sizeof(head) + head.payloadSize;
+      if (received_.size() < message_size) {
+        return;
+      }
+      // OculusSimpleFireMessage2 only differs after the salinity, version 1 and 2 are read the same way
+      if (head.msgId == messageSimpleFire && message_size >= sizeof(OculusSimpleFireMessage)) {
+        std::memcpy(&config_, received_.data(), sizeof(config_));
+        std::printf("oculus_simulator: config mode %d, rate %d, flags 0x%02x, range %.1f, gain %.1f\n",
+            config_.masterMode, config_.pingRate, config_.flags, config_.range, config_.gainPercent);
+      }
+      received_.erase(received_.begin(), received_.begin() + message_size);
+    }
+  }
+
+  void sendPing() {
+    const double time = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+    bool sent;
+    if (reader_) {
+      sent = sendRecordedPing();
+    } else {
+      const std::vector<uint8_t>& ping = scene_.ping(config_, ping_id_++, time);
+      sent = sendAll(client_, ping.data(), ping.size());
+    }
+    if (!sent) {
+      disconnect();
+    }
+  }
+
+  // Next simple ping of the file, looping at its end
+  bool sendRecordedPing() {
+    for (std::size_t tries = 0; tries < reader_->size(); ++tries) {
+      const oculus::RecordedMessageView message = reader_->message(next_message_);
+      next_message_ = (next_message_ + 1) % reader_->size();
+      OculusMessageHeader head;
+      if (message.size < sizeof(head)) {
+        continue;
+      }
+      std::memcpy(&head, message.data, sizeof(head));
+      if (head.oculusId == OCULUS_CHECK_ID && head.msgId == messageSimplePingResult) {
+        return sendAll(client_, message.data, message.size);
+      }
+    }
+    return true;  // No ping in the file
+  }
+
+  void sendDummy() {
+    const OculusMessageHeader head = header(messageDummy, 0, sizeof(OculusMessageHeader));
+    if (!sendAll(client_, reinterpret_cast<const uint8_t*>(&head), sizeof(head))) {
+      disconnect();
+    }
+  }
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!parseArguments(argc, argv, options)) {
+    printUsage();
+    return 1;
+  }
+  std::signal(SIGINT, [](int) { stop = 1; });
+  std::signal(SIGTERM, [](int) { stop = 1; });
+
+  try {
+    Simulator simulator(options);
+    if (!simulator.open()) {
+      return 1;
+    }
+    std::printf("oculus_simulator: listening on TCP port %d, status sent to %s:%d\n", TCP_PORT,
+        options.status_address.c_str(), STATUS_PORT);
+    simulator.run();
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "oculus_simulator: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
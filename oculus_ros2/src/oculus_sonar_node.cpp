@@ -36,29 +36,109 @@
 
 using SonarDriver = oculus::SonarDriver;
 
-OculusSonarNode::OculusSonarNode()
-  : Node("oculus_sonar"),
+namespace {
+
+DropPolicy dropPolicyFromString(const rclcpp::Logger& logger, const std::string& policy) {
+  if (policy == "drop_newest") {
+    return DropPolicy::DROP_NEWEST;
+  }
+  if (policy != "drop_oldest") {
+    RCLCPP_WARN_STREAM(logger, "Unknown ping_queue_policy " << policy << " (drop_oldest or drop_newest), using drop_oldest.");
+  }
+  return DropPolicy::DROP_OLDEST;
+}
+
+// The capacity is converted to std::size_t: rclcpp rejects the values below one instead of letting them wrap around
+rcl_interfaces::msg::ParameterDescriptor pingQueueSizeDescriptor() {
+  rcl_interfaces::msg::ParameterDescriptor desc;
+  desc.description = "Number of pings waiting to be published before some are dropped, min=1, max=1024.";
+  rcl_interfaces::msg::IntegerRange range;
+  range.set__from_value(1).set__to_value(params::PING_QUEUE_SIZE_MAX_VALUE).set__step(1);
+  desc.integer_range = {range};
+  return desc;
+}
+
+const char* toString(ConnectionState state) {
+  switch (state) {
+    case ConnectionState::DISCOVERING:
+      return "discovering";
+    case ConnectionState::CONNECTING:
+      return "connecting";
+    case ConnectionState::CONFIGURING:
+      return "configuring";
+    case ConnectionState::STREAMING:
+      return "streaming";
+    default:
+      return "lost";
+  }
+}
+
+}  // namespace
+
+OculusSonarNode::OculusSonarNode(const rclcpp::NodeOptions& options)
+  : Node("oculus_sonar", options),
     is_running_(this->declare_parameter<bool>("run", params::RUN_MODE_DEFAULT_VALUE)),
     sonar_viewer_(static_cast<rclcpp::Node*>(this)),
     frame_id_(this->declare_parameter<std::string>("frame_id", "sonar")),
     temperature_warn_limit_(this->declare_parameter<double>("temperature_warn", params::TEMPERATURE_WARN_DEFAULT_VALUE)),
-    temperature_stop_limit_(this->declare_parameter<double>("temperature_stop", params::TEMPERATURE_STOP_DEFAULT_VALUE)) {
+    temperature_stop_limit_(this->declare_parameter<double>("temperature_stop", params::TEMPERATURE_STOP_DEFAULT_VALUE)),
+    ping_queue_(this->declare_parameter<int>("ping_queue_size", params::PING_QUEUE_SIZE_DEFAULT_VALUE,
+                    pingQueueSizeDescriptor()),
+        dropPolicyFromString(this->get_logger(),
+            this->declare_parameter<std::string>("ping_queue_policy", params::PING_QUEUE_POLICY_DEFAULT_VALUE))),
+    connection_timeout_(this->declare_parameter<double>("connection_timeout", params::CONNECTION_TIMEOUT_DEFAULT_VALUE)),
+    parameter_echo_period_(
+        this->declare_parameter<double>("parameter_echo_period", params::PARAMETER_ECHO_PERIOD_DEFAULT_VALUE)) {
   this->status_publisher_ = this->create_publisher<oculus_interfaces::msg::OculusStatus>("status", 1);
   this->ping_publisher_ = this->create_publisher<oculus_interfaces::msg::Ping>("ping", 1);
+  this->compressed_ping_publisher_ = this->create_publisher<oculus_interfaces::msg::CompressedPing>("ping/compressed", 1);
   this->temperature_publisher_ = this->create_publisher<sensor_msgs::msg::Temperature>("temperature", 1);
   this->pressure_publisher_ = this->create_publisher<sensor_msgs::msg::FluidPressure>("pressure", 1);
-
-  this->sonar_driver_ = std::make_shared<SonarDriver>(this->io_service_.io_service());
-  this->io_service_.start();
-  if (!this->sonar_driver_->wait_next_message()) {  // Non-blocking function making connection with the sonar.
-    std::cerr << "Timeout reached while waiting for a connection to the Oculus sonar. "
-              << "Is it properly connected ?" << std::endl;
+  const std::string stamp = this->declare_parameter<std::string>("stamp", params::STAMP_DEFAULT_VALUE);
+  if (stamp != "firing" && stamp != "reception") {
+    RCLCPP_WARN_STREAM(this->get_logger(), "Unknown stamp " << stamp << " (firing or reception), using firing.");
   }
-
-  while (!this->sonar_driver_->connected())  // Blocking while waiting the connected with the sonar.
-  {
-    const int sleepWhileConnecting = 1000;
-    std::this_thread::sleep_for(std::chrono::milliseconds(sleepWhileConnecting));
+  stamp_firing_ = stamp != "reception";
+
+  rcl_interfaces::msg::ParameterDescriptor compression_desc;
+  compression_desc.description =
+      "Compressor of the ping/compressed topic.\n"
+      "\tlz4: Fastest, lowest ratio.\n"
+      "\tzstd: Better ratio, slower at high compression_level.";
+  ping_codec::Parameters codec_params;
+  const std::string compression =
+      this->declare_parameter<std::string>("compression", params::COMPRESSION_DEFAULT_VALUE, compression_desc);
+  if (!ping_codec::formatFromString(compression, codec_params.format)) {
+    RCLCPP_WARN_STREAM(this->get_logger(), "Unknown compression " << compression << " (lz4 or zstd), using zstd.");
+  }
+  codec_params.level = this->declare_parameter<int>("compression_level", params::COMPRESSION_LEVEL_DEFAULT_VALUE);
+  codec_params.bits = this->declare_parameter<int>("compression_bits", params::COMPRESSION_BITS_DEFAULT_VALUE);
+  codec_params.delta = this->declare_parameter<bool>("compression_delta", params::COMPRESSION_DELTA_DEFAULT_VALUE);
+  this->ping_encoder_ = ping_codec::Encoder(codec_params);
+
+  rcl_interfaces::msg::ParameterDescriptor temporal_filter_desc;
+  temporal_filter_desc.description =
+      "Temporal filter of the ping images, applied to the ping and image outputs.\n"
+      "\toff: Pings published as received.\n"
+      "\tema: Exponential moving average, weight temporal_filter_alpha on the last ping.\n"
+      "\tmedian: Median of the last temporal_filter_frames pings.\n"
+      "\tspeckle: Temporal Lee filter, moving average where the ping varies as speckle (temporal_filter_speckle).";
+  temporal_filter::Parameters filter_params;
+  const std::string filter_mode =
+      this->declare_parameter<std::string>("temporal_filter", params::TEMPORAL_FILTER_DEFAULT_VALUE, temporal_filter_desc);
+  if (!temporal_filter::modeFromString(filter_mode, filter_params.mode)) {
+    RCLCPP_WARN_STREAM(
+        this->get_logger(), "Unknown temporal_filter " << filter_mode << " (off, ema, median or speckle), using off.");
+  }
+  filter_params.alpha = this->declare_parameter<double>("temporal_filter_alpha", params::TEMPORAL_FILTER_ALPHA_DEFAULT_VALUE);
+  filter_params.frames = this->declare_parameter<int>("temporal_filter_frames", params::TEMPORAL_FILTER_FRAMES_DEFAULT_VALUE);
+  filter_params.speckle =
+      this->declare_parameter<double>("temporal_filter_speckle", params::TEMPORAL_FILTER_SPECKLE_DEFAULT_VALUE);
+  this->temporal_filter_ = temporal_filter::Filter(filter_params);
+
+  if (this->declare_parameter<bool>("pipeline_stats", params::PIPELINE_STATS_DEFAULT_VALUE)) {
+    this->pipeline_stats_ = std::make_unique<PipelineStats>();
+    this->sonar_viewer_.setStats(this->pipeline_stats_.get());
   }
 
   for (const params::BoolParam& param : params::BOOL) {
@@ -77,7 +157,7 @@ OculusSonarNode::OculusSonarNode()
       param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
       param_desc.description = param.desc;
       rcl_interfaces::msg::IntegerRange range;
-      range.set__from_value(param.min).set__to_value(param.max).set__step(1);
+      range.set__from_value(param.min).set__to_value(param.max).set__step(param.step);
       param_desc.integer_range = {range};
       this->declare_parameter<int>(param.name, param.default_val, param_desc);
     }
@@ -88,31 +168,55 @@ OculusSonarNode::OculusSonarNode()
       param_desc.name = param.name;
       param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
       param_desc.description = param.desc;
-      rcl_interfaces::msg::IntegerRange range;
-      range.set__from_value(param.min).set__to_value(param.max).set__step(param.step);
-      param_desc.integer_range = {range};
+      // Without step: the values echoed by the sonar are not on the param.step grid
+      rcl_interfaces::msg::FloatingPointRange range;
+      range.set__from_value(param.min).set__to_value(param.max).set__step(0.);
+      param_desc.floating_point_range = {range};
       this->declare_parameter<double>(param.name, param.default_val, param_desc);
     }
   }
 
-  // Get the current sonar config
-  updateLocalParameters(currentSonarParameters_, this->sonar_driver_->current_ping_config());
-  for (const std::string& param_name : dynamic_parameters_names_) {
-    setConfigCallback(this->get_parameters(std::vector{param_name}));
-  }
+  // The parameters are available right away, they are applied to the sonar once it is connected (CONFIGURING state)
+  setRosParameters(this->get_parameters(dynamic_parameters_names_));
+  ros_parameters_.clearQueued();  // Sent as the whole config once connected
   this->param_cb_ = this->add_on_set_parameters_callback(std::bind(&OculusSonarNode::setConfigCallback, this,
       std::placeholders::_1));  // TODO(hugoyvrn, to move before parameters initialisation ?)
 
   // this->??(&OculusSonarNode::enableRunMode)  // TODO(hugoyvrn)
 
+  this->sonar_driver_ = std::make_shared<SonarDriver>(this->io_service_.io_service());
+  currentConfig_ = this->sonar_driver_->current_ping_config();
+  checkMinimalFlags(currentConfig_.flags);
+  setSonarParameters(sonar_config::fromConfig(currentConfig_, SonarParameters{}));
+
   this->sonar_driver_->add_status_callback(std::bind(&OculusSonarNode::publishStatus, this, std::placeholders::_1));
-  this->sonar_driver_->add_ping_callback(std::bind(&OculusSonarNode::publishPing, this, std::placeholders::_1));
+  // The driver network thread only enqueues the pings, they are published and rendered by ping_worker_
+  this->ping_worker_ = std::thread(&OculusSonarNode::processPings, this);
+  this->sonar_driver_->add_ping_callback(std::bind(&OculusSonarNode::enqueuePing, this, std::placeholders::_1));
   // callback on dummy messages to reactivate the pings as needed
   this->sonar_driver_->add_dummy_callback(std::bind(&OculusSonarNode::handleDummy, this));
+
+  // The connection is not waited for: it is followed by a timer, the driver connects and reconnects in background
+  this->diagnostics_publisher_ = this->create_publisher<diagnostic_msgs::msg::DiagnosticArray>("/diagnostics", 1);
+  connection_start_date_ = state_date_ = steadyNow();  // The time to first ping of the first connection
+  this->io_service_.start();
+  this->connection_timer_ = this->create_wall_timer(
+      std::chrono::milliseconds(200), std::bind(&OculusSonarNode::updateConnectionState, this));
+  publishDiagnostics();
 }
 
 OculusSonarNode::~OculusSonarNode() {
+  // The request thread uses the driver and its network thread: it is waited for before they are stopped and destroyed
+  this->connection_timer_->cancel();
+  if (this->config_request_ && this->config_request_->feedback.valid()) {
+    this->config_request_->feedback.wait();  // Bounded by the driver timeout, its exception is dropped with the request
+  }
+  this->config_request_.reset();
   this->io_service_.stop();
+  this->ping_queue_.close();
+  if (this->ping_worker_.joinable()) {
+    this->ping_worker_.join();
+  }
 }
 
 void OculusSonarNode::enableRunMode() {
@@ -128,6 +232,24 @@ void OculusSonarNode::disableRunMode() {
   RCLCPP_INFO(this->get_logger(), "Going to standby mode");
 }
 
+// Called by the ping and driver threads, the last request wins: it reflects the latest state
+void OculusSonarNode::requestRunMode(RunModeRequest request) {
+  run_mode_request_ = request;
+}
+
+void OculusSonarNode::applyRunModeRequest() {
+  switch (run_mode_request_.exchange(RunModeRequest::NONE)) {
+    case RunModeRequest::STANDBY:
+      disableRunMode();
+      break;
+    case RunModeRequest::RESUME:
+      enableRunMode();
+      break;
+    case RunModeRequest::NONE:
+      break;
+  }
+}
+
 void OculusSonarNode::checkOverheating(const double& new_temperature) {
   is_overheating_ = new_temperature >= temperature_stop_limit_;
 }
@@ -137,15 +259,13 @@ void OculusSonarNode::setMinimalFlags(uint8_t& flags) const {
          | flagByte::SEND_GAINS  // force send gain to true this
          | flagByte::SIMPLE_PING;  // use simple ping
 
-  if (currentSonarParameters_.frequency_mode == params::FREQUENCY_MODE.max) {
+  if (sonarParameters()->frequency_mode == params::FREQUENCY_MODE.max) {
     // TODO(hugoyvrn, gain_assist not working, to fix)
     // flags |= flagByte::GAIN_ASSIST;
     flags &= ~flagByte::GAIN_ASSIST;
   }
 
-  // flags | 0x02 make wird change (depending of the configuration)
-  // flags |= 0x02;
-  flags &= ~0x02;
+  // flags | 0x02 (16 bits data) is driven by the data_depth parameter
   // flags | 0x20 must be ???
   // flags |= 0x20;
   // flags &= ~0x20;
@@ -168,20 +288,26 @@ void OculusSonarNode::checkMinimalFlags(const uint8_t& flags) const {
 }
 
 void OculusSonarNode::publishStatus(const OculusStatusMsg& status) {
+  last_status_date_ = steadyNow();
 
-  static oculus_interfaces::msg::OculusStatus msg;
-  oculus::toMsg(msg, status);
-  this->status_publisher_->publish(msg);
+  if (this->status_publisher_->get_subscription_count() > 0) {
+    static oculus_interfaces::msg::OculusStatus msg;
+    oculus::toMsg(msg, status);
+    this->status_publisher_->publish(msg);
+  }
 
   if (!is_running_) {
     checkOverheating(status.temperature6);
+  }
+  if (!is_running_ && this->temperature_publisher_->get_subscription_count() > 0) {
     sensor_msgs::msg::Temperature temperature_ros_msg;
     temperature_ros_msg.header.frame_id = frame_id_;
     temperature_ros_msg.header.stamp = this->now();
     temperature_ros_msg.temperature = status.temperature6;  // Measurement of the Temperature in Degrees Celsius
     temperature_ros_msg.variance = 0;  // 0 is interpreted as variance unknown
     this->temperature_publisher_->publish(temperature_ros_msg);
-
+  }
+  if (!is_running_ && this->pressure_publisher_->get_subscription_count() > 0) {
     sensor_msgs::msg::FluidPressure pressure_ros_msg;
     pressure_ros_msg.header.frame_id = frame_id_;
     pressure_ros_msg.header.stamp = this->now();
@@ -191,46 +317,106 @@ void OculusSonarNode::publishStatus(const OculusStatusMsg& status) {
   }
 }
 
-void OculusSonarNode::updateRosConfig() {
-  std::shared_lock l(param_mutex_);
+// Sets the ROS parameters which differ from the sonar values, in a single call (executor thread)
+void OculusSonarNode::updateRosConfig(const SonarParameters& sonar_parameters) {
+  const std::vector<rclcpp::Parameter> changed = ros_parameters_.applySonarValues(
+      sonar_parameters, [this](const std::vector<rclcpp::Parameter>& parameters) { this->set_parameters(parameters); });
+  for (const rclcpp::Parameter& param : changed) {
+    RCLCPP_WARN_STREAM(this->get_logger(),
+        "The parameter " << param.get_name() << " has change by it self to " << param.value_to_string());
+  }
+}
 
-  updateRosConfigForParam<int>(
-      currentRosParameters_.frequency_mode, currentSonarParameters_.frequency_mode, params::FREQUENCY_MODE.name);
-  updateRosConfigForParam<double>(currentRosParameters_.range, currentSonarParameters_.range, params::RANGE.name);
-  updateRosConfigForParam<double>(
-      currentRosParameters_.gain_percent, currentSonarParameters_.gain_percent, params::GAIN_PERCENT.name);
-  updateRosConfigForParam<double>(
-      currentRosParameters_.sound_speed, currentSonarParameters_.sound_speed, params::SOUND_SPEED.name);
-  updateRosConfigForParam<int>(currentRosParameters_.ping_rate, currentSonarParameters_.ping_rate, params::PING_RATE.name);
-  updateRosConfigForParam<bool>(currentRosParameters_.gain_assist, currentSonarParameters_.gain_assist, params::GAIN_ASSIT.name);
-  updateRosConfigForParam<int>(
-      currentRosParameters_.gamma_correction, currentSonarParameters_.gamma_correction, params::GAMMA_CORRECTION.name);
-  updateRosConfigForParam<bool>(
-      currentRosParameters_.use_salinity, currentSonarParameters_.use_salinity, params::USE_SALINITY.name);
-  updateRosConfigForParam<double>(currentRosParameters_.salinity, currentSonarParameters_.salinity, params::SALINITY.name);
+// Applies the values echoed in the last pings, at most once every parameter_echo_period seconds
+void OculusSonarNode::applyPingEcho(int64_t now) {
+  if (!ping_echo_.valid || now - last_echo_date_ < static_cast<int64_t>(parameter_echo_period_ * 1e9)) {
+    return;
+  }
+  last_echo_date_ = now;
+
+  const std::shared_ptr<const SonarParameters> current = sonarParameters();
+  SonarParameters echoed = *current;
+  echoed.frequency_mode = ping_echo_.frequency_mode.load(std::memory_order_relaxed);
+  echoed.range = ping_echo_.range.load(std::memory_order_relaxed);
+  echoed.gain_percent = ping_echo_.gain_percent.load(std::memory_order_relaxed);
+  echoed.sound_speed = ping_echo_.sound_speed.load(std::memory_order_relaxed);
+  echoed.data_depth = ping_echo_.data_depth.load(std::memory_order_relaxed);
+  if (echoed.frequency_mode != current->frequency_mode || echoed.range != current->range ||
+      echoed.gain_percent != current->gain_percent || echoed.sound_speed != current->sound_speed ||
+      echoed.data_depth != current->data_depth) {
+    setSonarParameters(echoed);
+  }
+  updateRosConfig(echoed);
 }
 
 int OculusSonarNode::get_subscription_count() const {
-  return this->ping_publisher_->get_subscription_count() + sonar_viewer_.image_publisher_->get_subscription_count();
+  return this->ping_publisher_->get_subscription_count() + this->compressed_ping_publisher_->get_subscription_count() +
+         sonar_viewer_.subscriptionCount();
+}
+
+std::shared_ptr<const SonarParameters> OculusSonarNode::sonarParameters() const {
+  return std::atomic_load(&currentSonarParameters_);
+}
+
+// The snapshot is never modified once published: the readers keep a consistent copy while it is replaced
+void OculusSonarNode::setSonarParameters(const SonarParameters& parameters) {
+  std::atomic_store(&currentSonarParameters_, std::make_shared<const SonarParameters>(parameters));
+}
+
+void OculusSonarNode::enqueuePing(const oculus::PingMessage::ConstPtr& ping) {
+  const int64_t now = steadyNow();
+  last_message_date_ = now;
+  if (waiting_first_ping_.exchange(false)) {
+    const double time_to_first_ping = (now - connection_start_date_) * 1e-9;
+    time_to_first_ping_ = time_to_first_ping;
+    RCLCPP_INFO_STREAM(this->get_logger(), "First ping received " << time_to_first_ping << " s after the connection start.");
+  }
+  this->ping_queue_.push(ping);
+}
+
+void OculusSonarNode::processPings() {
+  oculus::PingMessage::ConstPtr ping;
+  while (this->ping_queue_.pop(ping)) {
+    const std::size_t dropped = this->ping_queue_.dropped();
+    if (dropped != reported_dropped_pings_) {
+      RCLCPP_WARN_STREAM_THROTTLE(this->get_logger(), *this->get_clock(), 5000,
+          dropped << " pings dropped so far (ping_queue_size = " << this->ping_queue_.capacity()
+                  << "), the node does not keep up with the sonar ping rate.");
+      reported_dropped_pings_ = dropped;
+    }
+    publishPing(ping);
+  }
 }
 
 void OculusSonarNode::publishPing(const oculus::PingMessage::ConstPtr& ping) {
-  // Check if the sonar must go in standby mode
+  PipelineStats* stats = this->pipeline_stats_.get();
+  if (stats) {
+    stats->recordPing(ping->ping_index(), ping->data().size());
+    // The sonar clock (microseconds, 32 bits) has an unknown offset with the host one, only the variations are meaningful
+    const uint32_t reception_us = static_cast<uint32_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(ping->timestamp().time_since_epoch()).count());
+    stats->record(PipelineStage::TRANSPORT, 1e-6 * static_cast<uint32_t>(reception_us - ping->ping_firing_date()));
+    stats->record(PipelineStage::QUEUE,
+        std::chrono::duration<double>(SonarDriver::TimePoint::clock::now() - ping->timestamp()).count());
+  }
+
+  // Check if the sonar must go in standby mode, done by the connection timer
   checkOverheating(ping->temperature());
+  const std::shared_ptr<const SonarParameters> sonar_parameters = sonarParameters();
   if (!is_running_) {
-    disableRunMode();
+    requestRunMode(RunModeRequest::STANDBY);
   } else if (get_subscription_count() == 0) {
     RCLCPP_INFO(this->get_logger(), "There is no subscriber nor to ping topic neither to image topic.");
-    disableRunMode();
-  } else if (currentSonarParameters_.ping_rate == pingRateStandby) {
+    requestRunMode(RunModeRequest::STANDBY);
+  } else if (sonar_parameters->ping_rate == pingRateStandby) {
     RCLCPP_INFO_STREAM(this->get_logger(), "ping_rate mode is seted to " << pingRateStandby << ".");
-    disableRunMode();
+    requestRunMode(RunModeRequest::STANDBY);
   } else if (is_overheating_) {
     RCLCPP_FATAL_STREAM(this->get_logger(), "Temperature of sonar is to high ("
                                                 << ping->temperature()
                                                 << "°C). Make sur the sonar is underwatter. Security limit set at "
                                                 << temperature_stop_limit_ << "°C");
-    disableRunMode();
+    requestRunMode(RunModeRequest::STANDBY);
   } else if (ping->temperature() >= temperature_warn_limit_) {
     RCLCPP_WARN_STREAM(this->get_logger(), "Temperature of sonar is to high ("
                                                << ping->temperature()
@@ -238,216 +424,233 @@ void OculusSonarNode::publishPing(const oculus::PingMessage::ConstPtr& ping) {
                                                << temperature_stop_limit_ << "°C");
   }
 
-  // Update current config with ping information
-  currentSonarParameters_.frequency_mode = ping->master_mode();
-  currentSonarParameters_.range = ping->range();
-  currentSonarParameters_.gain_percent = ping->gain_percent();
-  currentSonarParameters_.sound_speed = ping->speed_of_sound_used();
-  updateRosConfig();
+  // The values used by the sonar are applied to the parameters by the connection timer (applyPingEcho)
+  ping_echo_.frequency_mode.store(ping->master_mode(), std::memory_order_relaxed);
+  ping_echo_.range.store(ping->range(), std::memory_order_relaxed);
+  ping_echo_.gain_percent.store(ping->gain_percent(), std::memory_order_relaxed);
+  ping_echo_.sound_speed.store(ping->speed_of_sound_used(), std::memory_order_relaxed);
+  ping_echo_.data_depth.store(8 * ping->sample_size(), std::memory_order_relaxed);
+  ping_echo_.valid.store(true, std::memory_order_relaxed);
+
+  // Every ping goes through the clock estimator, even if not published, to follow the sonar clock
+  const int64_t reception =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(ping->timestamp().time_since_epoch()).count();
+  const uint64_t firing_date = sonar_clock_.update(ping->ping_firing_date(), reception);
+  clock_drift_ = sonar_clock_.drift();
+  clock_resets_ = sonar_clock_.resets();
+
+  // The filtered image replaces the ping image in all the outputs
+  const std::vector<uint8_t>* ping_data = &ping->data();
+  if (temporal_filter_.parameters().mode != temporal_filter::Mode::OFF) {
+    StageProbe probe(stats, PipelineStage::FILTER);
+    filtered_data_.assign(ping->data().begin(), ping->data().end());
+    const temporal_filter::Geometry geometry{static_cast<int>(ping->range_count()), static_cast<int>(ping->bearing_count()),
+        static_cast<int>(ping->step()), static_cast<int>(ping->sample_size()), ping->has_gains(),
+        static_cast<int>(ping->master_mode()), ping->range()};
+    temporal_filter_.apply(filtered_data_.data() + ping->ping_data_offset(), geometry);
+    temporal_filter_resets_ = temporal_filter_.resets();
+    ping_data = &filtered_data_;
+  }
 
-  static oculus_interfaces::msg::Ping msg;
-  msg.header.frame_id = frame_id_;
-  oculus::toMsg(msg, ping);
-  this->ping_publisher_->publish(msg);
+  std_msgs::msg::Header header;
+  header.frame_id = frame_id_;
+  header.stamp = stamp_firing_ ? rclcpp::Time(sonar_clock_.toHost(firing_date)) : oculus::toMsg(ping->timestamp());
+
+  auto fillPing = [&](oculus_interfaces::msg::Ping& msg) {
+    StageProbe probe(stats, PipelineStage::CONVERSION);
+    oculus::toMsg(msg, ping, false);
+    msg.ping_data.assign(ping_data->begin(), ping_data->end());
+    msg.header = header;
+    msg.ping_firing_date_unwrapped = firing_date;
+  };
+
+  // Each output is only computed if someone listens to it
+  if (this->ping_publisher_->get_subscription_count() > 0) {
+    // The ping data is copied once, from the driver receive buffer to the message handed over to rclcpp
+    if (this->ping_publisher_->can_loan_messages()) {
+      auto loaned_msg = this->ping_publisher_->borrow_loaned_message();
+      fillPing(loaned_msg.get());
+      StageProbe probe(stats, PipelineStage::PUBLISH);
+      this->ping_publisher_->publish(std::move(loaned_msg));
+    } else if (this->get_node_options().use_intra_process_comms()) {
+      // publish(const T&) would duplicate the message: the ownership is given to rclcpp instead, intra-process subscribers
+      // (composed nodes) receive it without copy nor serialization
+      auto msg = std::make_unique<oculus_interfaces::msg::Ping>();
+      fillPing(*msg);
+      StageProbe probe(stats, PipelineStage::PUBLISH);
+      this->ping_publisher_->publish(std::move(msg));
+    } else {
+      // Published synchronously, the capacity of ping_msg_ buffers is recycled from one ping to the other
+      fillPing(ping_msg_);
+      StageProbe probe(stats, PipelineStage::PUBLISH);
+      this->ping_publisher_->publish(ping_msg_);
+    }
+  }
+
+  if (this->compressed_ping_publisher_->get_subscription_count() > 0) {
+    // The ping data is read from the driver buffer by the encoder, the message only holds the compressed data
+    auto fillCompressedPing = [&](oculus_interfaces::msg::CompressedPing& msg) {
+      oculus::toMsg(msg.ping, ping, false);
+      msg.ping.header = header;
+      msg.ping.ping_firing_date_unwrapped = firing_date;
+      StageProbe probe(stats, PipelineStage::COMPRESSION);
+      ping_encoder_.encode(ping_data->data(), ping_data->size(), msg);
+    };
+    if (this->get_node_options().use_intra_process_comms()) {
+      auto msg = std::make_unique<oculus_interfaces::msg::CompressedPing>();
+      fillCompressedPing(*msg);
+      this->compressed_ping_publisher_->publish(std::move(msg));
+    } else {
+      fillCompressedPing(compressed_ping_msg_);
+      this->compressed_ping_publisher_->publish(compressed_ping_msg_);
+    }
+  }
 
-  sensor_msgs::msg::Temperature temperature_ros_msg;
-  temperature_ros_msg.header = msg.header;
-  temperature_ros_msg.temperature = msg.temperature;  // Measurement of the Temperature in Degrees Celsius
-  temperature_ros_msg.variance = 0;  // 0 is interpreted as variance unknown
-  this->temperature_publisher_->publish(temperature_ros_msg);
+  if (this->temperature_publisher_->get_subscription_count() > 0) {
+    sensor_msgs::msg::Temperature temperature_ros_msg;
+    temperature_ros_msg.header = header;
+    temperature_ros_msg.temperature = ping->temperature();  // Measurement of the Temperature in Degrees Celsius
+    temperature_ros_msg.variance = 0;  // 0 is interpreted as variance unknown
+    this->temperature_publisher_->publish(temperature_ros_msg);
+  }
 
-  sensor_msgs::msg::FluidPressure pressure_ros_msg;
-  pressure_ros_msg.header = msg.header;
-  pressure_ros_msg.fluid_pressure = msg.pressure;  // Absolute pressure reading in Pascals.
-  pressure_ros_msg.variance = 0;  // 0 is interpreted as variance unknown
-  this->pressure_publisher_->publish(pressure_ros_msg);
+  if (this->pressure_publisher_->get_subscription_count() > 0) {
+    sensor_msgs::msg::FluidPressure pressure_ros_msg;
+    pressure_ros_msg.header = header;
+    pressure_ros_msg.fluid_pressure = ping->pressure();  // Absolute pressure reading in Pascals.
+    pressure_ros_msg.variance = 0;  // 0 is interpreted as variance unknown
+    this->pressure_publisher_->publish(pressure_ros_msg);
+  }
 
   // TODO(hugoyvrn, publish bearings)
 
-  sonar_viewer_.publishFan(ping, frame_id_);
+  sonar_viewer_.publishFan(ping, *ping_data, header);  // Only keeps its remap tables up to date if the image is not subscribed
+
+  if (stats) {
+    stats->record(PipelineStage::TOTAL,
+        std::chrono::duration<double>(SonarDriver::TimePoint::clock::now() - ping->timestamp()).count());
+  }
 }
 
 void OculusSonarNode::handleDummy() {
-  if (is_running_ && get_subscription_count() > 0 && !is_overheating_ && currentSonarParameters_.ping_rate != pingRateStandby) {
+  last_message_date_ = steadyNow();
+  if (is_running_ && get_subscription_count() > 0 && !is_overheating_ && sonarParameters()->ping_rate != pingRateStandby) {
     RCLCPP_INFO(this->get_logger(), "Exiting standby mode");
-    enableRunMode();
-  }
-}
-
-void OculusSonarNode::updateLocalParameters(SonarParameters& parameters, const std::vector<rclcpp::Parameter>& new_parameters) {
-  for (const rclcpp::Parameter& new_param : new_parameters) {
-    if (new_param.get_name() == params::FREQUENCY_MODE.name) {
-      parameters.frequency_mode = new_param.as_int();
-    } else if (new_param.get_name() == params::PING_RATE.name) {
-      parameters.ping_rate = new_param.as_int();
-    } else if (new_param.get_name() == params::NBEAMS.name) {
-      parameters.nbeams = new_param.as_int();
-    } else if (new_param.get_name() == params::GAIN_ASSIT.name) {
-      parameters.gain_assist = new_param.as_bool();
-    } else if (new_param.get_name() == params::RANGE.name) {
-      parameters.range = new_param.as_double();
-    } else if (new_param.get_name() == params::GAMMA_CORRECTION.name) {
-      parameters.gamma_correction = new_param.as_int();
-    } else if (new_param.get_name() == params::GAIN_PERCENT.name) {
-      parameters.gain_percent = new_param.as_double();
-    } else if (new_param.get_name() == params::SOUND_SPEED.name) {
-      parameters.sound_speed = new_param.as_double();
-    } else if (new_param.get_name() == params::USE_SALINITY.name) {
-      parameters.use_salinity = new_param.as_bool();
-    } else if (new_param.get_name() == params::SALINITY.name) {
-      parameters.salinity = new_param.as_double();
-    } else if (!(new_param.get_name() == "run")) {
-      RCLCPP_WARN_STREAM(get_logger(), "Wrong parameter to set : new_param = " << new_param << ". Not seted");
-    }
+    requestRunMode(RunModeRequest::RESUME);
   }
 }
 
-void OculusSonarNode::updateLocalParameters(SonarParameters& parameters, SonarDriver::PingConfig feedback) {
-  std::vector<rclcpp::Parameter> new_parameters;
-  // OculusMessageHeader head;      // The standard message header
-  // uint16_t oculusId;          // Fixed ID 0x4f53
-  // uint16_t srcDeviceId;       // The device id of the source
-  // uint16_t dstDeviceId;       // The device id of the destination
-  // uint16_t msgId;             // Message identifier
-  // uint16_t msgVersion;
-  // uint32_t payloadSize;       // The size of the message payload (header not included)
-  // uint16_t spare2;
-  // uint8_t masterMode;            // mode 0 is flexi mode, needs full fire message (not available for third party developers)
-  //                                // mode 1 - Low Frequency Mode (wide aperture, navigation)
-  //                                // mode 2 - High Frequency Mode (narrow aperture, target identification)
-  // uint8_t pingRate;              // Sets the maximum ping rate. was PingRateType
-  // uint8_t networkSpeed;          // Used to reduce the network comms speed (useful for high latency shared links)
-  // uint8_t gammaCorrection;       // 0 and 0xff = gamma correction = 1.0
-  //                                // Set to 127 for gamma correction = 0.5
-  // uint8_t flags;                 // bit 0: 0 = interpret range as percent, 1 = interpret range as meters
-  //                                // bit 1: 0 = 8 bit data, 1 = 16 bit data  // inverted ?
-  //                                // bit 2: 0 = won't send gain, 1 = send gain
-  //                                // bit 3: 0 = send full return message, 1 = send simple return message
-  //                                // bit 4: gain assist ? TODO
-  //                                // bit 5: ? TODO
-  //                                // bit 6: enable 512 beams
-  //                                // bit 7: ? TODO
-  // double range;                  // The range demand in percent or m depending on flags
-  // double gainPercent;            // The gain demand
-  // double speedOfSound;           // ms-1, if set to zero then internal calc will apply using salinity
-  // double salinity;               // ppt, set to zero if we are in fresh water
-
-  checkMinimalFlags(feedback.flags);
-
-  new_parameters.push_back(rclcpp::Parameter(params::FREQUENCY_MODE.name, feedback.masterMode));
-  new_parameters.push_back(rclcpp::Parameter(params::PING_RATE.name, feedback.pingRate));
-  new_parameters.push_back(rclcpp::Parameter(params::NBEAMS.name, static_cast<int>(feedback.flags & flagByte::NBEAMS)));
-  new_parameters.push_back(rclcpp::Parameter(params::GAIN_ASSIT.name, static_cast<bool>(feedback.flags & flagByte::GAIN_ASSIST)));
-  new_parameters.push_back(rclcpp::Parameter(params::RANGE.name, feedback.range));
-  new_parameters.push_back(rclcpp::Parameter(params::GAMMA_CORRECTION.name, feedback.gammaCorrection));
-  new_parameters.push_back(rclcpp::Parameter(params::GAIN_PERCENT.name, feedback.gainPercent));
-  new_parameters.push_back(rclcpp::Parameter(params::SOUND_SPEED.name, feedback.speedOfSound));
-  //  // use_salinity  // TODO(hugoyvrn)
-  // {
-  //     rclcpp::Parameter param(params::USE_SALINITY.name, );
-  //     new_parameters.push_back(param);
-  // }
-
-  new_parameters.push_back(rclcpp::Parameter(params::SALINITY.name, feedback.salinity));
-  updateLocalParameters(parameters, new_parameters);
-}
-
-void OculusSonarNode::sendParamToSonar(rclcpp::Parameter param, rcl_interfaces::msg::SetParametersResult result) {
-  SonarDriver::PingConfig newConfig = currentConfig_;  // To avoid to create a new SonarDriver::PingConfig from ros parameters
-  if (param.get_name() == params::FREQUENCY_MODE.name) {
-    RCLCPP_INFO_STREAM(this->get_logger(), "Updating frequency_mode to " << param.as_int() << " (1: LowFreq, 2: HighFreq).");
-    newConfig.masterMode = param.as_int();
-  } else if (param.get_name() == params::PING_RATE.name) {
-    RCLCPP_INFO_STREAM(this->get_logger(), "Updating ping_rate to " << param.as_int() << " (" + params::PING_RATE.desc + ").");
-    newConfig.pingRate = param.as_int();
-  } else if (param.get_name() == params::NBEAMS.name) {
-    RCLCPP_INFO_STREAM(this->get_logger(), "Updating nbeams to " << param.as_int() << " (0: 256 beams, 1: 512 beams).");
-    if (param.as_int() == 0) {
-      newConfig.flags &= ~flagByte::NBEAMS;  // 256 beams
-    } else {
-      newConfig.flags |= flagByte::NBEAMS;  // 512 beams
-    }
-  } else if (param.get_name() == params::GAIN_ASSIT.name) {
-    RCLCPP_INFO_STREAM(this->get_logger(), "Updating gain_assist to " << param.as_bool());
-    if (param.as_bool()) {
-      newConfig.flags |= flagByte::GAIN_ASSIST;
-    } else {
-      newConfig.flags &= ~flagByte::GAIN_ASSIST;
-    }
-  } else if (param.get_name() == params::RANGE.name) {
-    RCLCPP_INFO_STREAM(this->get_logger(), "Updating range to " << param.as_double() << "m.");
-    newConfig.range = param.as_double();
-  } else if (param.get_name() == params::GAMMA_CORRECTION.name) {
-    RCLCPP_INFO_STREAM(this->get_logger(), "Updating gamma_correction to " << param.as_int());
-    newConfig.gammaCorrection = param.as_int();
-  } else if (param.get_name() == params::GAIN_PERCENT.name) {
-    RCLCPP_INFO_STREAM(this->get_logger(), "Updating gain_percent to " << param.as_double() << "%.");
-    newConfig.gainPercent = param.as_double();
-  } else if (param.get_name() == params::USE_SALINITY.name) {
-    RCLCPP_INFO_STREAM(this->get_logger(), "Updating use_salinity to " << param.as_bool());
-    if (param.as_bool())
-      newConfig.speedOfSound = 0.0;
-  } else if (param.get_name() == params::SOUND_SPEED.name) {
-    RCLCPP_INFO_STREAM(this->get_logger(), "Updating sound_speed to " << param.as_double() << " m/s.");
-    if (!currentRosParameters_.use_salinity) {
-      if (param.as_double() >= 1400.0 &&
-          param.as_double() <= 1600.0)  // TODO(hugoyvrn, why is there a range verification here and not for other parameters?)
-        newConfig.speedOfSound = param.as_double();
-      else
-        RCLCPP_INFO_STREAM(this->get_logger(), "Speed of sound must be between 1400.0 and 1600.0.");
-    }
-  } else if (param.get_name() == params::SALINITY.name) {
-    RCLCPP_INFO_STREAM(this->get_logger(), "Updating salinity to " << param.as_double() << " parts per thousand (ppt,ppm,g/kg).");
-    newConfig.salinity = param.as_double();
+// Applies the parameters to ros_parameters_, the sonar ones are queued unless they are set from the sonar values
+void OculusSonarNode::setRosParameters(const std::vector<rclcpp::Parameter>& parameters) {
+  for (const rclcpp::Parameter& param : ros_parameters_.set(parameters)) {
+    RCLCPP_WARN_STREAM(get_logger(), "Wrong parameter to set : new_param = " << param << ". Not seted");
   }
+}
 
-  setMinimalFlags(newConfig.flags);
-
-  // send config to Oculus sonar and wait for feedback
-  SonarDriver::PingConfig feedback = this->sonar_driver_->request_ping_config(newConfig);
-  currentConfig_ = feedback;
-
-  updateLocalParameters(currentSonarParameters_, feedback);
+void OculusSonarNode::requestConfig(std::vector<rclcpp::Parameter> parameters) {
+  auto request = std::make_unique<ConfigRequest>();
+  request->parameters = std::move(parameters);
+  request->config = configFromParameters(ros_parameters_.parameters());
+  if (request->parameters.empty()) {
+    RCLCPP_INFO(this->get_logger(), "Sending the configuration to the sonar.");
+  } else {
+    std::ostringstream names;
+    for (const rclcpp::Parameter& param : request->parameters) {
+      names << " " << param.get_name() << "=" << param.value_to_string();
+    }
+    RCLCPP_INFO_STREAM(this->get_logger(), "Updating" << names.str() << ".");
+  }
+  request->feedback = std::async(std::launch::async, [this, config = request->config] {
+    const auto start = std::chrono::steady_clock::now();
+    const SonarDriver::PingConfig feedback = sonar_driver_->request_ping_config(config);
+    return std::make_pair(feedback, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  });
+  config_request_ = std::move(request);
+}
 
-  checkMinimalFlags(feedback.flags);
+void OculusSonarNode::sendQueuedParameters() {
+  if (!config_request_ && ros_parameters_.hasQueued() && connection_state_ == ConnectionState::STREAMING) {
+    requestConfig(ros_parameters_.takeQueued());
+  }
+}
 
-  handleFeedbackForParam<double>(result, param, newConfig.masterMode, feedback.masterMode, params::FREQUENCY_MODE.name);
-  // newConfig.pingRate      != feedback.pingRate  // is broken (?) sonar side TODO(???)
-  handleFeedbackForParam<bool>(result, param, (newConfig.flags & flagByte::GAIN_ASSIST) ? 1 : 0,
-      (feedback.flags & flagByte::GAIN_ASSIST) ? 1 : 0, params::GAIN_ASSIT.name);
-  handleFeedbackForParam<int>(result, param, (newConfig.flags & flagByte::NBEAMS) ? 1 : 0,
-      (feedback.flags & flagByte::NBEAMS) ? 1 : 0, params::NBEAMS.name);
-  handleFeedbackForParam<double>(result, param, newConfig.range, feedback.range, params::RANGE.name);
-  handleFeedbackForParam<int>(result, param, newConfig.gammaCorrection, feedback.gammaCorrection, params::GAMMA_CORRECTION.name);
-  handleFeedbackForParam<double>(result, param, newConfig.gainPercent, feedback.gainPercent, params::GAIN_PERCENT.name);
-  handleFeedbackForParam<double>(result, param, newConfig.speedOfSound, feedback.speedOfSound, params::SOUND_SPEED.name);
-  handleFeedbackForParam<double>(result, param, newConfig.salinity, feedback.salinity, params::SALINITY.name);
+// Returns true if a request has been answered
+bool OculusSonarNode::handleConfigFeedback() {
+  if (!config_request_ || config_request_->feedback.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+    return false;
+  }
+  std::pair<SonarDriver::PingConfig, double> feedback;
+  try {
+    feedback = config_request_->feedback.get();
+  } catch (const std::exception& e) {
+    // Failures of the driver are rethrown here, on the executor: the configuration is sent again on reconnection
+    RCLCPP_ERROR_STREAM(this->get_logger(), "Sonar configuration request failed: " << e.what());
+    config_request_.reset();
+    setConnectionState(ConnectionState::CONNECTING);
+    return false;
+  }
+  last_round_trip_ = feedback.second;
+  max_round_trip_ = std::max(max_round_trip_, feedback.second);
+  RCLCPP_INFO_STREAM(this->get_logger(), "Sonar configuration answered in " << 1000. * feedback.second << " ms.");
+
+  currentConfig_ = feedback.first;
+  const SonarParameters sonar_parameters = sonar_config::fromConfig(feedback.first, *sonarParameters());
+  setSonarParameters(sonar_parameters);
+  checkMinimalFlags(feedback.first.flags);
+  reconcileFeedback(*config_request_, feedback.first);
+  if (feedback.first.pingRate == pingRateStandby && is_running_) {
+    is_running_ = false;  // Will request disableRunMode() next ping callback
+  }
+  config_request_.reset();
 
-  if (feedback.pingRate == pingRateStandby && is_running_) {
-    is_running_ = false;  // Will do disableRunMode() next ping callback
+  // The pings already received were fired with the previous configuration
+  ping_echo_.valid = false;
+  last_echo_date_ = steadyNow();
+  if (!ros_parameters_.hasQueued()) {  // Otherwise the ROS parameters are newer than the sonar ones
+    updateRosConfig(sonar_parameters);
   }
+  return true;
 }
 
-rcl_interfaces::msg::SetParametersResult OculusSonarNode::setConfigCallback(const std::vector<rclcpp::Parameter>& parameters) {
-  std::shared_lock l(param_mutex_);
-
-  if (parameters.size() != 1) {
-    RCLCPP_WARN(get_logger(), "You should set parameters one by one.");
-    RCLCPP_INFO_STREAM(get_logger(), "parameters = " << parameters);
-    rcl_interfaces::msg::SetParametersResult result;
-    result.successful = false;
-    result.reason = "Parameters should be set one by one";
-    return result;
+// Reports the requested values the sonar did not apply, the ROS parameters then follow the sonar ones (updateRosConfig)
+void OculusSonarNode::reconcileFeedback(const ConfigRequest& request, const SonarDriver::PingConfig& feedback) {
+  std::ostringstream names;
+  for (const rclcpp::Parameter& param : request.parameters) {
+    names << " " << param.get_name();
+  }
+  bool successful = true;
+  std::string reason;
+  for (const sonar_config::Mismatch& mismatch : sonar_config::compareFeedback(request.parameters, request.config, feedback)) {
+    if (mismatch.changed) {
+      successful = false;
+      RCLCPP_WARN_STREAM(this->get_logger(), "Could not update " << mismatch.name);
+      reason.append("Could not update " + mismatch.name + ".\n");
+    } else {
+      RCLCPP_WARN_STREAM(this->get_logger(), mismatch.name << " change from " << mismatch.requested << " to " << mismatch.applied
+                                                           << " when updating the parameters" << names.str());
+      reason.append(mismatch.name + " change.\n");
+    }
+  }
+  if (!successful) {
+    RCLCPP_WARN_STREAM(this->get_logger(), "The sonar did not apply the whole configuration:\n" << reason);
   }
+}
 
+rcl_interfaces::msg::SetParametersResult OculusSonarNode::setConfigCallback(const std::vector<rclcpp::Parameter>& parameters) {
   rcl_interfaces::msg::SetParametersResult result;
   result.successful = true;
   result.reason = "";
+  if (ros_parameters_.applyingSonarValues()) {  // Set by updateRosConfig, already applied by the sonar
+    setRosParameters(parameters);
+    return result;
+  }
+
+  const std::shared_ptr<const SonarParameters> current = sonarParameters();
 
   for (const rclcpp::Parameter& param : parameters) {
     if (param.get_name() == "run") {
       if (!is_running_ || param.as_bool()) {
-        if (get_subscription_count() == 0 || is_overheating_ || currentSonarParameters_.ping_rate == pingRateStandby) {
+        if (get_subscription_count() == 0 || is_overheating_ || current->ping_rate == pingRateStandby) {
           result.successful = false;
           result.reason = "The condition to go in run mode are not meeted.";
           if (get_subscription_count() == 0) {
@@ -459,37 +662,167 @@ rcl_interfaces::msg::SetParametersResult OculusSonarNode::setConfigCallback(cons
                 " Make sur the sonar is underwatter. Security limit set at " +
                 std::to_string(temperature_stop_limit_) + "°C";
           }
-          if (currentSonarParameters_.ping_rate == pingRateStandby) {
+          if (current->ping_rate == pingRateStandby) {
             result.reason += " ping_rate mode is seted to " + std::to_string(pingRateStandby) + ".";
           }
           return result;
         }
       }
       is_running_ = param.as_bool();
+      run_mode_request_ = RunModeRequest::NONE;  // Requested before this change
 
-    } else if (std::find(dynamic_parameters_names_.begin(), dynamic_parameters_names_.end(), param.get_name()) !=
-               dynamic_parameters_names_.end()) {
+    } else if (param.get_name() == params::FREQUENCY_MODE.name) {
       // QUICK FIX TODO(hugoyvrn, gain_assist not working, to fix)
-      if (currentSonarParameters_.gain_assist && currentSonarParameters_.frequency_mode &&
-          param.get_name() == params::FREQUENCY_MODE.name) {
+      if (current->gain_assist && current->frequency_mode) {
+        result.successful = false;
         result.reason = "You must set gain_assist to false before changing frequency TODO(to fix).";
         return result;
       }
       // END QUICK FIX
-      sendParamToSonar(param, result);
     }
   }
 
   if (result.successful) {  // If the parameters will be updated to ros
-    updateLocalParameters(currentRosParameters_, parameters);
+    // Merged with the changes not sent yet (request in flight or sonar not connected), sent in a single config
+    setRosParameters(parameters);
+    sendQueuedParameters();
   }
 
   return result;
 }
 
-int main(int argc, char* argv[]) {
-  rclcpp::init(argc, argv);
-  rclcpp::spin(std::make_shared<OculusSonarNode>());  // force to monothread
-  rclcpp::shutdown();
-  return 0;
+int64_t OculusSonarNode::steadyNow() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
 }
+
+void OculusSonarNode::updateConnectionState() {
+  const int64_t now = steadyNow();
+  const int64_t timeout = static_cast<int64_t>(connection_timeout_ * 1e9);
+  const bool connected = this->sonar_driver_->connected();
+
+  handleConfigFeedback();
+  applyRunModeRequest();
+
+  switch (connection_state_.load()) {
+    case ConnectionState::DISCOVERING:
+      if (last_status_date_ > 0) {
+        setConnectionState(ConnectionState::CONNECTING);
+      }
+      break;
+    case ConnectionState::CONNECTING:
+      if (connected && !config_request_) {
+        // The ROS parameters are applied at once, also after a reconnection since the sonar may have been power cycled
+        setConnectionState(ConnectionState::CONFIGURING);
+        ros_parameters_.clearQueued();  // Already part of the whole config
+        requestConfig({});
+      }
+      break;
+    case ConnectionState::CONFIGURING:
+      if (!config_request_) {
+        last_message_date_ = now;
+        setConnectionState(connected ? ConnectionState::STREAMING : ConnectionState::LOST);
+        sendQueuedParameters();  // Changed while configuring
+      }
+      break;
+    case ConnectionState::STREAMING:
+      if (!connected || now - last_message_date_ > timeout) {
+        setConnectionState(ConnectionState::LOST);
+      } else {
+        sendQueuedParameters();
+        if (!config_request_) {  // During a request the pings may still use the previous configuration
+          applyPingEcho(now);
+        }
+      }
+      break;
+    case ConnectionState::LOST:
+      setConnectionState(now - last_status_date_ < timeout ? ConnectionState::CONNECTING : ConnectionState::DISCOVERING);
+      break;
+  }
+
+  if (now - last_diagnostics_date_ >= 1000000000) {
+    publishDiagnostics();
+  }
+}
+
+void OculusSonarNode::setConnectionState(ConnectionState state) {
+  const ConnectionState previous = connection_state_.exchange(state);
+  state_date_ = steadyNow();
+  if (state == ConnectionState::LOST) {
+    ++connection_losses_;
+    connection_start_date_ = state_date_.load();
+    waiting_first_ping_ = true;
+    time_to_first_ping_ = -1.;
+    RCLCPP_WARN_STREAM(this->get_logger(), "Connection to the sonar lost (" << toString(previous) << ").");
+  } else {
+    RCLCPP_INFO_STREAM(this->get_logger(), "Sonar connection: " << toString(previous) << " -> " << toString(state));
+  }
+  publishDiagnostics();
+}
+
+void OculusSonarNode::publishDiagnostics() {
+  diagnostic_msgs::msg::DiagnosticStatus status;
+  status.name = std::string(this->get_name()) + ": connection";
+  status.hardware_id = "oculus";
+  const ConnectionState state = connection_state_;
+  switch (state) {
+    case ConnectionState::STREAMING:
+      status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+      break;
+    case ConnectionState::LOST:
+      status.level = diagnostic_msgs::msg::DiagnosticStatus::ERROR;
+      break;
+    default:
+      status.level = diagnostic_msgs::msg::DiagnosticStatus::WARN;
+      break;
+  }
+  status.message = toString(state);
+
+  auto keyValue = [](const std::string& key, const std::string& value) {
+    diagnostic_msgs::msg::KeyValue key_value;
+    key_value.key = key;
+    key_value.value = value;
+    return key_value;
+  };
+  status.values.push_back(keyValue("state", toString(state)));
+  status.values.push_back(keyValue("time in state (s)", std::to_string((steadyNow() - state_date_) * 1e-9)));
+  const double time_to_first_ping = time_to_first_ping_;
+  status.values.push_back(
+      keyValue("time to first ping (s)", time_to_first_ping < 0. ? "waiting" : std::to_string(time_to_first_ping)));
+  status.values.push_back(keyValue("connection losses", std::to_string(connection_losses_)));
+  status.values.push_back(
+      keyValue("config round trip (ms)", last_round_trip_ < 0. ? "none" : std::to_string(1000. * last_round_trip_)));
+  status.values.push_back(keyValue("max config round trip (ms)", std::to_string(1000. * max_round_trip_)));
+  status.values.push_back(keyValue("sonar clock drift (ppm)", std::to_string(1e6 * clock_drift_.load())));
+  status.values.push_back(keyValue("sonar clock resets", std::to_string(clock_resets_.load())));
+  status.values.push_back(keyValue("temporal filter resets", std::to_string(temporal_filter_resets_.load())));
+
+  diagnostic_msgs::msg::DiagnosticArray array;
+  array.header.stamp = this->now();
+  array.status.push_back(status);
+
+  if (this->pipeline_stats_) {
+    diagnostic_msgs::msg::DiagnosticStatus pipeline;
+    pipeline.name = std::string(this->get_name()) + ": pipeline";
+    pipeline.hardware_id = "oculus";
+    pipeline.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+    pipeline.message = "ping pipeline statistics";
+    pipeline.values.push_back(keyValue("dropped pings (ping queue)", std::to_string(this->ping_queue_.dropped())));
+    for (const std::pair<std::string, std::string>& value : this->pipeline_stats_->report()) {
+      pipeline.values.push_back(keyValue(value.first, value.second));
+    }
+    array.status.push_back(pipeline);
+  }
+  this->diagnostics_publisher_->publish(array);
+  last_diagnostics_date_ = steadyNow();
+}
+
+// Full sonar configuration from the ROS parameters
+SonarDriver::PingConfig OculusSonarNode::configFromParameters(const SonarParameters& parameters) const {
+  SonarDriver::PingConfig config = sonar_config::toConfig(parameters, currentConfig_);
+  setMinimalFlags(config.flags);
+  return config;
+}
+
+#include <rclcpp_components/register_node_macro.hpp>
+
+RCLCPP_COMPONENTS_REGISTER_NODE(OculusSonarNode)
@@ -0,0 +1,345 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Converts a .oculus file to a rosbag2 (mcap storage, compressed chunks). Pings are converted and serialized by a pool
+// of workers and written in the order of the file.
+//
+// Usage: oculus_to_rosbag <file.oculus> <destination folder> [options], see --help.
+
+#define BOOST_BIND_GLOBAL_PLACEHOLDERS
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <oculus_interfaces/msg/ping.hpp>
+#include <oculus_ros2/conversions.hpp>
+#include <oculus_ros2/oculus_file_reader.hpp>
+#include <oculus_ros2/sonar_clock.hpp>
+#include <oculus_ros2/sonar_viewer.hpp>
+#include <rclcpp/rclcpp.hpp>
+#include <rclcpp/serialization.hpp>
+#include <rosbag2_cpp/writer.hpp>
+#include <rosbag2_storage/storage_options.hpp>
+#include <rosbag2_storage/topic_metadata.hpp>
+#include <sensor_msgs/msg/image.hpp>
+
+namespace {
+
+struct Options {
+  std::string filename;
+  std::string destination;
+  std::string topic_name = "/sonar/oculus";
+  std::string image_topic_name;  // The fan image is not written if empty
+  std::string frame_id = "sonar";
+  std::string storage_id = "mcap";
+  std::string storage_preset = "zstd_fast";  // mcap chunk compression: zstd_fast, zstd_small, fastwrite (none)
+  double seconds_offset = 0.;
+  unsigned int jobs = std::max(1u, std::thread::hardware_concurrency());
+};
+
+void printUsage() {
+  std::printf(
+      "Usage: oculus_to_rosbag <file.oculus> <destination folder> [options]\n"
+      "  --topicname NAME       Ping topic (default /sonar/oculus)\n"
+      "  --imagetopic NAME      Also write the fan image on this topic\n"
+      "  --frameid ID           Frame of the messages (default sonar)\n"
+      "  --secondsoffset S      Time offset added to the recording dates (default 0)\n"
+      "  --storage ID           rosbag2 storage plugin (default mcap)\n"
+      "  --preset PROFILE       Storage preset, zstd_fast, zstd_small or fastwrite for mcap (default zstd_fast)\n"
+      "  --jobs N               Number of serialization workers (default: number of cores)\n");
+}
+
+bool parseArguments(const std::vector<std::string>& args, Options& options) {
+  std::vector<std::string> positional;
+  for (std::size_t i = 1; i < args.size(); ++i) {
+    const std::string& arg = args[i];
+    if (arg == "-h" || arg == "--help") {
+      return false;
+    }
+    if (arg.rfind("--", 0) != 0) {
+      positional.push_back(arg);
+      continue;
+    }
+    if (i + 1 >= args.size()) {
+      std::fprintf(stderr, "Missing value for %s\n", arg.c_str());
+      return false;
+    }
+    const std::string& value = args[++i];
+    if (arg == "--topicname") {
+      options.topic_name = value;
+    } else if (arg == "--imagetopic") {
+      options.image_topic_name = value;
+    } else if (arg == "--frameid") {
+      options.frame_id = value;
+    } else if (arg == "--secondsoffset") {
+      options.seconds_offset = std::stod(value);
+    } else if (arg == "--storage") {
+      options.storage_id = value;
+    } else if (arg == "--preset") {
+      options.storage_preset = value;
+    } else if (arg == "--jobs") {
+      options.jobs = static_cast<unsigned int>(std::max(1, std::stoi(value)));
+    } else {
+      std::fprintf(stderr, "Unknown option %s\n", arg.c_str());
+      return false;
+    }
+  }
+  if (positional.size() != 2) {
+    return false;
+  }
+  options.filename = positional[0];
+  options.destination = positional[1];
+  return true;
+}
+
+// Serialized messages of one recorded message, slot of the reorder window between the workers and the writer.
+struct ConvertedPing {
+  enum class State { FREE, CONVERTING, READY } state = State::FREE;
+  bool is_ping = false;  // false for the other sonar messages (status...), which are not written
+  int64_t stamp = 0;  // nanoseconds
+  std::shared_ptr<rclcpp::SerializedMessage> ping;
+  std::shared_ptr<rclcpp::SerializedMessage> image;
+};
+
+// Workers convert the messages of the file in parallel, the writer takes them back in the order of the file. Message i
+// goes to slot i % window: a worker waits for the writer to free its slot, so at most window messages are in flight.
+class ConversionPipeline {
+public:
+  ConversionPipeline(const oculus::OculusFileReader& reader,
+      const Options& options,
+      const std::vector<uint64_t>& firing_dates,
+      const SonarViewer* viewer)
+    : reader_(reader), options_(options), firing_dates_(firing_dates), viewer_(viewer), slots_(4 * options.jobs) {
+    for (unsigned int i = 0; i < options.jobs; ++i) {
+      workers_.emplace_back(&ConversionPipeline::work, this);
+    }
+  }
+
+  ~ConversionPipeline() {
+    {
+      std::lock_guard<std::mutex> l(mutex_);
+      stop_ = true;
+    }
+    slot_freed_.notify_all();
+    for (std::thread& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  // Blocks until message i is converted, then hands it over to write and frees its slot
+  template <class Write>
+  void take(std::size_t i, Write&& write) {
+    ConvertedPing& slot = slots_[i % slots_.size()];
+    {
+      std::unique_lock<std::mutex> l(mutex_);
+      slot_ready_.wait(l, [&] { return slot.state == ConvertedPing::State::READY; });
+    }
+    write(slot);  // The slot belongs to the writer until it is freed
+    {
+      std::lock_guard<std::mutex> l(mutex_);
+      slot.ping.reset();
+      slot.image.reset();
+      slot.state = ConvertedPing::State::FREE;
+      ++written_;
+    }
+    slot_freed_.notify_all();
+  }
+
+private:
+  const oculus::OculusFileReader& reader_;
+  const Options& options_;
+  const std::vector<uint64_t>& firing_dates_;  // Unwrapped firing date of each message
+  const SonarViewer* viewer_;
+  std::vector<ConvertedPing> slots_;
+  std::vector<std::thread> workers_;
+  std::atomic<std::size_t> next_{0};
+  std::size_t written_ = 0;
+  bool stop_ = false;
+  std::mutex mutex_;
+  std::condition_variable slot_ready_;
+  std::condition_variable slot_freed_;
+
+  void work() {
+    const rclcpp::Serialization<oculus_interfaces::msg::Ping> ping_serialization;
+    const rclcpp::Serialization<sensor_msgs::msg::Image> image_serialization;
+    oculus_interfaces::msg::Ping msg;  // Buffers reused from one ping to the other
+    sensor_msgs::msg::Image image;
+
+    for (std::size_t i = next_++; i < reader_.size(); i = next_++) {
+      ConvertedPing& slot = slots_[i % slots_.size()];
+      {
+        std::unique_lock<std::mutex> l(mutex_);
+        slot_freed_.wait(l, [&] { return stop_ || (i < written_ + slots_.size() && slot.state == ConvertedPing::State::FREE); });
+        if (stop_) {
+          return;
+        }
+        slot.state = ConvertedPing::State::CONVERTING;
+      }
+
+      const oculus::RecordedMessageView message = reader_.message(i);
+      slot.stamp = static_cast<int64_t>((message.time + options_.seconds_offset) * 1e9);
+      slot.is_ping = oculus::toMsg(msg, message.data, message.size, rclcpp::Time(slot.stamp));
+      if (slot.is_ping) {
+        msg.header.frame_id = options_.frame_id;
+        msg.ping_firing_date_unwrapped = firing_dates_[i];
+        slot.ping = std::make_shared<rclcpp::SerializedMessage>();
+        ping_serialization.serialize_message(&msg, slot.ping.get());
+        if (viewer_ && viewer_->renderFan(msg, image)) {
+          slot.image = std::make_shared<rclcpp::SerializedMessage>();
+          image_serialization.serialize_message(&image, slot.image.get());
+        }
+      }
+
+      {
+        std::lock_guard<std::mutex> l(mutex_);
+        slot.state = ConvertedPing::State::READY;
+      }
+      slot_ready_.notify_all();
+    }
+  }
+};
+
+rosbag2_storage::TopicMetadata topic(const std::string& name, const std::string& type) {
+  rosbag2_storage::TopicMetadata metadata;
+  metadata.name = name;
+  metadata.type = type;
+  metadata.serialization_format = "cdr";
+  return metadata;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  rclcpp::init(argc, argv);
+  const std::vector<std::string> args = rclcpp::remove_ros_arguments(argc, argv);
+  Options options;
+  if (!parseArguments(args, options)) {
+    printUsage();
+    rclcpp::shutdown();
+    return 1;
+  }
+
+  std::unique_ptr<oculus::OculusFileReader> reader;
+  try {
+    reader = std::make_unique<oculus::OculusFileReader>(options.filename);
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "[oculus_to_bag] %s\n", e.what());
+    rclcpp::shutdown();
+    return 1;
+  }
+
+  // Same naming as scripts/oculus_to_rosbag.py: <destination>/<file name without .oculus>
+  std::string name = options.filename.substr(options.filename.find_last_of('/') + 1);
+  if (name.size() > 7 && name.compare(name.size() - 7, 7, ".oculus") == 0) {
+    name.resize(name.size() - 7);
+  }
+  const std::string output_path = options.destination + "/" + name;
+
+  rosbag2_storage::StorageOptions storage_options;
+  storage_options.uri = output_path;
+  storage_options.storage_id = options.storage_id;
+  storage_options.storage_preset_profile = options.storage_preset;
+  rosbag2_cpp::Writer writer;
+  writer.open(storage_options, rosbag2_cpp::ConverterOptions{"cdr", "cdr"});
+  writer.create_topic(topic(options.topic_name, "oculus_interfaces/msg/Ping"));
+
+  // The fan image is rendered by a SonarViewer, whose node is only used for its logger and parameters
+  std::shared_ptr<rclcpp::Node> node;
+  std::unique_ptr<SonarViewer> viewer;
+  if (!options.image_topic_name.empty()) {
+    node = std::make_shared<rclcpp::Node>("oculus_to_rosbag");
+    viewer = std::make_unique<SonarViewer>(node.get());
+    writer.create_topic(topic(options.image_topic_name, "sensor_msgs/msg/Image"));
+  }
+
+  std::printf("[oculus_to_bag] Parsing %s to %s with %u workers (%s, %s).\n", options.filename.c_str(), output_path.c_str(),
+      options.jobs, options.storage_id.c_str(), options.storage_preset.c_str());
+
+  // The firing dates are unwrapped in the order of the file, before the parallel conversion
+  std::vector<uint64_t> firing_dates(reader->size(), 0);
+  {
+    SonarClock sonar_clock;
+    for (std::size_t i = 0; i < reader->size(); ++i) {
+      const oculus::RecordedMessageView message = reader->message(i);
+      uint32_t firing_date;
+      if (oculus::pingFiringDate(message.data, message.size, firing_date)) {
+        firing_dates[i] = sonar_clock.update(firing_date, static_cast<int64_t>(message.time * 1e9));
+      }
+    }
+  }
+
+  using Clock = std::chrono::steady_clock;
+  const Clock::time_point start = Clock::now();
+  Clock::time_point last_report = start;
+  std::size_t pings = 0;
+  std::size_t read_bytes = 0;
+  {
+    ConversionPipeline pipeline(*reader, options, firing_dates, viewer.get());
+    for (std::size_t i = 0; i < reader->size(); ++i) {
+      pipeline.take(i, [&](ConvertedPing& converted) {
+        read_bytes += reader->message(i).size;
+        if (!converted.is_ping) {
+          return;
+        }
+        const rclcpp::Time stamp(converted.stamp);
+        writer.write(converted.ping, options.topic_name, "oculus_interfaces/msg/Ping", stamp);
+        if (converted.image) {
+          writer.write(converted.image, options.image_topic_name, "sensor_msgs/msg/Image", stamp);
+        }
+        ++pings;
+      });
+
+      if (Clock::now() - last_report > std::chrono::seconds(1)) {
+        last_report = Clock::now();
+        std::printf("[oculus_to_bag] %zu pings have been parsed in %.2f seconds.\r", pings,
+            std::chrono::duration<double>(last_report - start).count());
+        std::fflush(stdout);
+      }
+    }
+  }
+  writer.close();
+
+  const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  std::printf("\n[oculus_to_bag] File parsing is done: %zu pings in %.2f seconds (%.0f pings/s, %.1f MB/s).\n", pings,
+      elapsed, pings / elapsed, read_bytes / elapsed / 1e6);
+
+  rclcpp::shutdown();
+  return 0;
+}
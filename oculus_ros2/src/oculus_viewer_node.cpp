@@ -34,22 +34,49 @@
 
 #include <oculus_ros2/oculus_viewer_node.hpp>
 
+#include <stdexcept>
+#include <string>
+
 using SonarDriver = oculus::SonarDriver;
 
-OculusViewerNode::OculusViewerNode() : Node("oculus_viewer"), sonar_viewer_(static_cast<rclcpp::Node*>(this)) {
+OculusViewerNode::OculusViewerNode(const rclcpp::NodeOptions& options)
+  : Node("oculus_viewer", options), sonar_viewer_(static_cast<rclcpp::Node*>(this)) {
+  rcl_interfaces::msg::ParameterDescriptor transport_desc;
+  transport_desc.description =
+      "Topic of the rendered pings.\n"
+      "\traw: ping.\n"
+      "\tcompressed: ping/compressed, decoded by the node.";
+  const std::string transport = this->declare_parameter<std::string>("transport", "raw", transport_desc);
+  if (transport == "compressed") {
+    compressed_ping_subscription_ = this->create_subscription<oculus_interfaces::msg::CompressedPing>(
+        "ping/compressed", 10, std::bind(&OculusViewerNode::compressedPingCallback, this, std::placeholders::_1));
+    return;
+  }
+  if (transport != "raw") {
+    RCLCPP_WARN_STREAM(this->get_logger(), "Unknown transport " << transport << " (raw or compressed), using raw.");
+  }
   ping_subscription_ = this->create_subscription<oculus_interfaces::msg::Ping>(
       "ping", 10, std::bind(&OculusViewerNode::pingCallback, this, std::placeholders::_1));
 }
 
 OculusViewerNode::~OculusViewerNode() {}
 
-void OculusViewerNode::pingCallback(const oculus_interfaces::msg::Ping& ping_msg) const {
-  sonar_viewer_.publishFan(ping_msg);
+// Taking the shared pointer lets intra-process communication hand over the driver message without a copy
+void OculusViewerNode::pingCallback(const oculus_interfaces::msg::Ping::ConstSharedPtr& ping_msg) const {
+  sonar_viewer_.publishFan(*ping_msg);
 }
 
-int main(int argc, char* argv[]) {
-  rclcpp::init(argc, argv);
-  rclcpp::spin(std::make_shared<OculusViewerNode>());
-  rclcpp::shutdown();
-  return 0;
+void OculusViewerNode::compressedPingCallback(
+    const oculus_interfaces::msg::CompressedPing::ConstSharedPtr& compressed_ping_msg) {
+  try {
+    ping_decoder_.decode(*compressed_ping_msg, decoded_ping_);
+  } catch (const std::runtime_error& e) {
+    RCLCPP_WARN_STREAM_THROTTLE(this->get_logger(), *this->get_clock(), 5000, "Dropped compressed ping: " << e.what());
+    return;
+  }
+  sonar_viewer_.publishFan(decoded_ping_);
 }
+
+#include <rclcpp_components/register_node_macro.hpp>
+
+RCLCPP_COMPONENTS_REGISTER_NODE(OculusViewerNode)
@@ -0,0 +1,371 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <lz4.h>
+#include <zstd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include <oculus_ros2/ping_codec.hpp>
+
+namespace ping_codec {
+
+namespace {
+
+const int SIZE_OF_GAIN = 4;
+
+template <class T>
+T load(const uint8_t* p) {
+  T value;
+  std::memcpy(&value, p, sizeof(value));  // Little-endian, as the sonar
+  return value;
+}
+
+template <class T>
+void store(uint8_t* p, T value) {
+  std::memcpy(p, &value, sizeof(value));
+}
+
+// Transform applied to a ping data buffer, shared by the encoder and the decoder.
+struct Transform {
+  bool enabled = false;  // False if the layout does not match the buffer, which is then compressed as it is
+  int bits = 0;  // Lossy mode, 0 if lossless
+  bool delta = false;  // Samples stored as their difference with the previous row
+  int shift = 0;  // Right shift of the samples by the lossy mode
+  int plane_count = 1;  // Byte planes of the samples
+  std::size_t prefix = 0;  // Sonar message before the image
+  std::size_t gains = 0;  // Offset of the gain planes in the transformed buffer
+  std::size_t samples = 0;  // Offset of the sample planes
+  std::size_t size = 0;  // Size of the transformed buffer
+
+  Transform(const Layout& layout, std::size_t data_size, const Parameters& parameters) {
+    const std::size_t image_size = static_cast<std::size_t>(layout.n_ranges) * layout.step;
+    const int gain_size = layout.has_gains ? SIZE_OF_GAIN : 0;
+    enabled = (layout.sample_size == 1 || layout.sample_size == 2) && layout.n_ranges > 0 && layout.n_beams > 0 &&
+              layout.step == layout.n_beams * layout.sample_size + gain_size && image_size <= data_size &&
+              (layout.offset < 0 || static_cast<std::size_t>(layout.offset) == data_size - image_size);
+    if (!enabled) {
+      size = data_size;
+      return;
+    }
+    const int sample_bits = 8 * layout.sample_size;
+    bits = (parameters.bits > 0 && parameters.bits < sample_bits) ? parameters.bits : 0;
+    delta = parameters.delta;
+    shift = bits > 0 ? sample_bits - bits : 0;
+    plane_count = (bits > 0 && bits <= 8) ? 1 : layout.sample_size;
+    prefix = data_size - image_size;
+    gains = prefix;
+    samples = gains + (layout.has_gains ? SIZE_OF_GAIN * static_cast<std::size_t>(layout.n_ranges) : 0);
+    size = samples + static_cast<std::size_t>(plane_count) * layout.n_ranges * layout.n_beams;
+  }
+};
+
+// Gains: difference with the previous row, split in 4 byte planes.
+void encodeGains(const uint8_t* image, const Layout& layout, uint8_t* planes) {
+  uint32_t previous = 0;
+  for (int r = 0; r < layout.n_ranges; ++r) {
+    const uint32_t gain = load<uint32_t>(image + static_cast<std::size_t>(r) * layout.step);
+    const uint32_t delta = gain - previous;
+    previous = gain;
+    for (int k = 0; k < SIZE_OF_GAIN; ++k) {
+      planes[static_cast<std::size_t>(k) * layout.n_ranges + r] = static_cast<uint8_t>(delta >> (8 * k));
+    }
+  }
+}
+
+void decodeGains(const uint8_t* planes, const Layout& layout, uint8_t* image) {
+  uint32_t gain = 0;
+  for (int r = 0; r < layout.n_ranges; ++r) {
+    uint32_t delta = 0;
+    for (int k = 0; k < SIZE_OF_GAIN; ++k) {
+      delta |= static_cast<uint32_t>(planes[static_cast<std::size_t>(k) * layout.n_ranges + r]) << (8 * k);
+    }
+    gain += delta;
+    store(image + static_cast<std::size_t>(r) * layout.step, gain);
+  }
+}
+
+// Samples (rounded to their bits most significant bits by the lossy mode), with delta their difference with the sample of
+// the previous row in the arithmetic of Stored, split in sizeof(Stored) byte planes. The inner loops run over the beams
+// of a row without dependency between them, for the compiler to vectorize them.
+template <class Sample, class Stored>
+void encodeSamples(const uint8_t* image, const Layout& layout, int shift, bool delta, uint8_t* planes) {
+  const int gain_size = layout.has_gains ? SIZE_OF_GAIN : 0;
+  const std::size_t plane_size = static_cast<std::size_t>(layout.n_ranges) * layout.n_beams;
+  const int half = shift > 0 ? 1 << (shift - 1) : 0;
+  const int max_value = std::numeric_limits<Sample>::max() >> shift;
+  auto quantized = [&](const uint8_t* row, int b) {
+    const int sample = load<Sample>(row + static_cast<std::size_t>(b) * sizeof(Sample));
+    return static_cast<Stored>(std::min((sample + half) >> shift, max_value));
+  };
+
+  for (int r = 0; r < layout.n_ranges; ++r) {
+    const uint8_t* row = image + static_cast<std::size_t>(r) * layout.step + gain_size;
+    uint8_t* low = planes + static_cast<std::size_t>(r) * layout.n_beams;
+    if (r == 0 || !delta) {
+      for (int b = 0; b < layout.n_beams; ++b) {
+        const Stored value = quantized(row, b);
+        low[b] = static_cast<uint8_t>(value);
+        if (sizeof(Stored) > 1) {
+          low[plane_size + b] = static_cast<uint8_t>(value >> 8);
+        }
+      }
+      continue;
+    }
+    const uint8_t* previous = row - layout.step;
+    for (int b = 0; b < layout.n_beams; ++b) {
+      const Stored value = static_cast<Stored>(quantized(row, b) - quantized(previous, b));
+      low[b] = static_cast<uint8_t>(value);
+      if (sizeof(Stored) > 1) {
+        low[plane_size + b] = static_cast<uint8_t>(value >> 8);
+      }
+    }
+  }
+}
+
+template <class Sample, class Stored>
+void decodeSamples(const uint8_t* planes, const Layout& layout, int shift, bool delta, uint8_t* image) {
+  const int gain_size = layout.has_gains ? SIZE_OF_GAIN : 0;
+  const std::size_t plane_size = static_cast<std::size_t>(layout.n_ranges) * layout.n_beams;
+  auto stored = [&](const uint8_t* low, int b) {
+    Stored value = low[b];
+    if (sizeof(Stored) > 1) {
+      value = static_cast<Stored>(value | (low[plane_size + b] << 8));
+    }
+    return value;
+  };
+
+  for (int r = 0; r < layout.n_ranges; ++r) {
+    uint8_t* row = image + static_cast<std::size_t>(r) * layout.step + gain_size;
+    const uint8_t* low = planes + static_cast<std::size_t>(r) * layout.n_beams;
+    if (r == 0 || !delta) {
+      for (int b = 0; b < layout.n_beams; ++b) {
+        store(row + static_cast<std::size_t>(b) * sizeof(Sample), static_cast<Sample>(stored(low, b) << shift));
+      }
+      continue;
+    }
+    // The previous row holds the rounded samples, exact multiples of 2^shift
+    const uint8_t* previous = row - layout.step;
+    for (int b = 0; b < layout.n_beams; ++b) {
+      const Stored value =
+          static_cast<Stored>(stored(low, b) + (load<Sample>(previous + static_cast<std::size_t>(b) * sizeof(Sample)) >> shift));
+      store(row + static_cast<std::size_t>(b) * sizeof(Sample), static_cast<Sample>(value << shift));
+    }
+  }
+}
+
+void encodeSamples(const uint8_t* image, const Layout& layout, const Transform& transform, uint8_t* planes) {
+  if (layout.sample_size == 1) {
+    encodeSamples<uint8_t, uint8_t>(image, layout, transform.shift, transform.delta, planes);
+  } else if (transform.plane_count == 1) {
+    encodeSamples<uint16_t, uint8_t>(image, layout, transform.shift, transform.delta, planes);
+  } else {
+    encodeSamples<uint16_t, uint16_t>(image, layout, transform.shift, transform.delta, planes);
+  }
+}
+
+void decodeSamples(const uint8_t* planes, const Layout& layout, const Transform& transform, uint8_t* image) {
+  if (layout.sample_size == 1) {
+    decodeSamples<uint8_t, uint8_t>(planes, layout, transform.shift, transform.delta, image);
+  } else if (transform.plane_count == 1) {
+    decodeSamples<uint16_t, uint8_t>(planes, layout, transform.shift, transform.delta, image);
+  } else {
+    decodeSamples<uint16_t, uint16_t>(planes, layout, transform.shift, transform.delta, image);
+  }
+}
+
+}  // namespace
+
+bool formatFromString(const std::string& name, Format& format) {
+  if (name == "lz4") {
+    format = Format::LZ4;
+  } else if (name == "zstd") {
+    format = Format::ZSTD;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char* toString(Format format) {
+  return format == Format::LZ4 ? "lz4" : "zstd";
+}
+
+Layout layout(const oculus_interfaces::msg::Ping& ping) {
+  // An unknown offset (0) is the end of the buffer
+  return Layout{ping.n_ranges, ping.n_beams, static_cast<int>(ping.step), ping.sample_size, ping.has_gains,
+      ping.image_offset > 0 ? static_cast<int>(ping.image_offset) : -1};
+}
+
+void copyMetadata(const oculus_interfaces::msg::Ping& from, oculus_interfaces::msg::Ping& to) {
+  to.header = from.header;
+  to.ping_id = from.ping_id;
+  to.ping_firing_date = from.ping_firing_date;
+  to.ping_firing_date_unwrapped = from.ping_firing_date_unwrapped;
+  to.range = from.range;
+  to.gain_percent = from.gain_percent;
+  to.frequency = from.frequency;
+  to.speed_of_sound_used = from.speed_of_sound_used;
+  to.range_resolution = from.range_resolution;
+  to.temperature = from.temperature;
+  to.pressure = from.pressure;
+  to.master_mode = from.master_mode;
+  to.has_gains = from.has_gains;
+  to.n_ranges = from.n_ranges;
+  to.n_beams = from.n_beams;
+  to.step = from.step;
+  to.sample_size = from.sample_size;
+  to.image_offset = from.image_offset;
+  to.bearings = from.bearings;
+}
+
+void Encoder::ZstdContextDeleter::operator()(ZSTD_CCtx_s* context) const {
+  ZSTD_freeCCtx(context);
+}
+
+Encoder::Encoder(const Parameters& parameters) : parameters_(parameters) {
+  if (parameters_.format == Format::ZSTD) {
+    zstd_context_.reset(ZSTD_createCCtx());
+  }
+}
+
+int Encoder::encode(const uint8_t* data, std::size_t size, const Layout& layout, std::vector<uint8_t>& out) {
+  const Transform transform(layout, size, parameters_);
+  const uint8_t* source = data;
+  if (transform.enabled) {
+    planes_.resize(transform.size);
+    std::memcpy(planes_.data(), data, transform.prefix);
+    const uint8_t* image = data + transform.prefix;
+    if (layout.has_gains) {
+      encodeGains(image, layout, planes_.data() + transform.gains);
+    }
+    encodeSamples(image, layout, transform, planes_.data() + transform.samples);
+    source = planes_.data();
+  }
+
+  if (parameters_.format == Format::ZSTD) {
+    out.resize(ZSTD_compressBound(transform.size));
+    const std::size_t compressed_size =
+        ZSTD_compressCCtx(zstd_context_.get(), out.data(), out.size(), source, transform.size, parameters_.level);
+    if (ZSTD_isError(compressed_size)) {
+      throw std::runtime_error(std::string("zstd compression failed: ") + ZSTD_getErrorName(compressed_size));
+    }
+    out.resize(compressed_size);
+  } else {
+    if (transform.size > static_cast<std::size_t>(LZ4_MAX_INPUT_SIZE)) {
+      throw std::runtime_error("Ping too large for lz4");
+    }
+    out.resize(LZ4_compressBound(static_cast<int>(transform.size)));
+    const int compressed_size = LZ4_compress_fast(reinterpret_cast<const char*>(source), reinterpret_cast<char*>(out.data()),
+        static_cast<int>(transform.size), static_cast<int>(out.size()), std::max(1, parameters_.level));
+    if (compressed_size <= 0) {
+      throw std::runtime_error("lz4 compression failed");
+    }
+    out.resize(compressed_size);
+  }
+  return transform.bits;
+}
+
+void Encoder::encode(const uint8_t* data, std::size_t size, oculus_interfaces::msg::CompressedPing& msg) {
+  msg.format = toString(parameters_.format);
+  msg.bits = static_cast<uint8_t>(encode(data, size, layout(msg.ping), msg.data));
+  msg.delta = parameters_.delta;
+  msg.ping_data_size = static_cast<uint32_t>(size);
+}
+
+void Encoder::encode(const oculus_interfaces::msg::Ping& ping, oculus_interfaces::msg::CompressedPing& msg) {
+  copyMetadata(ping, msg.ping);
+  msg.ping.ping_data.clear();
+  encode(ping.ping_data.data(), ping.ping_data.size(), msg);
+}
+
+void Decoder::ZstdContextDeleter::operator()(ZSTD_DCtx_s* context) const {
+  ZSTD_freeDCtx(context);
+}
+
+Decoder::Decoder() : zstd_context_(ZSTD_createDCtx()) {}
+
+void Decoder::decode(const uint8_t* data,
+    std::size_t data_size,
+    const Parameters& parameters,
+    const Layout& layout,
+    std::size_t size,
+    std::vector<uint8_t>& out) {
+  const Transform transform(layout, size, parameters);
+  if (transform.bits != parameters.bits) {
+    throw std::runtime_error("Inconsistent lossy ping bits " + std::to_string(parameters.bits));
+  }
+  out.resize(size);
+  uint8_t* destination = out.data();
+  if (transform.enabled) {
+    planes_.resize(transform.size);
+    destination = planes_.data();
+  }
+
+  if (parameters.format == Format::ZSTD) {
+    const std::size_t decoded_size = ZSTD_decompressDCtx(zstd_context_.get(), destination, transform.size, data, data_size);
+    if (ZSTD_isError(decoded_size) || decoded_size != transform.size) {
+      throw std::runtime_error("Corrupted zstd ping data");
+    }
+  } else {
+    const int decoded_size = LZ4_decompress_safe(reinterpret_cast<const char*>(data), reinterpret_cast<char*>(destination),
+        static_cast<int>(std::min<std::size_t>(data_size, std::numeric_limits<int>::max())), static_cast<int>(transform.size));
+    if (decoded_size < 0 || static_cast<std::size_t>(decoded_size) != transform.size) {
+      throw std::runtime_error("Corrupted lz4 ping data");
+    }
+  }
+
+  if (transform.enabled) {
+    std::memcpy(out.data(), planes_.data(), transform.prefix);
+    uint8_t* image = out.data() + transform.prefix;
+    if (layout.has_gains) {
+      decodeGains(planes_.data() + transform.gains, layout, image);
+    }
+    decodeSamples(planes_.data() + transform.samples, layout, transform, image);
+  }
+}
+
+void Decoder::decode(const oculus_interfaces::msg::CompressedPing& msg, oculus_interfaces::msg::Ping& ping) {
+  Parameters parameters;
+  if (!formatFromString(msg.format, parameters.format)) {
+    throw std::runtime_error("Unknown ping compression format " + msg.format);
+  }
+  parameters.bits = msg.bits;
+  parameters.delta = msg.delta;
+  copyMetadata(msg.ping, ping);
+  decode(msg.data.data(), msg.data.size(), parameters, layout(msg.ping), msg.ping_data_size, ping.ping_data);
+}
+
+}  // namespace ping_codec
@@ -0,0 +1,158 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+#include <oculus_ros2/pipeline_stats.hpp>
+
+namespace {
+
+// A jump larger than this in ping_id is a sonar restart, not lost pings
+const uint32_t MAX_PING_ID_GAP = 1000000;
+
+std::string formatMs(double seconds) {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(3) << 1000. * seconds;
+  return out.str();
+}
+
+}  // namespace
+
+const char* toString(PipelineStage stage) {
+  switch (stage) {
+    case PipelineStage::TRANSPORT:
+      return "transport";
+    case PipelineStage::QUEUE:
+      return "queue";
+    case PipelineStage::FILTER:
+      return "temporal filter";
+    case PipelineStage::CONVERSION:
+      return "conversion";
+    case PipelineStage::PUBLISH:
+      return "publish";
+    case PipelineStage::COMPRESSION:
+      return "compression";
+    case PipelineStage::FAN_RENDER:
+      return "fan render";
+    case PipelineStage::DETECTION:
+      return "detection";
+    case PipelineStage::IMAGE_PUBLISH:
+      return "image publish";
+    default:
+      return "total";
+  }
+}
+
+LatencyWindow::LatencyWindow(std::size_t capacity) : samples_(std::max<std::size_t>(capacity, 1)) {}
+
+void LatencyWindow::add(double seconds) {
+  samples_[next_] = seconds;
+  next_ = (next_ + 1) % samples_.size();
+  size_ = std::min(size_ + 1, samples_.size());
+}
+
+LatencyWindow::Summary LatencyWindow::summary(bool relative_to_min) const {
+  Summary summary;
+  summary.count = size_;
+  if (size_ == 0) {
+    return summary;
+  }
+  std::vector<double> sorted(samples_.begin(), samples_.begin() + size_);
+  std::sort(sorted.begin(), sorted.end());
+  const double offset = relative_to_min ? sorted.front() : 0.;
+  auto percentile = [&sorted, offset](double p) {
+    return sorted[static_cast<std::size_t>(std::ceil(p * sorted.size())) - 1] - offset;
+  };
+  summary.p50 = percentile(.50);
+  summary.p95 = percentile(.95);
+  summary.p99 = percentile(.99);
+  summary.max = sorted.back() - offset;
+  return summary;
+}
+
+PipelineStats::PipelineStats(std::size_t window)
+  : stages_(static_cast<std::size_t>(PipelineStage::COUNT), LatencyWindow(window)), last_report_(Clock::now()) {}
+
+void PipelineStats::record(PipelineStage stage, double seconds) {
+  std::lock_guard<std::mutex> l(mutex_);
+  stages_[static_cast<std::size_t>(stage)].add(seconds);
+}
+
+void PipelineStats::recordPing(uint32_t ping_id, std::size_t size) {
+  std::lock_guard<std::mutex> l(mutex_);
+  ++pings_;
+  bytes_ += size;
+  if (has_ping_id_) {
+    const uint32_t gap = ping_id - last_ping_id_ - 1;  // Modulo 2^32, the counter wraps
+    if (gap > MAX_PING_ID_GAP) {
+      ++ping_id_resets_;
+    } else {
+      missing_pings_ += gap;
+    }
+  }
+  has_ping_id_ = true;
+  last_ping_id_ = ping_id;
+}
+
+std::vector<std::pair<std::string, std::string>> PipelineStats::report() {
+  std::vector<std::pair<std::string, std::string>> values;
+  const Clock::time_point now = Clock::now();
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    const double period = std::chrono::duration<double>(now - last_report_).count();
+    values.emplace_back("pings/s", std::to_string(period > 0. ? pings_ / period : 0.));
+    values.emplace_back("MB/s", std::to_string(period > 0. ? 1e-6 * bytes_ / period : 0.));
+    values.emplace_back("missing pings (ping_id gaps)", std::to_string(missing_pings_));
+    values.emplace_back("ping_id resets", std::to_string(ping_id_resets_));
+    pings_ = 0;
+    bytes_ = 0;
+    last_report_ = now;
+    report_stages_ = stages_;  // The capacity of the copies is kept from one report to the other
+  }
+
+  for (std::size_t i = 0; i < report_stages_.size(); ++i) {
+    const PipelineStage stage = static_cast<PipelineStage>(i);
+    const LatencyWindow::Summary summary = report_stages_[i].summary(stage == PipelineStage::TRANSPORT);
+    if (summary.count == 0) {
+      continue;  // Stage not run (no subscriber)
+    }
+    const std::string name = toString(stage);
+    values.emplace_back(name + " p50 (ms)", formatMs(summary.p50));
+    values.emplace_back(name + " p95 (ms)", formatMs(summary.p95));
+    values.emplace_back(name + " p99 (ms)", formatMs(summary.p99));
+    values.emplace_back(name + " max (ms)", formatMs(summary.max));
+  }
+  return values;
+}
@@ -0,0 +1,137 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include <oculus_ros2/sonar_clock.hpp>
+
+namespace {
+
+const double WRAP = 4294967296.;  // us, period of the 32 bits sonar clock
+const double MAX_JUMP = 1.;  // s, larger discrepancies between the clocks are a sonar restart or a host clock jump
+
+}  // namespace
+
+SonarClock::SonarClock(double bin_duration, std::size_t n_bins)
+  : bin_duration_(bin_duration > 0. ? bin_duration : 1.), n_bins_(n_bins > 1 ? n_bins : 2) {}
+
+uint64_t SonarClock::update(uint32_t firing_date, int64_t reception) {
+  if (!initialized_) {
+    initialized_ = true;
+    unwrapped_ = firing_date;
+    reset(unwrapped_, reception);
+  } else {
+    // The wraps missed during a silence longer than the sonar clock period are counted from the host elapsed time
+    const double elapsed = 1e-3 * static_cast<double>(reception - last_reception_);  // us
+    const uint32_t delta = firing_date - last_date_;  // Modulo 2^32
+    const double wraps = std::max(0., std::round((elapsed - delta) / WRAP));
+    const double sonar_elapsed = delta + wraps * WRAP;
+    if (std::abs(sonar_elapsed - elapsed) > std::max(1e6 * MAX_JUMP, .01 * elapsed)) {
+      unwrapped_ = firing_date;  // Sonar restart, its clock starts again
+      ++resets_;
+      reset(unwrapped_, reception);
+    } else {
+      unwrapped_ += static_cast<uint64_t>(sonar_elapsed);
+    }
+  }
+  last_date_ = firing_date;
+  last_reception_ = reception;
+
+  const double sonar_time = x(unwrapped_);
+  const double delay = 1e-9 * static_cast<double>(reception - reference_reception_) - sonar_time;
+  if (std::abs(delay - (offset_ + drift_ * sonar_time)) > MAX_JUMP) {
+    ++resets_;  // Host clock step
+    reset(unwrapped_, reception);
+    return unwrapped_;
+  }
+
+  const int64_t index = static_cast<int64_t>(std::floor(sonar_time / bin_duration_));
+  if (bins_.empty() || index > bins_.back().index) {
+    bins_.push_back({index, sonar_time, delay});
+    while (bins_.size() > n_bins_) {
+      bins_.pop_front();
+    }
+  } else if (delay < bins_.back().y) {
+    bins_.back().x = sonar_time;
+    bins_.back().y = delay;
+  } else {
+    return unwrapped_;  // The envelope is unchanged
+  }
+  fit();
+  return unwrapped_;
+}
+
+int64_t SonarClock::toHost(uint64_t firing_date) const {
+  const double sonar_time = x(firing_date);
+  return reference_reception_ + static_cast<int64_t>(std::llround(1e9 * (sonar_time + offset_ + drift_ * sonar_time)));
+}
+
+void SonarClock::reset(uint64_t date, int64_t reception) {
+  reference_date_ = date;
+  reference_reception_ = reception;
+  bins_.clear();
+  bins_.push_back({0, 0., 0.});
+  offset_ = 0.;
+  drift_ = 0.;
+}
+
+void SonarClock::fit() {
+  // The slope is only estimated over a few bins, the offset alone is the lower bound of the delays until then
+  if (bins_.size() < 3) {
+    offset_ = bins_.front().y;
+    for (const Bin& bin : bins_) {
+      offset_ = std::min(offset_, bin.y - drift_ * bin.x);
+    }
+    return;
+  }
+  double mean_x = 0.;
+  double mean_y = 0.;
+  for (const Bin& bin : bins_) {
+    mean_x += bin.x;
+    mean_y += bin.y;
+  }
+  mean_x /= bins_.size();
+  mean_y /= bins_.size();
+  double sxy = 0.;
+  double sxx = 0.;
+  for (const Bin& bin : bins_) {
+    sxy += (bin.x - mean_x) * (bin.y - mean_y);
+    sxx += (bin.x - mean_x) * (bin.x - mean_x);
+  }
+  drift_ = sxx > 0. ? sxy / sxx : 0.;
+  // The line is lowered onto the envelope: the fitted firing times are never later than a reception
+  offset_ = mean_y - drift_ * mean_x;
+  for (const Bin& bin : bins_) {
+    offset_ = std::min(offset_, bin.y - drift_ * bin.x);
+  }
+}
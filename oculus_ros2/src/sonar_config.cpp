@@ -0,0 +1,196 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <oculus_ros2/sonar_config.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace sonar_config {
+
+namespace {
+
+// Sets the parameter if the sonar value differs from the current one by more than tolerance
+template <class T>
+void followSonar(std::vector<rclcpp::Parameter>& changed, const T& current, const T& sonar, const std::string& name,
+    double tolerance = 0.) {
+  if (std::abs(static_cast<double>(current) - static_cast<double>(sonar)) > tolerance) {
+    changed.push_back(rclcpp::Parameter(name, sonar));
+  }
+}
+
+void compare(std::vector<Mismatch>& mismatches, const std::vector<rclcpp::Parameter>& changed, double requested,
+    double applied, const std::string& name) {
+  if (requested == applied) {
+    return;
+  }
+  const bool is_changed = std::any_of(changed.begin(), changed.end(),
+      [&name](const rclcpp::Parameter& param) { return param.get_name() == name; });
+  mismatches.push_back(Mismatch{name, requested, applied, is_changed});
+}
+
+}  // namespace
+
+ParameterBatch::ParameterBatch(const SonarParameters& parameters) : parameters_(parameters) {}
+
+std::vector<rclcpp::Parameter> ParameterBatch::set(const std::vector<rclcpp::Parameter>& parameters) {
+  std::vector<rclcpp::Parameter> unknown;
+  for (const rclcpp::Parameter& param : parameters) {
+    if (!setParameter(parameters_, param)) {
+      if (param.get_name() != "run") {
+        unknown.push_back(param);
+      }
+    } else if (!applying_sonar_values_) {
+      auto queued = std::find_if(
+          queued_.begin(), queued_.end(), [&param](const rclcpp::Parameter& p) { return p.get_name() == param.get_name(); });
+      if (queued != queued_.end()) {
+        *queued = param;
+      } else {
+        queued_.push_back(param);
+      }
+    }
+  }
+  return unknown;
+}
+
+std::vector<rclcpp::Parameter> ParameterBatch::applySonarValues(const SonarParameters& sonar,
+    const std::function<void(const std::vector<rclcpp::Parameter>&)>& set_parameters) {
+  std::vector<rclcpp::Parameter> changed;
+  // The doubles are compared with half their step: the sonar rounds them, speed_of_sound_used drifts
+  followSonar(changed, parameters_.frequency_mode, sonar.frequency_mode, params::FREQUENCY_MODE.name);
+  followSonar(changed, parameters_.range, sonar.range, params::RANGE.name, params::RANGE.step / 2);
+  followSonar(changed, parameters_.gain_percent, sonar.gain_percent, params::GAIN_PERCENT.name, params::GAIN_PERCENT.step / 2);
+  if (!parameters_.use_salinity) {  // Otherwise sound_speed is not used, the sonar computes it
+    followSonar(changed, parameters_.sound_speed, sonar.sound_speed, params::SOUND_SPEED.name, params::SOUND_SPEED.step / 2);
+  }
+  followSonar(changed, parameters_.ping_rate, sonar.ping_rate, params::PING_RATE.name);
+  followSonar(changed, parameters_.gain_assist, sonar.gain_assist, params::GAIN_ASSIT.name);
+  followSonar(changed, parameters_.gamma_correction, sonar.gamma_correction, params::GAMMA_CORRECTION.name);
+  followSonar(changed, parameters_.salinity, sonar.salinity, params::SALINITY.name, params::SALINITY.step / 2);
+  followSonar(changed, parameters_.data_depth, sonar.data_depth, params::DATA_DEPTH.name);
+
+  if (!changed.empty()) {
+    applying_sonar_values_ = true;
+    set_parameters(changed);
+    applying_sonar_values_ = false;
+  }
+  return changed;
+}
+
+std::vector<rclcpp::Parameter> ParameterBatch::takeQueued() {
+  std::vector<rclcpp::Parameter> parameters;
+  parameters.swap(queued_);
+  return parameters;
+}
+
+bool setParameter(SonarParameters& parameters, const rclcpp::Parameter& parameter) {
+  const std::string& name = parameter.get_name();
+  if (name == params::FREQUENCY_MODE.name) {
+    parameters.frequency_mode = parameter.as_int();
+  } else if (name == params::PING_RATE.name) {
+    parameters.ping_rate = parameter.as_int();
+  } else if (name == params::NBEAMS.name) {
+    parameters.nbeams = parameter.as_int();
+  } else if (name == params::DATA_DEPTH.name) {
+    parameters.data_depth = parameter.as_int();
+  } else if (name == params::GAIN_ASSIT.name) {
+    parameters.gain_assist = parameter.as_bool();
+  } else if (name == params::RANGE.name) {
+    parameters.range = parameter.as_double();
+  } else if (name == params::GAMMA_CORRECTION.name) {
+    parameters.gamma_correction = parameter.as_int();
+  } else if (name == params::GAIN_PERCENT.name) {
+    parameters.gain_percent = parameter.as_double();
+  } else if (name == params::SOUND_SPEED.name) {
+    parameters.sound_speed = parameter.as_double();
+  } else if (name == params::USE_SALINITY.name) {
+    parameters.use_salinity = parameter.as_bool();
+  } else if (name == params::SALINITY.name) {
+    parameters.salinity = parameter.as_double();
+  } else {
+    return false;
+  }
+  return true;
+}
+
+oculus::SonarDriver::PingConfig toConfig(const SonarParameters& parameters, oculus::SonarDriver::PingConfig base) {
+  base.masterMode = parameters.frequency_mode;
+  base.pingRate = parameters.ping_rate;
+  base.gammaCorrection = parameters.gamma_correction;
+  base.range = parameters.range;
+  base.gainPercent = parameters.gain_percent;
+  base.speedOfSound = parameters.use_salinity ? 0. : parameters.sound_speed;
+  base.salinity = parameters.salinity;
+  base.flags = parameters.nbeams ? (base.flags | flagByte::NBEAMS) : (base.flags & ~flagByte::NBEAMS);
+  base.flags = parameters.data_depth == 16 ? (base.flags | flagByte::DATA_DEPTH) : (base.flags & ~flagByte::DATA_DEPTH);
+  base.flags = parameters.gain_assist ? (base.flags | flagByte::GAIN_ASSIST) : (base.flags & ~flagByte::GAIN_ASSIST);
+  return base;
+}
+
+SonarParameters fromConfig(const oculus::SonarDriver::PingConfig& config, SonarParameters base) {
+  base.frequency_mode = config.masterMode;
+  base.ping_rate = config.pingRate;
+  base.nbeams = (config.flags & flagByte::NBEAMS) ? 1 : 0;
+  base.data_depth = (config.flags & flagByte::DATA_DEPTH) ? 16 : 8;
+  base.gain_assist = config.flags & flagByte::GAIN_ASSIST;
+  base.range = config.range;
+  base.gamma_correction = config.gammaCorrection;
+  base.gain_percent = config.gainPercent;
+  base.sound_speed = config.speedOfSound;
+  base.salinity = config.salinity;
+  return base;
+}
+
+std::vector<Mismatch> compareFeedback(const std::vector<rclcpp::Parameter>& changed,
+    const oculus::SonarDriver::PingConfig& requested,
+    const oculus::SonarDriver::PingConfig& feedback) {
+  std::vector<Mismatch> mismatches;
+  if (changed.empty()) {
+    return mismatches;
+  }
+  auto flag = [](const oculus::SonarDriver::PingConfig& config, int flag) { return (config.flags & flag) ? 1. : 0.; };
+  compare(mismatches, changed, requested.masterMode, feedback.masterMode, params::FREQUENCY_MODE.name);
+  // requested.pingRate != feedback.pingRate  // is broken (?) sonar side TODO(???)
+  compare(mismatches, changed, flag(requested, flagByte::GAIN_ASSIST), flag(feedback, flagByte::GAIN_ASSIST),
+      params::GAIN_ASSIT.name);
+  compare(mismatches, changed, flag(requested, flagByte::NBEAMS), flag(feedback, flagByte::NBEAMS), params::NBEAMS.name);
+  compare(mismatches, changed, 8. + 8. * flag(requested, flagByte::DATA_DEPTH), 8. + 8. * flag(feedback, flagByte::DATA_DEPTH),
+      params::DATA_DEPTH.name);
+  compare(mismatches, changed, requested.range, feedback.range, params::RANGE.name);
+  compare(mismatches, changed, requested.gammaCorrection, feedback.gammaCorrection, params::GAMMA_CORRECTION.name);
+  compare(mismatches, changed, requested.gainPercent, feedback.gainPercent, params::GAIN_PERCENT.name);
+  compare(mismatches, changed, requested.speedOfSound, feedback.speedOfSound, params::SOUND_SPEED.name);
+  compare(mismatches, changed, requested.salinity, feedback.salinity, params::SALINITY.name);
+  return mismatches;
+}
+
+}  // namespace sonar_config
@@ -32,29 +32,167 @@
 
 #include <oculus_ros2/sonar_viewer.hpp>
 
+#include <cmath>
+#include <cstring>
+
+#include <sensor_msgs/point_cloud2_iterator.hpp>
+
+namespace {
+
+// Offset of the image in ping_data. Messages which do not carry it (image_offset left to 0) have the image at the end.
+int imageOffset(const oculus_interfaces::msg::Ping& msg) {
+  if (msg.image_offset > 0) {
+    return static_cast<int>(msg.image_offset);
+  }
+  return static_cast<int>(msg.ping_data.size()) - msg.n_ranges * static_cast<int>(msg.step);
+}
+
+}  // namespace
+
 SonarViewer::SonarViewer(rclcpp::Node* node) : node_(node) {
   image_publisher_ = node->create_publisher<sensor_msgs::msg::Image>("image", 10);
+  compensated_publisher_ = node->create_publisher<sensor_msgs::msg::Image>("compensated", 10);
+  polar_publisher_ = node->create_publisher<sensor_msgs::msg::Image>("polar", 10);
+  raw_publisher_ = node->create_publisher<sensor_msgs::msg::Image>("raw", 10);
+  points_publisher_ = node->create_publisher<sensor_msgs::msg::PointCloud2>("points", 10);
+
+  rcl_interfaces::msg::ParameterDescriptor param_desc;
+  param_desc.description =
+      "Gain compensation of the ping image published on the compensated topic (each row divided by the square root of its "
+      "gain).\n"
+      "\toff: Not published.\n"
+      "\tfloat: 32FC1 image.\n"
+      "\t8bit: mono8 image, compensated values scaled by 255.\n"
+      "\t16bit: mono16 image, compensated values scaled by 65535.";
+  const std::string mode = node->declare_parameter<std::string>("gain_compensation", "off", param_desc);
+  if (!gain_compensation::modeFromString(mode, gain_compensation_mode_)) {
+    RCLCPP_WARN_STREAM(node->get_logger(), "Unknown gain_compensation " << mode << " (off, float, 8bit or 16bit), using off.");
+  }
+
+  rcl_interfaces::msg::ParameterDescriptor cfar_desc;
+  cfar_desc.description =
+      "CFAR detector of the points topic, run over the gain compensated polar image.\n"
+      "\toff: Not published.\n"
+      "\tca: Cell averaging, noise estimated by the mean of the training cells.\n"
+      "\tos: Ordered statistic, noise estimated by the cfar_os_rank quantile of the training cells.";
+  const std::string method = node->declare_parameter<std::string>("cfar", "off", cfar_desc);
+  cfar::Parameters cfar_params;
+  if (!cfar::methodFromString(method, cfar_params.method)) {
+    RCLCPP_WARN_STREAM(node->get_logger(), "Unknown cfar " << method << " (off, ca or os), using off.");
+  }
+  cfar_params.guard_ranges = node->declare_parameter<int>("cfar_guard_ranges", cfar_params.guard_ranges);
+  cfar_params.guard_beams = node->declare_parameter<int>("cfar_guard_beams", cfar_params.guard_beams);
+  cfar_params.training_ranges = node->declare_parameter<int>("cfar_training_ranges", cfar_params.training_ranges);
+  cfar_params.training_beams = node->declare_parameter<int>("cfar_training_beams", cfar_params.training_beams);
+  cfar_params.pfa = node->declare_parameter<double>("cfar_pfa", cfar_params.pfa);
+  cfar_params.os_rank = node->declare_parameter<double>("cfar_os_rank", cfar_params.os_rank);
+  detector_ = cfar::Detector(cfar_params);
+
+  rcl_interfaces::msg::ParameterDescriptor levels_desc;
+  levels_desc.description =
+      "Resolutions of the fan image: image is the full resolution, each further level is published on image_<divisor> "
+      "with half the resolution of the previous one (image_2, image_4...).";
+  int levels = node->declare_parameter<int>("image_levels", 3, levels_desc);
+  if (levels < 1 || levels > MAX_IMAGE_LEVELS_) {
+    levels = std::clamp(levels, 1, MAX_IMAGE_LEVELS_);
+    RCLCPP_WARN_STREAM(node->get_logger(), "image_levels out of [1, " << MAX_IMAGE_LEVELS_ << "], using " << levels << ".");
+  }
+  for (int divisor = 2; divisor < (1 << levels); divisor *= 2) {
+    auto level = std::make_unique<FanLevel>();
+    level->divisor = divisor;
+    level->publisher = node->create_publisher<sensor_msgs::msg::Image>("image_" + std::to_string(divisor), 10);
+    levels_.push_back(std::move(level));
+  }
+
+  image_min_range_ = node->declare_parameter<double>("image_min_range", 0.);
+  image_max_range_ = node->declare_parameter<double>("image_max_range", 0.);
+  if (image_max_range_ > 0. && image_max_range_ <= image_min_range_) {
+    RCLCPP_WARN_STREAM(node->get_logger(), "image_max_range is not above image_min_range, using the range of the sonar.");
+    image_max_range_ = 0.;
+  }
+  image_min_bearing_ = node->declare_parameter<double>("image_min_bearing", 0.);
+  image_max_bearing_ = node->declare_parameter<double>("image_max_bearing", 0.);
+  if (image_max_bearing_ < image_min_bearing_) {
+    RCLCPP_WARN_STREAM(node->get_logger(), "image_max_bearing is below image_min_bearing, using the whole aperture.");
+    image_min_bearing_ = image_max_bearing_ = 0.;
+  }
+  image_width_ = std::max(node->declare_parameter<int>("image_width", 0), 0);
+  image_height_ = std::max(node->declare_parameter<int>("image_height", 0), 0);
+  image_resolution_ = std::max(node->declare_parameter<double>("image_resolution", 0.), 0.);
+
+  rcl_interfaces::msg::ParameterDescriptor interpolation_desc;
+  interpolation_desc.description =
+      "Interpolation of the polar image in the fan images.\n"
+      "\tnearest: Closest sample.\n"
+      "\tbilinear: 2x2 neighbourhood.\n"
+      "\tcubic: 4x4 neighbourhood, sharpest but slower and overshoots on speckle.\n"
+      "\tarea: Bilinear over the beams averaged over the width of a pixel, no aliasing near the sonar.";
+  const std::string interpolation = node->declare_parameter<std::string>("interpolation", "cubic", interpolation_desc);
+  if (!fan_interpolation::methodFromString(interpolation, interpolation_)) {
+    RCLCPP_WARN_STREAM(
+        node->get_logger(), "Unknown interpolation " << interpolation << " (nearest, bilinear, cubic or area), using cubic.");
+  }
 }
 
 SonarViewer::~SonarViewer() {}
 
+std::size_t SonarViewer::subscriptionCount() const {
+  std::size_t count = image_publisher_->get_subscription_count() + polar_publisher_->get_subscription_count() +
+                      raw_publisher_->get_subscription_count();
+  for (const std::unique_ptr<FanLevel>& level : levels_) {
+    count += level->publisher->get_subscription_count();
+  }
+  if (gain_compensation_mode_ != gain_compensation::Mode::OFF) {
+    count += compensated_publisher_->get_subscription_count();
+  }
+  if (detector_.parameters().method != cfar::Method::OFF) {
+    count += points_publisher_->get_subscription_count();
+  }
+  return count;
+}
+
+void SonarViewer::setStats(PipelineStats* stats) {
+  stats_ = stats;
+}
+
+std::size_t SonarViewer::remapCacheHits() const {
+  return remap_cache_.hits();
+}
+
+std::size_t SonarViewer::remapCacheMisses() const {
+  return remap_cache_.misses();
+}
+
 void SonarViewer::publishFan(const oculus_interfaces::msg::Ping& ros_ping_msg) const {
-  // const int offset = ping->ping_data_offset(); // TODO(hugoyvrn)
-  const int offset = -16;  // quick fix TODO(hugoyvrn, why 229?)
+  const int offset = imageOffset(ros_ping_msg);
 
-  publishFan(
-      ros_ping_msg.n_beams, ros_ping_msg.n_ranges, offset, ros_ping_msg.ping_data, ros_ping_msg.master_mode, ros_ping_msg.header);
+  // An incomplete bearing table falls back on a uniform repartition of the beams over the aperture
+  const int16_t* bearings =
+      (ros_ping_msg.bearings.size() == ros_ping_msg.n_beams && ros_ping_msg.n_beams > 0) ? ros_ping_msg.bearings.data() : nullptr;
+
+  publishFan(ros_ping_msg.n_beams, ros_ping_msg.n_ranges, offset, ros_ping_msg.ping_data, ros_ping_msg.master_mode, bearings,
+      ros_ping_msg.step, ros_ping_msg.sample_size, ros_ping_msg.header, ros_ping_msg.range_resolution);
 }
 
 void SonarViewer::publishFan(const oculus::PingMessage::ConstPtr& ping, const std::string& frame_id) const {
   std_msgs::msg::Header header;
   header.stamp = oculus::toMsg(ping->timestamp());
   header.frame_id = frame_id;
+  publishFan(ping, header);
+}
 
+void SonarViewer::publishFan(const oculus::PingMessage::ConstPtr& ping, const std_msgs::msg::Header& header) const {
+  publishFan(ping, ping->data(), header);
+}
+
+void SonarViewer::publishFan(const oculus::PingMessage::ConstPtr& ping,
+    const std::vector<uint8_t>& ping_data,
+    const std_msgs::msg::Header& header) const {
   if (!ping->has_gains()) {
     RCLCPP_WARN(node_->get_logger(), "Gains are not send by the sonar. The conic image view is wrong.");
   }
-  publishFan(ping->bearing_count(), ping->range_count(), ping->ping_data_offset(), ping->data(), ping->master_mode(), header);
+  publishFan(ping->bearing_count(), ping->range_count(), ping->ping_data_offset(), ping_data, ping->master_mode(),
+      ping->bearing_data(), ping->step(), ping->sample_size(), header, ping->range_resolution());
 }
 
 void SonarViewer::publishFan(const int& width,
@@ -62,61 +200,341 @@ void SonarViewer::publishFan(const int& width,
     const int& offset,
     const std::vector<uint8_t>& ping_data,
     const int& master_mode,
-    const std_msgs::msg::Header& header) const {
-  const int step = width + SIZE_OF_GAIN_;
-  const float theta_shift = 270;
-  const int mat_encoding = CV_8U;
-  const char* ros_image_encoding = sensor_msgs::image_encodings::MONO8;
-
-  const double bearing =
-      (master_mode == 1) ? LOW_FREQUENCY_BEARING_APERTURE_ * M_PI / 180 : HIGHT_FREQUENCY_BEARING_APERTURE_ * M_PI / 180;
-  const float bearing_ratio = 2 * bearing / width;
-  const int negative_height = static_cast<int>(std::floor(height * std::sin(-bearing)));
-  const int positive_height = static_cast<int>(std::ceil(height * std::sin(bearing)));
-  const int image_width = positive_height - negative_height;
-  const int origin_width = abs(negative_height);  // x coordinate of the origin
-  const cv::Size image_size(image_width, height);
-  cv::Mat map(image_size, CV_32FC2);
-  cv::parallel_for_(cv::Range(0, map.total()), [&](const cv::Range& range) {
-    for (auto i = range.start; i < range.end; i++) {
-      int y = i / map.cols;
-      int x = i % map.cols;
-
-      // Calculate range and bearing of this pixel from origin
-      const float dx = x - origin_width;
-      const float dy = map.rows - y;
-
-      const float range = sqrt(dx * dx + dy * dy);
-      const float bearing_x_y = atan2(dx, dy);
-
-      float xp = range;
-      // Linear interpolation, TODO: use a better interpolation method
-      float yp = (bearing_x_y + bearing) / bearing_ratio;
-
-      map.at<cv::Vec2f>(cv::Point(x, y)) = cv::Vec2f(xp, yp);
+    const int16_t* bearings,
+    const int& step,
+    const int& sample_size,
+    const std_msgs::msg::Header& header,
+    const double& range_resolution) const {
+  int gain_size;
+  if (!checkLayout(width, height, offset, ping_data.size(), step, sample_size, gain_size)) {
+    return;
+  }
+
+  const uint8_t* rows = ping_data.data() + offset;
+  if (sample_size == sizeof(uint16_t)) {
+    renderPing<uint16_t>(width, height, rows, step, gain_size, master_mode, bearings, header, range_resolution);
+  } else {
+    renderPing<uint8_t>(width, height, rows, step, gain_size, master_mode, bearings, header, range_resolution);
+  }
+}
+
+bool SonarViewer::renderFan(const oculus_interfaces::msg::Ping& ros_ping_msg, sensor_msgs::msg::Image& image) const {
+  const int width = ros_ping_msg.n_beams;
+  const int height = ros_ping_msg.n_ranges;
+  const std::vector<uint8_t>& ping_data = ros_ping_msg.ping_data;
+  const int offset = imageOffset(ros_ping_msg);
+  int gain_size;
+  if (!checkLayout(width, height, offset, ping_data.size(), ros_ping_msg.step, ros_ping_msg.sample_size, gain_size)) {
+    return false;
+  }
+  const int16_t* bearings =
+      (ros_ping_msg.bearings.size() == ros_ping_msg.n_beams && width > 0) ? ros_ping_msg.bearings.data() : nullptr;
+  const std::shared_ptr<const FanRemap> remap = fanRemap(
+      remap_cache_, width, height, ros_ping_msg.master_mode, bearings, fanRegion(ros_ping_msg.range_resolution, 1));
+
+  const uint8_t* rows = ping_data.data() + offset;
+  if (ros_ping_msg.sample_size == sizeof(uint16_t)) {
+    fillFan<uint16_t>(*remap, width, height, rows, ros_ping_msg.step, gain_size, ros_ping_msg.header, image);
+  } else {
+    fillFan<uint8_t>(*remap, width, height, rows, ros_ping_msg.step, gain_size, ros_ping_msg.header, image);
+  }
+  return true;
+}
+
+bool SonarViewer::checkLayout(const int& width,
+    const int& height,
+    const int& offset,
+    const std::size_t& data_size,
+    const int& step,
+    const int& sample_size,
+    int& gain_size) const {
+  if (width <= 0 || height <= 0) {
+    RCLCPP_WARN_STREAM(node_->get_logger(), "Empty ping image: " << width << " beams and " << height << " ranges.");
+    return false;
+  }
+  // Each row holds its gain (if sent by the sonar) followed by the samples
+  gain_size = step - width * sample_size;
+  if ((sample_size != sizeof(uint8_t) && sample_size != sizeof(uint16_t)) || (gain_size != 0 && gain_size != SIZE_OF_GAIN_)) {
+    RCLCPP_WARN_STREAM(node_->get_logger(),
+        "Unsupported ping layout: step of " << step << " bytes for " << width << " samples of " << sample_size << " bytes.");
+    return false;
+  }
+  if (offset < 0 || static_cast<std::size_t>(offset) + static_cast<std::size_t>(height) * step > data_size) {
+    RCLCPP_WARN_STREAM(node_->get_logger(),
+        "Ping data is too small (" << data_size << " bytes) for " << width << " beams and " << height << " ranges.");
+    return false;
+  }
+  return true;
+}
+
+FanRegion SonarViewer::fanRegion(const double& range_resolution, const int& divisor) const {
+  FanRegion region;
+  region.min_bearing = image_min_bearing_ * M_PI / 180;
+  region.max_bearing = image_max_bearing_ * M_PI / 180;
+  region.width = image_width_ > 0 ? std::max(image_width_ / divisor, 1) : 0;
+  region.height = image_height_ > 0 ? std::max(image_height_ / divisor, 1) : 0;
+
+  // The distances in meters are ignored when the range resolution is unknown. They are rounded so that a jitter of the
+  // range resolution (speed of sound computed from the water temperature) does not rebuild the remap tables every ping.
+  if (range_resolution > 0.) {
+    auto ranges = [](double value) { return static_cast<float>(std::round(value * 1024) / 1024); };
+    region.min_range = ranges(image_min_range_ / (range_resolution * divisor));
+    region.max_range = ranges(image_max_range_ / (range_resolution * divisor));
+    region.pixel_size = ranges(image_resolution_ / range_resolution);  // The reduced ranges are divisor times larger too
+  }
+  return region;
+}
+
+std::shared_ptr<const FanRemap> SonarViewer::fanRemap(FanRemapCache& cache,
+    const int& width,
+    const int& height,
+    const int& master_mode,
+    const int16_t* bearings,
+    const FanRegion& region) const {
+  const double aperture = (master_mode == 1) ? LOW_FREQUENCY_BEARING_APERTURE_ : HIGHT_FREQUENCY_BEARING_APERTURE_;
+  // Remap tables only depend on the ping geometry, they are rebuilt when it changes
+  std::shared_ptr<const FanRemap> remap = cache.get(
+      {width, height, master_mode, aperture, FanRemapCache::hashBearings(bearings, width), region, interpolation_}, bearings);
+  if (remap->bearings_ignored) {
+    RCLCPP_WARN_ONCE(node_->get_logger(), "The bearing table of the pings is not monotonic, using a linear aperture.");
+  }
+  return remap;
+}
+
+template <class Sample>
+void SonarViewer::fillFan(const FanRemap& remap,
+    const int& width,
+    const int& height,
+    const uint8_t* rows,
+    const int& step,
+    const int& gain_size,
+    const std_msgs::msg::Header& header,
+    sensor_msgs::msg::Image& msg) {
+  msg.header = header;
+  msg.height = remap.image_size.height;
+  msg.width = remap.image_size.width;
+  msg.encoding = SampleEncoding<Sample>::ROS_ENCODING;
+  msg.is_bigendian = false;  // Samples are little-endian, as sent by the sonar
+  msg.step = msg.width * sizeof(Sample);
+  msg.data.resize(msg.step * msg.height);
+
+  // The polar image (ranges x beams) is read in place from the ping buffer, the gain at the start of each row is skipped
+  Sample* out = reinterpret_cast<Sample*>(msg.data.data());
+  switch (remap.method) {
+    case fan_interpolation::Method::CUBIC: {
+      const cv::Mat polar(height, width, SampleEncoding<Sample>::CV_TYPE, const_cast<uint8_t*>(rows) + gain_size, step);
+      cv::Mat out_mat(remap.image_size, SampleEncoding<Sample>::CV_TYPE, out, msg.step);
+      cv::remap(polar, out_mat, remap.map1, remap.map2, cv::INTER_CUBIC, cv::BORDER_CONSTANT,
+          cv::Scalar(std::numeric_limits<Sample>::max()));
+      break;
+    }
+    case fan_interpolation::Method::AREA: {
+      // Per thread, renderFan can be called concurrently
+      thread_local std::vector<uint8_t> averaged;
+      averaged.resize(static_cast<std::size_t>(height) * width * sizeof(Sample));
+      fan_interpolation::averageBeams<Sample>(
+          rows + gain_size, step, width, height, remap.table.half_beams, reinterpret_cast<Sample*>(averaged.data()));
+      fan_interpolation::remap<Sample>(remap.table, fan_interpolation::Method::BILINEAR, averaged.data(),
+          width * sizeof(Sample), std::numeric_limits<Sample>::max(), out);
+      break;
+    }
+    default:
+      fan_interpolation::remap<Sample>(
+          remap.table, remap.method, rows + gain_size, step, std::numeric_limits<Sample>::max(), out);
+      break;
+  }
+}
+
+template <class Sample>
+void SonarViewer::renderPing(const int& width,
+    const int& height,
+    const uint8_t* rows,
+    const int& step,
+    const int& gain_size,
+    const int& master_mode,
+    const int16_t* bearings,
+    const std_msgs::msg::Header& header,
+    const double& range_resolution) const {
+  if (raw_publisher_->get_subscription_count() > 0) {
+    publishMessage(*raw_publisher_, raw_msg_, [&](sensor_msgs::msg::Image& msg) {
+      msg.header = header;
+      msg.height = height;
+      msg.width = step;
+      msg.encoding = sensor_msgs::image_encodings::TYPE_8UC1;
+      msg.is_bigendian = false;
+      msg.step = step;
+      msg.data.assign(rows, rows + static_cast<std::size_t>(height) * step);
+    });
+  }
+
+  if (polar_publisher_->get_subscription_count() > 0) {
+    publishMessage(*polar_publisher_, polar_msg_, [&](sensor_msgs::msg::Image& msg) {
+      msg.header = header;
+      msg.height = height;
+      msg.width = width;
+      msg.encoding = SampleEncoding<Sample>::ROS_ENCODING;
+      msg.is_bigendian = false;
+      msg.step = width * sizeof(Sample);
+      msg.data.resize(static_cast<std::size_t>(msg.step) * height);
+      for (int r = 0; r < height; ++r) {
+        std::memcpy(msg.data.data() + static_cast<std::size_t>(r) * msg.step,
+            rows + static_cast<std::size_t>(r) * step + gain_size, msg.step);
+      }
+    });
+  }
+
+  if (gain_size == SIZE_OF_GAIN_ && gain_compensation_mode_ != gain_compensation::Mode::OFF &&
+      compensated_publisher_->get_subscription_count() > 0) {
+    publishCompensated<Sample>(width, height, rows, step, header);
+  }
+
+  if (detector_.parameters().method != cfar::Method::OFF && range_resolution > 0. &&
+      points_publisher_->get_subscription_count() > 0) {
+    publishPoints<Sample>(width, height, rows, step, gain_size, master_mode, bearings, header, range_resolution);
+  }
+
+  for (const std::unique_ptr<FanLevel>& level : levels_) {
+    if (level->publisher->get_subscription_count() > 0) {
+      publishLevel<Sample>(*level, width, height, rows, step, gain_size, master_mode, bearings, header, range_resolution);
     }
+  }
+
+  const std::shared_ptr<const FanRemap> remap =
+      fanRemap(remap_cache_, width, height, master_mode, bearings, fanRegion(range_resolution, 1));
+
+  // Without subscriber only the remap tables are kept up to date, so the first fan is immediate when someone subscribes
+  if (image_publisher_->get_subscription_count() == 0) {
+    return;
+  }
+
+  publishMessage(*image_publisher_, image_msg_, [&](sensor_msgs::msg::Image& msg) {
+    StageProbe probe(stats_, PipelineStage::FAN_RENDER);
+    fillFan<Sample>(*remap, width, height, rows, step, gain_size, header, msg);
+  });
+}
+
+template <class Sample>
+void SonarViewer::publishLevel(FanLevel& level,
+    const int& width,
+    const int& height,
+    const uint8_t* rows,
+    const int& step,
+    const int& gain_size,
+    const int& master_mode,
+    const int16_t* bearings,
+    const std_msgs::msg::Header& header,
+    const double& range_resolution) const {
+  // The fan is divisor times smaller, so is the range of each pixel: the polar image is averaged over divisor ranges
+  // (picking one range out of divisor would alias the speckle). Along the beams the fan is already narrower than the
+  // beam count near the origin, as the full resolution one.
+  const int level_height = std::max(height / level.divisor, 1);
+  const int level_step = width * static_cast<int>(sizeof(Sample));
+  const std::shared_ptr<const FanRemap> remap = fanRemap(
+      level.remap_cache, width, level_height, master_mode, bearings, fanRegion(range_resolution, level.divisor));
+
+  publishMessage(*level.publisher, level.msg, [&](sensor_msgs::msg::Image& msg) {
+    StageProbe probe(stats_, PipelineStage::FAN_RENDER);
+    level.polar.resize(static_cast<std::size_t>(level_height) * level_step);
+    const cv::Mat polar(height, width, SampleEncoding<Sample>::CV_TYPE, const_cast<uint8_t*>(rows) + gain_size, step);
+    cv::Mat reduced(level_height, width, SampleEncoding<Sample>::CV_TYPE, level.polar.data(), level_step);
+    cv::resize(polar, reduced, reduced.size(), 0., 0., cv::INTER_AREA);
+    fillFan<Sample>(*remap, width, level_height, level.polar.data(), level_step, 0, header, msg);
   });
+}
 
-  cv::Mat source_map_1, source_map_2;
-  cv::convertMaps(map, cv::Mat(), source_map_1, source_map_2, CV_16SC2);
+template <class Sample>
+void SonarViewer::publishCompensated(const int& width,
+    const int& height,
+    const uint8_t* rows,
+    const int& step,
+    const std_msgs::msg::Header& header) const {
+  publishMessage(*compensated_publisher_, compensated_msg_, [&](sensor_msgs::msg::Image& msg) {
+    msg.header = header;
+    msg.height = height;
+    msg.width = width;
+    msg.is_bigendian = false;
 
-  cv::Mat sonar_mat_data(height, step, mat_encoding);  // Note that the width is 'step' to include gain data
-  // Copy the data including gain data
-  for (int i = 0; i < height; ++i)
-    std::copy(ping_data.begin() + offset + i * step, ping_data.begin() + offset + (i + 1) * step, sonar_mat_data.ptr<uint8_t>(i));
+    switch (gain_compensation_mode_) {
+      case gain_compensation::Mode::FLOAT:
+        msg.encoding = sensor_msgs::image_encodings::TYPE_32FC1;
+        msg.step = width * sizeof(float);
+        msg.data.resize(msg.step * height);
+        gain_compensation::compensate<Sample>(rows, step, height, width, reinterpret_cast<float*>(msg.data.data()));
+        break;
+      case gain_compensation::Mode::UINT16:
+        msg.encoding = sensor_msgs::image_encodings::MONO16;
+        msg.step = width * sizeof(uint16_t);
+        msg.data.resize(msg.step * height);
+        gain_compensation::compensate<Sample>(rows, step, height, width, reinterpret_cast<uint16_t*>(msg.data.data()));
+        break;
+      default:
+        msg.encoding = sensor_msgs::image_encodings::MONO8;
+        msg.step = width;
+        msg.data.resize(msg.step * height);
+        gain_compensation::compensate<Sample>(rows, step, height, width, msg.data.data());
+        break;
+    }
+  });
+}
 
-  // Now remove the gain data from sonar_mat_data
-  cv::Mat sonar_mat_data_without_gain(height, width, mat_encoding);
-  for (int i = 0; i < height; ++i)
-    std::copy(sonar_mat_data.ptr<uint8_t>(i) + SIZE_OF_GAIN_, sonar_mat_data.ptr<uint8_t>(i) + step,
-        sonar_mat_data_without_gain.ptr<uint8_t>(i));
+template <class Sample>
+void SonarViewer::publishPoints(const int& width,
+    const int& height,
+    const uint8_t* rows,
+    const int& step,
+    const int& gain_size,
+    const int& master_mode,
+    const int16_t* bearings,
+    const std_msgs::msg::Header& header,
+    const double& range_resolution) const {
+  // The rows are brought to the same scale by their gains, the detector thresholds still adapt to the range through its
+  // training windows
+  detector_image_.resize(static_cast<std::size_t>(width) * height);
+  if (gain_size == SIZE_OF_GAIN_) {
+    gain_compensation::compensate<Sample>(rows, step, height, width, detector_image_.data());
+  } else {
+    // The rows may not be aligned for 16 bits samples
+    for (int r = 0; r < height; ++r) {
+      const uint8_t* samples = rows + static_cast<std::size_t>(r) * step;
+      float* out = detector_image_.data() + static_cast<std::size_t>(r) * width;
+      for (int b = 0; b < width; ++b) {
+        out[b] = gain_compensation::loadSample<Sample>(samples, b);
+      }
+    }
+  }
+  {
+    StageProbe probe(stats_, PipelineStage::DETECTION);
+    detector_.detect(detector_image_.data(), height, width, detections_);
+  }
 
-  cv::Mat out = cv::Mat::ones(cv::Size(image_width, height), CV_MAKETYPE(mat_encoding, 1)) * std::numeric_limits<uint8_t>::max();
-  cv::remap(sonar_mat_data_without_gain.t(), out, source_map_1, source_map_2, cv::INTER_CUBIC, cv::BORDER_CONSTANT,
-      cv::Scalar(std::numeric_limits<uint8_t>::max(), std::numeric_limits<uint8_t>::max(), std::numeric_limits<uint8_t>::max()));
+  const double aperture = ((master_mode == 1) ? LOW_FREQUENCY_BEARING_APERTURE_ : HIGHT_FREQUENCY_BEARING_APERTURE_) * M_PI / 180;
+  publishMessage(*points_publisher_, points_msg_, [&](sensor_msgs::msg::PointCloud2& msg) {
+    msg.header = header;
+    msg.height = 1;
+    msg.is_dense = true;
+    sensor_msgs::PointCloud2Modifier modifier(msg);
+    modifier.setPointCloud2Fields(4, "x", 1, sensor_msgs::msg::PointField::FLOAT32, "y", 1,
+        sensor_msgs::msg::PointField::FLOAT32, "z", 1, sensor_msgs::msg::PointField::FLOAT32, "intensity", 1,
+        sensor_msgs::msg::PointField::FLOAT32);
+    modifier.resize(detections_.size());
 
-  // Publish sonar conic image
-  sensor_msgs::msg::Image msg;
-  cv_bridge::CvImage(header, ros_image_encoding, out).toImageMsg(msg);
-  image_publisher_->publish(msg);
+    sensor_msgs::PointCloud2Iterator<float> x(msg, "x");
+    sensor_msgs::PointCloud2Iterator<float> y(msg, "y");
+    sensor_msgs::PointCloud2Iterator<float> z(msg, "z");
+    sensor_msgs::PointCloud2Iterator<float> intensity(msg, "intensity");
+    for (const cfar::Detection& detection : detections_) {
+      // Same bearings as the fan image, positive to starboard: y (port) is opposed to the bearing
+      const double bearing =
+          bearings ? bearings[detection.beam] * 0.01 * M_PI / 180 : -aperture + 2 * aperture * detection.beam / width;
+      const double range = detection.range * range_resolution;
+      *x = static_cast<float>(range * std::cos(bearing));
+      *y = static_cast<float>(-range * std::sin(bearing));
+      *z = 0.f;
+      *intensity = detection.value;
+      ++x;
+      ++y;
+      ++z;
+      ++intensity;
+    }
+  });
 }
@@ -0,0 +1,508 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include <oculus_ros2/gain_compensation.hpp>
+#include <oculus_ros2/temporal_filter.hpp>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace temporal_filter {
+
+namespace {
+
+const int SIZE_OF_GAIN = 4;
+const int MEDIAN_BLOCK = 256;  // Cells sorted at once by the median, the ring values of a block stay in the L1 cache
+const float MIN_VARIANCE = std::numeric_limits<float>::min();
+
+// Scalar kernels, also used for the tail of the rows by the SIMD ones.
+
+void emaScalar(const float* x, float* mean, int n, float alpha) {
+  for (int i = 0; i < n; ++i) {
+    mean[i] += alpha * (x[i] - mean[i]);
+  }
+}
+
+// x is replaced by the filtered value. k, the weight of the ping against the average, is the part of the variance of
+// the cell not explained by the speckle (whose variance is speckle2 * mean^2).
+void leeScalar(float* x, float* mean, float* squares, int n, float alpha, float speckle2) {
+  for (int i = 0; i < n; ++i) {
+    const float m = mean[i] + alpha * (x[i] - mean[i]);
+    const float s = squares[i] + alpha * (x[i] * x[i] - squares[i]);
+    const float variance = std::max(s - m * m, 0.f);
+    const float k = std::max(variance - speckle2 * m * m, 0.f) / std::max(variance, MIN_VARIANCE);
+    mean[i] = m;
+    squares[i] = s;
+    x[i] = m + k * (x[i] - m);
+  }
+}
+
+// Compare-exchange of a median network, between two frames of a block of cells. The sources may be the destinations.
+void minMaxScalar(const float* a, const float* b, int n, float* low, float* high) {
+  for (int i = 0; i < n; ++i) {
+    const float x = a[i];
+    const float y = b[i];
+    low[i] = std::min(x, y);
+    high[i] = std::max(x, y);
+  }
+}
+
+// Rounds to nearest (even), as the SIMD conversions do with the default rounding mode. The samples are written through a
+// byte pointer, the rows of the ping are not aligned.
+template <class Sample>
+void toSamplesScalar(const float* in, int n, float scale, uint8_t* out) {
+  for (int i = 0; i < n; ++i) {
+    const float value = in[i] * scale;
+    Sample sample;
+    if (!(value > 0.f)) {
+      sample = 0;
+    } else if (value >= static_cast<float>(std::numeric_limits<Sample>::max())) {
+      sample = std::numeric_limits<Sample>::max();
+    } else {
+      sample = static_cast<Sample>(std::lrintf(value));
+    }
+    gain_compensation::storeSample(sample, i, out);
+  }
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("avx2"))) void emaAvx2(const float* x, float* mean, int n, float alpha) {
+  const __m256 alpha_v = _mm256_set1_ps(alpha);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 m = _mm256_loadu_ps(mean + i);
+    _mm256_storeu_ps(mean + i, _mm256_add_ps(m, _mm256_mul_ps(alpha_v, _mm256_sub_ps(_mm256_loadu_ps(x + i), m))));
+  }
+  emaScalar(x + i, mean + i, n - i, alpha);
+}
+
+__attribute__((target("avx2"))) void leeAvx2(float* x, float* mean, float* squares, int n, float alpha, float speckle2) {
+  const __m256 alpha_v = _mm256_set1_ps(alpha);
+  const __m256 speckle2_v = _mm256_set1_ps(speckle2);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 min_variance = _mm256_set1_ps(MIN_VARIANCE);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 value = _mm256_loadu_ps(x + i);
+    const __m256 mean_v = _mm256_loadu_ps(mean + i);
+    const __m256 squares_v = _mm256_loadu_ps(squares + i);
+    const __m256 m = _mm256_add_ps(mean_v, _mm256_mul_ps(alpha_v, _mm256_sub_ps(value, mean_v)));
+    const __m256 s = _mm256_add_ps(squares_v, _mm256_mul_ps(alpha_v, _mm256_sub_ps(_mm256_mul_ps(value, value), squares_v)));
+    const __m256 m2 = _mm256_mul_ps(m, m);
+    const __m256 variance = _mm256_max_ps(_mm256_sub_ps(s, m2), zero);
+    const __m256 k = _mm256_div_ps(_mm256_max_ps(_mm256_sub_ps(variance, _mm256_mul_ps(speckle2_v, m2)), zero),
+        _mm256_max_ps(variance, min_variance));
+    _mm256_storeu_ps(mean + i, m);
+    _mm256_storeu_ps(squares + i, s);
+    _mm256_storeu_ps(x + i, _mm256_add_ps(m, _mm256_mul_ps(k, _mm256_sub_ps(value, m))));
+  }
+  leeScalar(x + i, mean + i, squares + i, n - i, alpha, speckle2);
+}
+
+__attribute__((target("avx2"))) void minMaxAvx2(const float* a, const float* b, int n, float* low, float* high) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 x = _mm256_loadu_ps(a + i);
+    const __m256 y = _mm256_loadu_ps(b + i);
+    _mm256_storeu_ps(low + i, _mm256_min_ps(x, y));
+    _mm256_storeu_ps(high + i, _mm256_max_ps(x, y));
+  }
+  minMaxScalar(a + i, b + i, n - i, low + i, high + i);
+}
+
+__attribute__((target("avx2"))) void toUint8Avx2(const float* in, int n, float scale, uint8_t* out) {
+  const __m256 scale_v = _mm256_set1_ps(scale);
+  const __m256 max_v = _mm256_set1_ps(255.f);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256i values = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i), scale_v), max_v));
+    const __m128i values16 = _mm_packs_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(values16, values16));
+  }
+  toSamplesScalar<uint8_t>(in + i, n - i, scale, out + i);
+}
+
+__attribute__((target("avx2"))) void toUint16Avx2(const float* in, int n, float scale, uint8_t* out) {
+  const __m256 scale_v = _mm256_set1_ps(scale);
+  const __m256 max_v = _mm256_set1_ps(65535.f);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256i values = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i), scale_v), max_v));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i),
+        _mm_packus_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1)));
+  }
+  toSamplesScalar<uint16_t>(in + i, n - i, scale, out + 2 * i);
+}
+
+// SSE2 is always available on x86-64
+void emaSse2(const float* x, float* mean, int n, float alpha) {
+  const __m128 alpha_v = _mm_set1_ps(alpha);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 m = _mm_loadu_ps(mean + i);
+    _mm_storeu_ps(mean + i, _mm_add_ps(m, _mm_mul_ps(alpha_v, _mm_sub_ps(_mm_loadu_ps(x + i), m))));
+  }
+  emaScalar(x + i, mean + i, n - i, alpha);
+}
+
+void leeSse2(float* x, float* mean, float* squares, int n, float alpha, float speckle2) {
+  const __m128 alpha_v = _mm_set1_ps(alpha);
+  const __m128 speckle2_v = _mm_set1_ps(speckle2);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 min_variance = _mm_set1_ps(MIN_VARIANCE);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 value = _mm_loadu_ps(x + i);
+    const __m128 mean_v = _mm_loadu_ps(mean + i);
+    const __m128 squares_v = _mm_loadu_ps(squares + i);
+    const __m128 m = _mm_add_ps(mean_v, _mm_mul_ps(alpha_v, _mm_sub_ps(value, mean_v)));
+    const __m128 s = _mm_add_ps(squares_v, _mm_mul_ps(alpha_v, _mm_sub_ps(_mm_mul_ps(value, value), squares_v)));
+    const __m128 m2 = _mm_mul_ps(m, m);
+    const __m128 variance = _mm_max_ps(_mm_sub_ps(s, m2), zero);
+    const __m128 k =
+        _mm_div_ps(_mm_max_ps(_mm_sub_ps(variance, _mm_mul_ps(speckle2_v, m2)), zero), _mm_max_ps(variance, min_variance));
+    _mm_storeu_ps(mean + i, m);
+    _mm_storeu_ps(squares + i, s);
+    _mm_storeu_ps(x + i, _mm_add_ps(m, _mm_mul_ps(k, _mm_sub_ps(value, m))));
+  }
+  leeScalar(x + i, mean + i, squares + i, n - i, alpha, speckle2);
+}
+
+void minMaxSse2(const float* a, const float* b, int n, float* low, float* high) {
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 x = _mm_loadu_ps(a + i);
+    const __m128 y = _mm_loadu_ps(b + i);
+    _mm_storeu_ps(low + i, _mm_min_ps(x, y));
+    _mm_storeu_ps(high + i, _mm_max_ps(x, y));
+  }
+  minMaxScalar(a + i, b + i, n - i, low + i, high + i);
+}
+
+void toUint8Sse2(const float* in, int n, float scale, uint8_t* out) {
+  const __m128 scale_v = _mm_set1_ps(scale);
+  const __m128 max_v = _mm_set1_ps(255.f);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m128i low = _mm_cvtps_epi32(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(in + i), scale_v), max_v));
+    const __m128i high = _mm_cvtps_epi32(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale_v), max_v));
+    const __m128i values16 = _mm_packs_epi32(low, high);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(values16, values16));
+  }
+  toSamplesScalar<uint8_t>(in + i, n - i, scale, out + i);
+}
+
+void toUint16Sse2(const float* in, int n, float scale, uint8_t* out) {
+  // SSE2 has no unsigned 32 to 16 bits pack: values are clamped, shifted to the signed range, packed and shifted back
+  const __m128 scale_v = _mm_set1_ps(scale);
+  const __m128 max_v = _mm_set1_ps(65535.f);
+  const __m128i shift32 = _mm_set1_epi32(0x8000);
+  const __m128i shift16 = _mm_set1_epi16(static_cast<int16_t>(0x8000));
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m128i low =
+        _mm_sub_epi32(_mm_cvtps_epi32(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(in + i), scale_v), max_v)), shift32);
+    const __m128i high =
+        _mm_sub_epi32(_mm_cvtps_epi32(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale_v), max_v)), shift32);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), _mm_xor_si128(_mm_packs_epi32(low, high), shift16));
+  }
+  toSamplesScalar<uint16_t>(in + i, n - i, scale, out + 2 * i);
+}
+
+#elif defined(__aarch64__)
+
+void emaNeon(const float* x, float* mean, int n, float alpha) {
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const float32x4_t m = vld1q_f32(mean + i);
+    vst1q_f32(mean + i, vaddq_f32(m, vmulq_n_f32(vsubq_f32(vld1q_f32(x + i), m), alpha)));
+  }
+  emaScalar(x + i, mean + i, n - i, alpha);
+}
+
+void leeNeon(float* x, float* mean, float* squares, int n, float alpha, float speckle2) {
+  const float32x4_t zero = vdupq_n_f32(0.f);
+  const float32x4_t min_variance = vdupq_n_f32(MIN_VARIANCE);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const float32x4_t value = vld1q_f32(x + i);
+    const float32x4_t mean_v = vld1q_f32(mean + i);
+    const float32x4_t squares_v = vld1q_f32(squares + i);
+    const float32x4_t m = vaddq_f32(mean_v, vmulq_n_f32(vsubq_f32(value, mean_v), alpha));
+    const float32x4_t s = vaddq_f32(squares_v, vmulq_n_f32(vsubq_f32(vmulq_f32(value, value), squares_v), alpha));
+    const float32x4_t m2 = vmulq_f32(m, m);
+    const float32x4_t variance = vmaxq_f32(vsubq_f32(s, m2), zero);
+    const float32x4_t k =
+        vdivq_f32(vmaxq_f32(vsubq_f32(variance, vmulq_n_f32(m2, speckle2)), zero), vmaxq_f32(variance, min_variance));
+    vst1q_f32(mean + i, m);
+    vst1q_f32(squares + i, s);
+    vst1q_f32(x + i, vaddq_f32(m, vmulq_f32(k, vsubq_f32(value, m))));
+  }
+  leeScalar(x + i, mean + i, squares + i, n - i, alpha, speckle2);
+}
+
+void minMaxNeon(const float* a, const float* b, int n, float* low, float* high) {
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const float32x4_t x = vld1q_f32(a + i);
+    const float32x4_t y = vld1q_f32(b + i);
+    vst1q_f32(low + i, vminq_f32(x, y));
+    vst1q_f32(high + i, vmaxq_f32(x, y));
+  }
+  minMaxScalar(a + i, b + i, n - i, low + i, high + i);
+}
+
+inline uint16x8_t toUint16Neon(const float* in, float scale) {
+  // vcvtnq rounds to nearest even and saturates negative values to 0, vqmovn saturates to 16 bits
+  return vcombine_u16(vqmovn_u32(vcvtnq_u32_f32(vmulq_n_f32(vld1q_f32(in), scale))),
+      vqmovn_u32(vcvtnq_u32_f32(vmulq_n_f32(vld1q_f32(in + 4), scale))));
+}
+
+void toUint8Neon(const float* in, int n, float scale, uint8_t* out) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    vst1_u8(out + i, vqmovn_u16(toUint16Neon(in + i, scale)));
+  }
+  toSamplesScalar<uint8_t>(in + i, n - i, scale, out + i);
+}
+
+void toUint16Neon(const float* in, int n, float scale, uint8_t* out) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    vst1q_u8(out + 2 * i, vreinterpretq_u8_u16(toUint16Neon(in + i, scale)));  // Byte store, the rows are not aligned
+  }
+  toSamplesScalar<uint16_t>(in + i, n - i, scale, out + 2 * i);
+}
+
+#endif
+
+struct Kernels {
+  void (*ema)(const float*, float*, int, float);
+  void (*lee)(float*, float*, float*, int, float, float);
+  void (*minMax)(const float*, const float*, int, float*, float*);
+  void (*toUint8)(const float*, int, float, uint8_t*);
+  void (*toUint16)(const float*, int, float, uint8_t*);  // Little-endian uint16 samples
+};
+
+Kernels selectKernels() {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    return Kernels{emaAvx2, leeAvx2, minMaxAvx2, toUint8Avx2, toUint16Avx2};
+  }
+  return Kernels{emaSse2, leeSse2, minMaxSse2, toUint8Sse2, toUint16Sse2};
+#elif defined(__aarch64__)
+  return Kernels{emaNeon, leeNeon, minMaxNeon, toUint8Neon, toUint16Neon};
+#else
+  return Kernels{emaScalar, leeScalar, minMaxScalar, toSamplesScalar<uint8_t>, toSamplesScalar<uint16_t>};
+#endif
+}
+
+const Kernels& kernels() {
+  static const Kernels selected = selectKernels();  // CPU features are only checked once
+  return selected;
+}
+
+// Batcher's odd-even merge sort of n values, pruned of the compare-exchanges that do not lead to the median: 8 instead of
+// 10 for 5 frames, 24 instead of 36 for 9 frames.
+std::vector<std::pair<int, int>> medianNetwork(int n) {
+  std::vector<std::pair<int, int>> network;
+  for (int p = 1; p < n; p *= 2) {
+    for (int k = p; k >= 1; k /= 2) {
+      for (int j = k % p; j + k < n; j += 2 * k) {
+        for (int i = 0; i < k && i + j + k < n; ++i) {
+          if ((i + j) / (2 * p) == (i + j + k) / (2 * p)) {
+            network.emplace_back(i + j, i + j + k);
+          }
+        }
+      }
+    }
+  }
+  std::array<bool, MAX_FRAMES> needed{};  // n <= MAX_FRAMES
+  needed[n / 2] = true;
+  std::vector<std::pair<int, int>> pruned;
+  for (auto it = network.rbegin(); it != network.rend(); ++it) {
+    if (needed[it->first] || needed[it->second]) {
+      needed[it->first] = needed[it->second] = true;
+      pruned.push_back(*it);
+    }
+  }
+  return std::vector<std::pair<int, int>>(pruned.rbegin(), pruned.rend());
+}
+
+template <class Sample>
+void toFrame(const uint8_t* rows, const Geometry& geometry, float* frame) {
+  if (geometry.has_gains) {
+    gain_compensation::compensate<Sample>(rows, geometry.step, geometry.n_ranges, geometry.n_beams, frame);
+    return;
+  }
+  for (int r = 0; r < geometry.n_ranges; ++r) {
+    const uint8_t* samples = rows + static_cast<std::ptrdiff_t>(r) * geometry.step;
+    float* out = frame + static_cast<std::ptrdiff_t>(r) * geometry.n_beams;
+    for (int b = 0; b < geometry.n_beams; ++b) {
+      out[b] = gain_compensation::loadSample<Sample>(samples, b);
+    }
+  }
+}
+
+// Inverse of toFrame, with the gains of rows
+void fromFrame(const float* frame, const Geometry& geometry, void (*kernel)(const float*, int, float, uint8_t*), uint8_t* rows) {
+  const int gain_size = geometry.has_gains ? SIZE_OF_GAIN : 0;
+  for (int r = 0; r < geometry.n_ranges; ++r) {
+    uint8_t* row = rows + static_cast<std::ptrdiff_t>(r) * geometry.step;
+    const float scale = geometry.has_gains ? 1.f / gain_compensation::rowScale(gain_compensation::rowGain(row), 1.f) : 1.f;
+    kernel(frame + static_cast<std::ptrdiff_t>(r) * geometry.n_beams, geometry.n_beams, scale, row + gain_size);
+  }
+}
+
+}  // namespace
+
+bool modeFromString(const std::string& name, Mode& mode) {
+  if (name == "off") {
+    mode = Mode::OFF;
+  } else if (name == "ema") {
+    mode = Mode::EMA;
+  } else if (name == "median") {
+    mode = Mode::MEDIAN;
+  } else if (name == "speckle") {
+    mode = Mode::SPECKLE;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool Geometry::operator==(const Geometry& other) const {
+  return n_ranges == other.n_ranges && n_beams == other.n_beams && step == other.step && sample_size == other.sample_size &&
+         has_gains == other.has_gains && master_mode == other.master_mode && range == other.range;
+}
+
+Filter::Filter(const Parameters& parameters) : parameters_(parameters) {
+  parameters_.alpha = std::min(std::max(parameters_.alpha, 1e-3), 1.);
+  parameters_.frames = std::min(std::max(parameters_.frames, 1), MAX_FRAMES) | 1;  // The median of an odd count is a value
+  parameters_.speckle = std::max(parameters_.speckle, 0.);
+  if (parameters_.mode == Mode::MEDIAN) {
+    network_ = medianNetwork(parameters_.frames);
+  }
+}
+
+void Filter::apply(uint8_t* rows, const Geometry& geometry) {
+  const int gain_size = geometry.has_gains ? SIZE_OF_GAIN : 0;
+  if (parameters_.mode == Mode::OFF || (geometry.sample_size != 1 && geometry.sample_size != 2) || geometry.n_ranges <= 0 ||
+      geometry.n_beams <= 0 || geometry.step < geometry.n_beams * geometry.sample_size + gain_size) {
+    return;
+  }
+
+  const std::size_t cells = static_cast<std::size_t>(geometry.n_ranges) * geometry.n_beams;
+  frame_.resize(cells);
+  if (geometry.sample_size == 1) {
+    toFrame<uint8_t>(rows, geometry, frame_.data());
+  } else {
+    toFrame<uint16_t>(rows, geometry, frame_.data());
+  }
+
+  // The first ping of a geometry initializes the state and is published as it is
+  if (!initialized_ || geometry != geometry_) {
+    if (initialized_) {
+      ++resets_;
+    }
+    initialized_ = true;
+    geometry_ = geometry;
+    if (parameters_.mode == Mode::MEDIAN) {
+      ring_.resize(cells * parameters_.frames);
+      for (int f = 0; f < parameters_.frames; ++f) {
+        std::copy(frame_.begin(), frame_.end(), ring_.begin() + f * cells);
+      }
+      sorted_.resize(static_cast<std::size_t>(MEDIAN_BLOCK) * parameters_.frames);
+      ring_next_ = 0;
+    } else {
+      mean_ = frame_;
+      if (parameters_.mode == Mode::SPECKLE) {
+        squares_.resize(cells);
+        std::transform(frame_.begin(), frame_.end(), squares_.begin(), [](float x) { return x * x; });
+      }
+    }
+    return;
+  }
+
+  const Kernels& k = kernels();
+  const float* filtered = frame_.data();
+  const float alpha = static_cast<float>(parameters_.alpha);
+  switch (parameters_.mode) {
+    case Mode::EMA:
+      k.ema(frame_.data(), mean_.data(), static_cast<int>(cells), alpha);
+      filtered = mean_.data();
+      break;
+    case Mode::SPECKLE: {
+      const float speckle2 = static_cast<float>(parameters_.speckle * parameters_.speckle);
+      k.lee(frame_.data(), mean_.data(), squares_.data(), static_cast<int>(cells), alpha, speckle2);
+      break;
+    }
+    case Mode::MEDIAN: {
+      const int frames = parameters_.frames;
+      std::copy(frame_.begin(), frame_.end(), ring_.begin() + ring_next_ * cells);
+      ring_next_ = (ring_next_ + 1) % frames;
+      // The median network runs on a block of cells at a time, each compare-exchange is a min / max between two frames of
+      // the block. A frame is read from the ring by its first compare-exchange, then from the sorted block.
+      for (std::size_t start = 0; start < cells; start += MEDIAN_BLOCK) {
+        const int n = static_cast<int>(std::min<std::size_t>(MEDIAN_BLOCK, cells - start));
+        loaded_.fill(false);
+        auto source = [&](int f) { return loaded_[f] ? &sorted_[f * MEDIAN_BLOCK] : &ring_[f * cells + start]; };
+        for (const std::pair<int, int>& exchange : network_) {
+          k.minMax(source(exchange.first), source(exchange.second), n, &sorted_[exchange.first * MEDIAN_BLOCK],
+              &sorted_[exchange.second * MEDIAN_BLOCK]);
+          loaded_[exchange.first] = loaded_[exchange.second] = true;
+        }
+        std::memcpy(&frame_[start], source(frames / 2), n * sizeof(float));
+      }
+      break;
+    }
+    case Mode::OFF:
+      break;
+  }
+
+  if (geometry.sample_size == 1) {
+    fromFrame(filtered, geometry, k.toUint8, rows);
+  } else {
+    fromFrame(filtered, geometry, k.toUint16, rows);
+  }
+}
+
+}  // namespace temporal_filter
@@ -0,0 +1,199 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include <oculus_ros2/cfar.hpp>
+
+namespace {
+
+// Exponentially distributed noise (mean 1) with a few bright targets
+std::vector<float> noiseImage(int n_ranges, int n_beams, int n_targets, unsigned seed) {
+  std::mt19937 generator(seed);
+  std::exponential_distribution<float> noise(1.f);
+  std::vector<float> image(static_cast<std::size_t>(n_ranges) * n_beams);
+  for (float& value : image) {
+    value = noise(generator);
+  }
+  std::uniform_int_distribution<std::size_t> cell(0, image.size() - 1);
+  for (int i = 0; i < n_targets; ++i) {
+    image[cell(generator)] = 60.f;
+  }
+  return image;
+}
+
+double osFactorReference(int n, int k, double pfa) {
+  auto logPfa = [n, k](double factor) {
+    double log_pfa = 0.;
+    for (int i = 0; i <= k; ++i) {
+      log_pfa += std::log((n - i) / (n - i + factor));
+    }
+    return log_pfa;
+  };
+  double low = 0.;
+  double high = 1e12;
+  for (int i = 0; i < 200; ++i) {
+    const double middle = .5 * (low + high);
+    (logPfa(middle) > std::log(pfa) ? low : high) = middle;
+  }
+  return high;
+}
+
+// Threshold of every cell computed from its training cells, listed one by one. < 0 when the cell has none.
+std::vector<double> referenceThresholds(const std::vector<float>& image, int n_ranges, int n_beams, const cfar::Parameters& p) {
+  std::vector<double> thresholds(image.size(), -1.);
+  std::vector<float> training;
+  for (int r = 0; r < n_ranges; ++r) {
+    for (int c = 0; c < n_beams; ++c) {
+      training.clear();
+      for (int i = r - p.guard_ranges - p.training_ranges; i <= r + p.guard_ranges + p.training_ranges; ++i) {
+        for (int j = c - p.guard_beams - p.training_beams; j <= c + p.guard_beams + p.training_beams; ++j) {
+          const bool inside = i >= 0 && i < n_ranges && j >= 0 && j < n_beams;
+          const bool guard = std::abs(i - r) <= p.guard_ranges && std::abs(j - c) <= p.guard_beams;
+          if (inside && !guard) {
+            training.push_back(image[i * n_beams + j]);
+          }
+        }
+      }
+      const int n = static_cast<int>(training.size());
+      if (n == 0) {
+        continue;
+      }
+      if (p.method == cfar::Method::CA) {
+        double sum = 0.;
+        for (float value : training) {
+          sum += value;
+        }
+        thresholds[r * n_beams + c] = (std::pow(p.pfa, -1. / n) - 1.) * sum;
+      } else {
+        const int k = std::min(n - 1, std::max(0, static_cast<int>(std::lround(p.os_rank * n)) - 1));
+        std::nth_element(training.begin(), training.begin() + k, training.end());
+        thresholds[r * n_beams + c] = osFactorReference(n, k, p.pfa) * training[k];
+      }
+    }
+  }
+  return thresholds;
+}
+
+// The detector works in float: cells within a relative 1e-4 of their threshold may go either way
+void expectReferenceDetections(const cfar::Parameters& parameters, int n_ranges, int n_beams, unsigned seed) {
+  const std::vector<float> image = noiseImage(n_ranges, n_beams, 20, seed);
+  cfar::Detector detector(parameters);
+  std::vector<cfar::Detection> detections;
+  detector.detect(image.data(), n_ranges, n_beams, detections);
+  const std::vector<double> thresholds = referenceThresholds(image, n_ranges, n_beams, detector.parameters());
+
+  std::set<std::pair<int, int>> detected;
+  for (const cfar::Detection& detection : detections) {
+    EXPECT_EQ(detection.value, image[detection.range * n_beams + detection.beam]);
+    detected.insert({detection.range, detection.beam});
+  }
+  std::size_t expected = 0;
+  for (int r = 0; r < n_ranges; ++r) {
+    for (int c = 0; c < n_beams; ++c) {
+      const double value = image[r * n_beams + c];
+      const double threshold = thresholds[r * n_beams + c];
+      const bool reference = threshold >= 0. && value > threshold;
+      expected += reference;
+      if (reference != (detected.count({r, c}) > 0) && std::abs(value - threshold) > 1e-4 * threshold) {
+        ADD_FAILURE() << "cell (" << r << ", " << c << "): " << value << " against a threshold of " << threshold;
+      }
+    }
+  }
+  EXPECT_GE(expected, 20u);  // The targets
+}
+
+TEST(Cfar, MethodFromString) {
+  cfar::Method method = cfar::Method::OFF;
+  EXPECT_TRUE(cfar::methodFromString("ca", method));
+  EXPECT_EQ(method, cfar::Method::CA);
+  EXPECT_TRUE(cfar::methodFromString("os", method));
+  EXPECT_EQ(method, cfar::Method::OS);
+  EXPECT_TRUE(cfar::methodFromString("off", method));
+  EXPECT_EQ(method, cfar::Method::OFF);
+  EXPECT_FALSE(cfar::methodFromString("go", method));
+}
+
+TEST(Cfar, OffDetectsNothing) {
+  const std::vector<float> image = noiseImage(32, 16, 5, 1);
+  cfar::Detector detector;
+  std::vector<cfar::Detection> detections{{0, 0, 0.f}};
+  detector.detect(image.data(), 32, 16, detections);
+  EXPECT_TRUE(detections.empty());
+}
+
+TEST(Cfar, CaMatchesBruteForce) {
+  cfar::Parameters parameters;
+  parameters.method = cfar::Method::CA;
+  parameters.pfa = 1e-3;
+  expectReferenceDetections(parameters, 120, 64, 2);
+  // Window wider than the image: no inner column
+  parameters.training_beams = 40;
+  expectReferenceDetections(parameters, 60, 16, 3);
+}
+
+TEST(Cfar, OsMatchesBruteForce) {
+  cfar::Parameters parameters;
+  parameters.method = cfar::Method::OS;
+  parameters.pfa = 1e-3;
+  expectReferenceDetections(parameters, 120, 64, 4);
+  parameters.os_rank = .5;
+  parameters.guard_ranges = 0;
+  parameters.guard_beams = 0;
+  expectReferenceDetections(parameters, 60, 32, 5);
+}
+
+TEST(Cfar, FalseAlarmRateFollowsPfa) {
+  for (cfar::Method method : {cfar::Method::CA, cfar::Method::OS}) {
+    cfar::Parameters parameters;
+    parameters.method = method;
+    parameters.pfa = 1e-2;
+    cfar::Detector detector(parameters);
+    const int n_ranges = 400;
+    const int n_beams = 256;
+    const std::vector<float> image = noiseImage(n_ranges, n_beams, 0, 6);
+    std::vector<cfar::Detection> detections;
+    detector.detect(image.data(), n_ranges, n_beams, detections);
+    const double rate = static_cast<double>(detections.size()) / (n_ranges * n_beams);
+    EXPECT_GT(rate, .5e-2);
+    EXPECT_LT(rate, 2e-2);
+  }
+}
+
+}  // namespace
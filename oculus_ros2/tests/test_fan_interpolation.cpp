@@ -0,0 +1,201 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <oculus_ros2/fan_interpolation.hpp>
+
+namespace {
+
+using fan_interpolation::Method;
+
+// Polar image of n_ranges rows of step bytes: a 4 bytes gain then n_beams samples, or the samples alone. The buffer is
+// exactly sized, so that the gathers reading past the last sample are seen by the sanitizers.
+struct Polar {
+  int n_beams;
+  int n_ranges;
+  int gain_size;
+  int step;
+  std::vector<uint8_t> buffer;
+
+  template <class Sample>
+  static Polar random(int n_beams, int n_ranges, bool has_gains, std::mt19937& generator) {
+    const int gain_size = has_gains ? 4 : 0;
+    const int step = n_beams * static_cast<int>(sizeof(Sample)) + gain_size;
+    Polar polar{n_beams, n_ranges, gain_size, step, std::vector<uint8_t>(static_cast<std::size_t>(step) * n_ranges)};
+    for (uint8_t& byte : polar.buffer) {
+      byte = static_cast<uint8_t>(generator());
+    }
+    return polar;
+  }
+
+  const uint8_t* samples() const { return buffer.data() + gain_size; }
+
+  template <class Sample>
+  double at(int range, int beam) const {
+    Sample value;
+    std::memcpy(&value, samples() + static_cast<std::size_t>(range) * step + beam * sizeof(Sample), sizeof(value));
+    return value;
+  }
+};
+
+// (beam, range) of size pixels, around and beyond the image, one pixel in 17 outside of the fan
+std::vector<float> randomCoordinates(int n_beams, int n_ranges, std::size_t size, std::mt19937& generator) {
+  std::uniform_real_distribution<float> beam(-.5f, n_beams + .5f);
+  std::uniform_real_distribution<float> range(-.5f, n_ranges + .5f);
+  std::vector<float> coordinates;
+  for (std::size_t i = 0; i < size; ++i) {
+    coordinates.push_back(i % 17 == 0 ? -1.f : beam(generator));
+    coordinates.push_back(range(generator));
+  }
+  // Corners of the image and beyond
+  const float corners[] = {0.f, 0.f, n_beams - 1.f, n_ranges - 1.f, static_cast<float>(n_beams), static_cast<float>(n_ranges)};
+  std::copy(std::begin(corners), std::end(corners), coordinates.begin() + 2);
+  return coordinates;
+}
+
+template <class Sample>
+void expectRemap(int n_beams, int n_ranges, bool has_gains, Method method) {
+  SCOPED_TRACE(::testing::Message() << n_beams << " beams, " << n_ranges << " ranges, gains " << has_gains << ", "
+                                    << sizeof(Sample) << " bytes samples, method " << static_cast<int>(method));
+  std::mt19937 generator(n_beams * n_ranges + has_gains);
+  const Polar polar = Polar::random<Sample>(n_beams, n_ranges, has_gains, generator);
+  const std::size_t size = 5003;  // Not a multiple of the SIMD width
+  const std::vector<float> coordinates = randomCoordinates(n_beams, n_ranges, size, generator);
+  ASSERT_TRUE(fan_interpolation::supported(n_beams, n_ranges));
+  fan_interpolation::Table table;
+  fan_interpolation::buildTable(coordinates.data(), size, n_beams, n_ranges, table);
+  ASSERT_EQ(table.cells.size(), size);
+
+  const Sample border = static_cast<Sample>(-1);
+  std::vector<Sample> vectorized(size);
+  std::vector<Sample> scalar(size);
+  fan_interpolation::remap<Sample>(table, method, polar.samples(), polar.step, border, vectorized.data());
+  fan_interpolation::remapScalar<Sample>(table, method, polar.samples(), polar.step, border, scalar.data());
+  EXPECT_EQ(vectorized, scalar);
+
+  // Against a float interpolation: the weights are quantized to 1/256
+  const double max_value = static_cast<double>(static_cast<Sample>(-1));
+  for (std::size_t i = 0; i < size; ++i) {
+    float beam = coordinates[2 * i];
+    float range = coordinates[2 * i + 1];
+    if (beam < 0.f || range < 0.f) {
+      EXPECT_EQ(scalar[i], border);
+      continue;
+    }
+    beam = std::min<float>(beam, n_beams - 1);
+    range = std::min<float>(range, n_ranges - 1);
+    const int c = std::min(static_cast<int>(beam), n_beams - 2);
+    const int r = std::min(static_cast<int>(range), n_ranges - 2);
+    const double fx = beam - c;
+    const double fy = range - r;
+    if (method == Method::NEAREST) {
+      if (std::abs(fx - .5) > 1. / 256 && std::abs(fy - .5) > 1. / 256) {  // Otherwise either neighbour
+        EXPECT_EQ(scalar[i], polar.at<Sample>(fy < .5 ? r : r + 1, fx < .5 ? c : c + 1)) << "pixel " << i;
+      }
+    } else {
+      const double expected = (polar.at<Sample>(r, c) * (1. - fx) + polar.at<Sample>(r, c + 1) * fx) * (1. - fy) +
+                              (polar.at<Sample>(r + 1, c) * (1. - fx) + polar.at<Sample>(r + 1, c + 1) * fx) * fy;
+      EXPECT_NEAR(scalar[i], expected, 1. + max_value / 256.) << "pixel " << i;
+    }
+  }
+}
+
+TEST(FanInterpolation, MethodFromString) {
+  Method method = Method::CUBIC;
+  EXPECT_TRUE(fan_interpolation::methodFromString("nearest", method));
+  EXPECT_EQ(method, Method::NEAREST);
+  EXPECT_TRUE(fan_interpolation::methodFromString("bilinear", method));
+  EXPECT_EQ(method, Method::BILINEAR);
+  EXPECT_TRUE(fan_interpolation::methodFromString("area", method));
+  EXPECT_EQ(method, Method::AREA);
+  EXPECT_TRUE(fan_interpolation::methodFromString("cubic", method));
+  EXPECT_EQ(method, Method::CUBIC);
+  EXPECT_FALSE(fan_interpolation::methodFromString("lanczos", method));
+}
+
+TEST(FanInterpolation, Supported) {
+  EXPECT_TRUE(fan_interpolation::supported(4, 2));
+  EXPECT_FALSE(fan_interpolation::supported(3, 100));
+  EXPECT_FALSE(fan_interpolation::supported(256, 1));
+  EXPECT_FALSE(fan_interpolation::supported(0x10000, 100));
+}
+
+TEST(FanInterpolation, VectorizedRemapMatchesScalar) {
+  for (int n_beams : {4, 5, 256, 512}) {
+    for (bool has_gains : {false, true}) {
+      for (Method method : {Method::NEAREST, Method::BILINEAR}) {
+        expectRemap<uint8_t>(n_beams, 7, has_gains, method);
+        expectRemap<uint16_t>(n_beams, 7, has_gains, method);
+      }
+    }
+  }
+}
+
+template <class Sample>
+void expectAverageBeams(bool has_gains) {
+  std::mt19937 generator(3);
+  const int n_beams = 37;
+  const int n_ranges = 6;
+  const Polar polar = Polar::random<Sample>(n_beams, n_ranges, has_gains, generator);
+  const std::vector<int> half_beams{0, 1, 2, 5, 36, 100};  // Up to wider than the row
+  std::vector<Sample> out(static_cast<std::size_t>(n_beams) * n_ranges);
+  fan_interpolation::averageBeams<Sample>(polar.samples(), polar.step, n_beams, n_ranges, half_beams, out.data());
+  for (int r = 0; r < n_ranges; ++r) {
+    for (int b = 0; b < n_beams; ++b) {
+      const int first = std::max(b - half_beams[r], 0);
+      const int last = std::min(b + half_beams[r], n_beams - 1);
+      double sum = 0.;
+      for (int i = first; i <= last; ++i) {
+        sum += polar.at<Sample>(r, i);
+      }
+      // Rounded to nearest, ties up
+      EXPECT_EQ(out[r * n_beams + b], static_cast<Sample>(std::floor(sum / (last - first + 1) + .5)))
+          << "sample (" << r << ", " << b << ")";
+    }
+  }
+}
+
+TEST(FanInterpolation, AverageBeams) {
+  expectAverageBeams<uint8_t>(false);
+  expectAverageBeams<uint8_t>(true);
+  expectAverageBeams<uint16_t>(true);
+}
+
+}  // namespace
@@ -0,0 +1,153 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <oculus_ros2/gain_compensation.hpp>
+
+namespace {
+
+// Rows of a ping image: a little-endian gain followed by n_beams random samples of type In
+template <class In>
+std::vector<uint8_t> makeRows(int n_ranges, int n_beams, int& step) {
+  step = 4 + n_beams * static_cast<int>(sizeof(In));
+  std::vector<uint8_t> rows(static_cast<std::size_t>(n_ranges) * step);
+  std::mt19937 rng(n_ranges * 1000 + n_beams);
+  for (int r = 0; r < n_ranges; ++r) {
+    uint8_t* row = rows.data() + static_cast<std::size_t>(r) * step;
+    const uint32_t gain = r == 0 ? 0 : 1 + rng() % 100000;  // A null gain is compensated as 1
+    std::memcpy(row, &gain, sizeof(gain));
+    for (int b = 4; b < step; ++b) {
+      row[b] = static_cast<uint8_t>(rng());
+    }
+  }
+  return rows;
+}
+
+// The vectorized kernels match the scalar reference, tails of the rows included
+template <class In, class Out>
+void expectMatchesScalar(double tolerance) {
+  for (const int n_beams : {1, 7, 8, 15, 16, 33, 256, 512}) {
+    const int n_ranges = 11;
+    int step;
+    const std::vector<uint8_t> rows = makeRows<In>(n_ranges, n_beams, step);
+    std::vector<Out> vectorized(static_cast<std::size_t>(n_ranges) * n_beams);
+    std::vector<Out> scalar(vectorized.size());
+    gain_compensation::compensate<In>(rows.data(), step, n_ranges, n_beams, vectorized.data());
+    gain_compensation::compensateScalar<In>(rows.data(), step, n_ranges, n_beams, scalar.data());
+    for (std::size_t i = 0; i < scalar.size(); ++i) {
+      ASSERT_NEAR(static_cast<double>(vectorized[i]), static_cast<double>(scalar[i]), tolerance)
+          << n_beams << " beams, sample " << i;
+    }
+  }
+}
+
+TEST(GainCompensation, ModeFromString) {
+  gain_compensation::Mode mode;
+  ASSERT_TRUE(gain_compensation::modeFromString("off", mode));
+  EXPECT_EQ(mode, gain_compensation::Mode::OFF);
+  ASSERT_TRUE(gain_compensation::modeFromString("float", mode));
+  EXPECT_EQ(mode, gain_compensation::Mode::FLOAT);
+  ASSERT_TRUE(gain_compensation::modeFromString("8bit", mode));
+  EXPECT_EQ(mode, gain_compensation::Mode::UINT8);
+  ASSERT_TRUE(gain_compensation::modeFromString("16bit", mode));
+  EXPECT_EQ(mode, gain_compensation::Mode::UINT16);
+  EXPECT_FALSE(gain_compensation::modeFromString("32bit", mode));
+}
+
+TEST(GainCompensation, RowGainIsLittleEndian) {
+  const uint8_t row[4] = {0x78, 0x56, 0x34, 0x12};
+  EXPECT_EQ(gain_compensation::rowGain(row), 0x12345678u);
+}
+
+TEST(GainCompensation, ScalarDividesBySqrtGain) {
+  const int n_beams = 3;
+  const int step = 4 + n_beams;
+  std::vector<uint8_t> rows(2 * step);
+  const uint32_t gains[2] = {4, 100};
+  for (int r = 0; r < 2; ++r) {
+    std::memcpy(rows.data() + r * step, &gains[r], sizeof(uint32_t));
+    rows[r * step + 4] = 0;
+    rows[r * step + 5] = 100;
+    rows[r * step + 6] = 255;
+  }
+  std::vector<float> out(2 * n_beams);
+  gain_compensation::compensateScalar<uint8_t>(rows.data(), step, 2, n_beams, out.data());
+  const float expected[6] = {0.f, 50.f, 127.5f, 0.f, 10.f, 25.5f};
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_FLOAT_EQ(out[i], expected[i]);
+  }
+}
+
+TEST(GainCompensation, VectorizedMatchesScalar) {
+  expectMatchesScalar<uint8_t, float>(1e-3);
+  expectMatchesScalar<uint8_t, uint8_t>(1.);
+  expectMatchesScalar<uint8_t, uint16_t>(1.);
+  expectMatchesScalar<uint16_t, float>(1e-1);
+  expectMatchesScalar<uint16_t, uint8_t>(1.);
+  expectMatchesScalar<uint16_t, uint16_t>(1.);
+}
+
+// The rows follow the sonar message header, at any offset
+template <class In>
+void expectUnalignedRows() {
+  const int n_ranges = 5;
+  const int n_beams = 37;
+  int step;
+  const std::vector<uint8_t> rows = makeRows<In>(n_ranges, n_beams, step);
+  std::vector<uint8_t> shifted(rows.size() + 1);
+  std::copy(rows.begin(), rows.end(), shifted.begin() + 1);
+  std::vector<float> expected(static_cast<std::size_t>(n_ranges) * n_beams);
+  std::vector<float> vectorized(expected.size());
+  std::vector<float> scalar(expected.size());
+  gain_compensation::compensateScalar<In>(rows.data(), step, n_ranges, n_beams, expected.data());
+  gain_compensation::compensate<In>(shifted.data() + 1, step, n_ranges, n_beams, vectorized.data());
+  gain_compensation::compensateScalar<In>(shifted.data() + 1, step, n_ranges, n_beams, scalar.data());
+  EXPECT_EQ(scalar, expected);
+  for (std::size_t i = 0; i < expected.size(); ++i) {
+    ASSERT_NEAR(vectorized[i], expected[i], 1e-1) << "sample " << i;
+  }
+}
+
+TEST(GainCompensation, UnalignedRows) {
+  expectUnalignedRows<uint8_t>();
+  expectUnalignedRows<uint16_t>();
+}
+
+}  // namespace
@@ -0,0 +1,204 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <oculus_ros2/oculus_file_reader.hpp>
+
+namespace {
+
+// Builds .oculus files in memory: file header then items with a packed (30 bytes) or natural (40 bytes) item header.
+class LogWriter {
+public:
+  LogWriter() {
+    append<uint32_t>(oculus::LOG_FILE_MAGIC);
+    append<uint32_t>(16);  // File header size
+    append<uint64_t>(0);
+  }
+
+  void item(const std::vector<uint8_t>& payload, double time, bool packed, uint16_t compression = 0) {
+    const std::size_t start = bytes.size();
+    bytes.resize(start + (packed ? 30 : 40), 0);
+    write<uint32_t>(start, oculus::LOG_ITEM_MAGIC);
+    write<uint32_t>(start + 4, packed ? 30 : 40);
+    write<double>(start + (packed ? 12 : 16), time);
+    write<uint16_t>(start + (packed ? 20 : 24), compression);
+    write<uint32_t>(start + (packed ? 26 : 32), static_cast<uint32_t>(payload.size()));
+    bytes.insert(bytes.end(), payload.begin(), payload.end());
+  }
+
+  std::string save(const std::string& name) const {
+    const std::string path = ::testing::TempDir() + name + "_" + std::to_string(::getpid()) + ".oculus";
+    std::remove(oculus::OculusFileReader::indexPath(path).c_str());
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    return path;
+  }
+
+  template <class T>
+  void append(T value) {
+    bytes.resize(bytes.size() + sizeof(T));
+    write<T>(bytes.size() - sizeof(T), value);
+  }
+
+  template <class T>
+  void write(std::size_t offset, T value) {
+    std::memcpy(bytes.data() + offset, &value, sizeof(T));
+  }
+
+  std::vector<uint8_t> bytes;
+};
+
+const std::vector<uint8_t> PAYLOAD_A{1, 2, 3, 4, 5};
+const std::vector<uint8_t> PAYLOAD_B{6, 7, 8};
+
+TEST(OculusFileReader, ReadsPackedAndNaturalItems) {
+  LogWriter log;
+  log.item(PAYLOAD_A, 1.5, true);
+  log.item(PAYLOAD_B, 2.5, false);
+  log.item(PAYLOAD_A, 3.5, true, 1);  // Compressed items are skipped
+  const std::string path = log.save("mixed");
+
+  oculus::OculusFileReader reader(path, false);
+  ASSERT_EQ(reader.size(), 2u);
+  oculus::RecordedMessage message;
+  ASSERT_TRUE(reader.next(message));
+  EXPECT_EQ(message.data, PAYLOAD_A);
+  EXPECT_EQ(message.time, 1.5);
+  ASSERT_TRUE(reader.next(message));
+  EXPECT_EQ(message.data, PAYLOAD_B);
+  EXPECT_EQ(message.time, 2.5);
+  EXPECT_FALSE(reader.next(message));
+  std::remove(path.c_str());
+}
+
+TEST(OculusFileReader, StopsAtATruncatedItemHeader) {
+  LogWriter log;
+  log.item(PAYLOAD_A, 1.0, true);
+  log.item({}, 2.0, false);
+  log.bytes.resize(log.bytes.size() - 8);  // Natural header cut before its payload_size
+  const std::string path = log.save("truncated_header");
+
+  oculus::OculusFileReader reader(path, false);
+  EXPECT_EQ(reader.size(), 1u);
+  std::remove(path.c_str());
+}
+
+TEST(OculusFileReader, RejectsAnItemHeaderTooShortForItsFields) {
+  LogWriter log;
+  log.item(PAYLOAD_A, 1.0, true);
+  log.item(PAYLOAD_B, 2.0, false);
+  log.write<uint32_t>(log.bytes.size() - PAYLOAD_B.size() - 40 + 4, 32);  // Neither packed nor natural
+  const std::string path = log.save("short_header");
+
+  oculus::OculusFileReader reader(path, false);
+  EXPECT_EQ(reader.size(), 1u);
+  std::remove(path.c_str());
+}
+
+TEST(OculusFileReader, StopsAtATruncatedPayload) {
+  LogWriter log;
+  log.item(PAYLOAD_A, 1.0, false);
+  log.item(PAYLOAD_B, 2.0, false);
+  log.bytes.pop_back();
+  const std::string path = log.save("truncated_payload");
+
+  oculus::OculusFileReader reader(path, false);
+  EXPECT_EQ(reader.size(), 1u);
+  std::remove(path.c_str());
+}
+
+TEST(OculusFileReader, ReusesItsIndex) {
+  LogWriter log;
+  log.item(PAYLOAD_A, 1.0, true);
+  log.item(PAYLOAD_B, 2.0, false);
+  const std::string path = log.save("index");
+
+  { oculus::OculusFileReader reader(path); }
+  oculus::OculusFileReader reader(path);
+  EXPECT_TRUE(reader.indexWasLoaded());
+  ASSERT_EQ(reader.size(), 2u);
+  EXPECT_EQ(reader.message(1).size, PAYLOAD_B.size());
+  std::remove(oculus::OculusFileReader::indexPath(path).c_str());
+  std::remove(path.c_str());
+}
+
+// Rewrites a field of the index file: magic, version, file size, mtime then count (8 bytes, at 24), then the entries.
+template <class T>
+void patchIndex(const std::string& path, std::streamoff offset, T value) {
+  std::fstream file(oculus::OculusFileReader::indexPath(path), std::ios::binary | std::ios::in | std::ios::out);
+  file.seekp(offset);
+  file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+TEST(OculusFileReader, RescansOnACorruptedIndexCount) {
+  LogWriter log;
+  log.item(PAYLOAD_A, 1.0, true);
+  log.item(PAYLOAD_B, 2.0, false);
+  const std::string path = log.save("index_count");
+
+  { oculus::OculusFileReader reader(path); }
+  patchIndex<uint64_t>(path, 24, uint64_t(1) << 60);
+  oculus::OculusFileReader reader(path);
+  EXPECT_FALSE(reader.indexWasLoaded());
+  EXPECT_EQ(reader.size(), 2u);
+  std::remove(oculus::OculusFileReader::indexPath(path).c_str());
+  std::remove(path.c_str());
+}
+
+TEST(OculusFileReader, RescansOnAnIndexEntryPastTheFile) {
+  LogWriter log;
+  log.item(PAYLOAD_A, 1.0, true);
+  log.item(PAYLOAD_B, 2.0, false);
+  const std::string path = log.save("index_entry");
+
+  { oculus::OculusFileReader reader(path); }
+  const std::streamoff second_entry = 32 + sizeof(oculus::OculusFileReader::IndexEntry);
+  patchIndex<uint64_t>(path, second_entry, ~uint64_t(0) - 1);  // offset + size would wrap around
+  oculus::OculusFileReader reader(path);
+  EXPECT_FALSE(reader.indexWasLoaded());
+  ASSERT_EQ(reader.size(), 2u);
+  EXPECT_EQ(reader.message(1).size, PAYLOAD_B.size());
+  std::remove(oculus::OculusFileReader::indexPath(path).c_str());
+  std::remove(path.c_str());
+}
+
+}  // namespace
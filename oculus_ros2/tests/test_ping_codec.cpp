@@ -0,0 +1,239 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include <oculus_ros2/ping_codec.hpp>
+
+namespace {
+
+const std::size_t PREFIX_SIZE = 137;  // Sonar message before the image, compressed as it is
+
+// Ping data: random prefix, increasing gains, smooth image with speckle (correlated rows, for the delta)
+std::vector<uint8_t> pingData(const ping_codec::Layout& layout, unsigned seed) {
+  std::mt19937 generator(seed);
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::uniform_int_distribution<int> speckle(-20, 20);
+  std::vector<uint8_t> data(PREFIX_SIZE + static_cast<std::size_t>(layout.n_ranges) * layout.step);
+  for (std::size_t i = 0; i < PREFIX_SIZE; ++i) {
+    data[i] = static_cast<uint8_t>(byte(generator));
+  }
+  const int max_value = layout.sample_size == 1 ? 255 : 65535;
+  for (int r = 0; r < layout.n_ranges; ++r) {
+    uint8_t* row = data.data() + PREFIX_SIZE + static_cast<std::size_t>(r) * layout.step;
+    if (layout.has_gains) {
+      const uint32_t gain = 1000u + 37u * r;
+      std::memcpy(row, &gain, sizeof(gain));
+      row += sizeof(gain);
+    }
+    for (int b = 0; b < layout.n_beams; ++b) {
+      const double level = (.5 + .4 * std::sin(.05 * r + .1 * b)) * max_value;
+      const int sample = std::min(std::max(static_cast<int>(level) + speckle(generator) * (max_value / 255), 0), max_value);
+      if (layout.sample_size == 1) {
+        row[b] = static_cast<uint8_t>(sample);
+      } else {
+        const uint16_t value = static_cast<uint16_t>(sample);
+        std::memcpy(row + 2 * b, &value, sizeof(value));
+      }
+    }
+  }
+  // Saturated samples, rounded down by the lossy mode
+  std::fill(data.end() - layout.step / 2, data.end(), 255);
+  return data;
+}
+
+// Expected result of the lossy mode: the samples rounded to their bits most significant bits, the rest unchanged
+std::vector<uint8_t> quantized(std::vector<uint8_t> data, const ping_codec::Layout& layout, int bits) {
+  const int shift = 8 * layout.sample_size - bits;
+  const int half = 1 << (shift - 1);
+  const int max_value = (layout.sample_size == 1 ? 255 : 65535) >> shift;
+  for (int r = 0; r < layout.n_ranges; ++r) {
+    uint8_t* row = data.data() + PREFIX_SIZE + static_cast<std::size_t>(r) * layout.step + (layout.has_gains ? 4 : 0);
+    for (int b = 0; b < layout.n_beams; ++b) {
+      if (layout.sample_size == 1) {
+        row[b] = static_cast<uint8_t>(std::min((row[b] + half) >> shift, max_value) << shift);
+      } else {
+        uint16_t value;
+        std::memcpy(&value, row + 2 * b, sizeof(value));
+        value = static_cast<uint16_t>(std::min((value + half) >> shift, max_value) << shift);
+        std::memcpy(row + 2 * b, &value, sizeof(value));
+      }
+    }
+  }
+  return data;
+}
+
+ping_codec::Layout makeLayout(int sample_size, bool has_gains) {
+  const int n_beams = 64;
+  return ping_codec::Layout{50, n_beams, n_beams * sample_size + (has_gains ? 4 : 0), sample_size, has_gains};
+}
+
+void expectRoundTrip(const ping_codec::Parameters& parameters, const ping_codec::Layout& layout) {
+  SCOPED_TRACE(::testing::Message() << ping_codec::toString(parameters.format) << " bits " << parameters.bits << " delta "
+                                    << parameters.delta << " sample size " << layout.sample_size << " gains "
+                                    << layout.has_gains);
+  const std::vector<uint8_t> data = pingData(layout, 7);
+  ping_codec::Encoder encoder(parameters);
+  ping_codec::Decoder decoder;
+  std::vector<uint8_t> compressed;
+  std::vector<uint8_t> decoded;
+  for (int i = 0; i < 2; ++i) {  // The buffers reused by the encoder and the decoder do not leak into the next ping
+    const int bits = encoder.encode(data.data(), data.size(), layout, compressed);
+    ping_codec::Parameters decoding = parameters;
+    decoding.bits = bits;
+    decoder.decode(compressed.data(), compressed.size(), decoding, layout, data.size(), decoded);
+    const bool lossy = parameters.bits > 0 && parameters.bits < 8 * layout.sample_size;
+    EXPECT_EQ(bits, lossy ? parameters.bits : 0);
+    ASSERT_EQ(decoded.size(), data.size());
+    EXPECT_TRUE(decoded == (lossy ? quantized(data, layout, bits) : data));
+  }
+}
+
+TEST(PingCodec, FormatFromString) {
+  ping_codec::Format format = ping_codec::Format::LZ4;
+  EXPECT_TRUE(ping_codec::formatFromString("zstd", format));
+  EXPECT_EQ(format, ping_codec::Format::ZSTD);
+  EXPECT_TRUE(ping_codec::formatFromString(ping_codec::toString(ping_codec::Format::LZ4), format));
+  EXPECT_EQ(format, ping_codec::Format::LZ4);
+  EXPECT_FALSE(ping_codec::formatFromString("gzip", format));
+}
+
+TEST(PingCodec, LosslessRoundTrip) {
+  for (ping_codec::Format format : {ping_codec::Format::LZ4, ping_codec::Format::ZSTD}) {
+    for (bool delta : {false, true}) {
+      for (int sample_size : {1, 2}) {
+        for (bool has_gains : {false, true}) {
+          expectRoundTrip(ping_codec::Parameters{format, 1, 0, delta}, makeLayout(sample_size, has_gains));
+          // As many bits as the samples: lossless
+          expectRoundTrip(ping_codec::Parameters{format, 1, 8 * sample_size, delta}, makeLayout(sample_size, has_gains));
+        }
+      }
+    }
+  }
+}
+
+TEST(PingCodec, LossyRoundTrip) {
+  for (ping_codec::Format format : {ping_codec::Format::LZ4, ping_codec::Format::ZSTD}) {
+    for (bool delta : {false, true}) {
+      for (bool has_gains : {false, true}) {
+        expectRoundTrip(ping_codec::Parameters{format, 1, 5, delta}, makeLayout(1, has_gains));
+        expectRoundTrip(ping_codec::Parameters{format, 1, 6, delta}, makeLayout(2, has_gains));  // Single byte plane
+        expectRoundTrip(ping_codec::Parameters{format, 1, 12, delta}, makeLayout(2, has_gains));
+      }
+    }
+  }
+}
+
+TEST(PingCodec, InconsistentLayoutIsLossless) {
+  ping_codec::Layout layout = makeLayout(1, true);
+  const std::vector<uint8_t> data = pingData(layout, 8);
+  layout.step += 1;  // Does not match the beams
+  ping_codec::Encoder encoder(ping_codec::Parameters{ping_codec::Format::ZSTD, 1, 4, true});
+  std::vector<uint8_t> compressed;
+  EXPECT_EQ(encoder.encode(data.data(), data.size(), layout, compressed), 0);
+  ping_codec::Decoder decoder;
+  std::vector<uint8_t> decoded;
+  decoder.decode(compressed.data(), compressed.size(), ping_codec::Parameters{ping_codec::Format::ZSTD, 1, 0, true}, layout,
+      data.size(), decoded);
+  EXPECT_TRUE(decoded == data);
+
+  // Image followed by trailing bytes
+  layout = makeLayout(1, true);
+  layout.offset = PREFIX_SIZE;
+  std::vector<uint8_t> trailed = data;
+  trailed.resize(data.size() + 16, 3);
+  EXPECT_EQ(encoder.encode(trailed.data(), trailed.size(), layout, compressed), 0);
+  decoder.decode(compressed.data(), compressed.size(), ping_codec::Parameters{ping_codec::Format::ZSTD, 1, 0, true}, layout,
+      trailed.size(), decoded);
+  EXPECT_TRUE(decoded == trailed);
+}
+
+TEST(PingCodec, MessageRoundTrip) {
+  const ping_codec::Layout layout = makeLayout(2, true);
+  oculus_interfaces::msg::Ping ping;
+  ping.ping_id = 42;
+  ping.range = 12.5;
+  ping.has_gains = layout.has_gains;
+  ping.n_ranges = static_cast<uint16_t>(layout.n_ranges);
+  ping.n_beams = static_cast<uint16_t>(layout.n_beams);
+  ping.step = static_cast<uint32_t>(layout.step);
+  ping.sample_size = static_cast<uint8_t>(layout.sample_size);
+  ping.image_offset = PREFIX_SIZE;
+  ping.bearings.assign(layout.n_beams, -7);
+  ping.ping_data = pingData(layout, 9);
+
+  ping_codec::Encoder encoder(ping_codec::Parameters{ping_codec::Format::LZ4, 1, 0, true});
+  oculus_interfaces::msg::CompressedPing msg;
+  encoder.encode(ping, msg);
+  EXPECT_TRUE(msg.ping.ping_data.empty());
+  EXPECT_EQ(msg.format, "lz4");
+  EXPECT_EQ(msg.ping_data_size, ping.ping_data.size());
+  EXPECT_LT(msg.data.size(), ping.ping_data.size());
+
+  ping_codec::Decoder decoder;
+  oculus_interfaces::msg::Ping decoded;
+  decoder.decode(msg, decoded);
+  EXPECT_EQ(decoded.ping_id, ping.ping_id);
+  EXPECT_EQ(decoded.range, ping.range);
+  EXPECT_EQ(decoded.bearings, ping.bearings);
+  EXPECT_EQ(decoded.image_offset, ping.image_offset);
+  EXPECT_TRUE(decoded.ping_data == ping.ping_data);
+}
+
+TEST(PingCodec, CorruptedDataThrows) {
+  const ping_codec::Layout layout = makeLayout(1, true);
+  const std::vector<uint8_t> data = pingData(layout, 10);
+  ping_codec::Decoder decoder;
+  std::vector<uint8_t> decoded;
+  for (ping_codec::Format format : {ping_codec::Format::LZ4, ping_codec::Format::ZSTD}) {
+    const ping_codec::Parameters parameters{format, 1, 0, true};
+    ping_codec::Encoder encoder(parameters);
+    std::vector<uint8_t> compressed;
+    encoder.encode(data.data(), data.size(), layout, compressed);
+    compressed.resize(compressed.size() / 2);
+    EXPECT_THROW(decoder.decode(compressed.data(), compressed.size(), parameters, layout, data.size(), decoded),
+        std::runtime_error);
+  }
+  ping_codec::Parameters parameters;
+  parameters.bits = 20;  // More than the samples
+  EXPECT_THROW(decoder.decode(data.data(), data.size(), parameters, layout, data.size(), decoded), std::runtime_error);
+}
+
+}  // namespace
@@ -0,0 +1,154 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include <oculus_ros2/ping_queue.hpp>
+
+namespace {
+
+TEST(PingQueue, PopsInOrder) {
+  PingQueue<int> queue(4, DropPolicy::DROP_OLDEST);
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_TRUE(queue.push(i));
+  }
+  EXPECT_EQ(queue.size(), 3u);
+  for (int i = 0; i < 3; ++i) {
+    int item = -1;
+    ASSERT_TRUE(queue.pop(item));
+    EXPECT_EQ(item, i);
+  }
+  EXPECT_EQ(queue.size(), 0u);
+  EXPECT_EQ(queue.dropped(), 0u);
+}
+
+TEST(PingQueue, DropOldestKeepsTheLatestPings) {
+  PingQueue<int> queue(3, DropPolicy::DROP_OLDEST);
+  for (int i = 0; i < 5; ++i) {
+    queue.push(i);
+  }
+  EXPECT_EQ(queue.size(), 3u);
+  EXPECT_EQ(queue.dropped(), 2u);
+  for (int expected : {2, 3, 4}) {
+    int item = -1;
+    ASSERT_TRUE(queue.pop(item));
+    EXPECT_EQ(item, expected);
+  }
+}
+
+TEST(PingQueue, DropNewestKeepsTheQueuedPings) {
+  PingQueue<int> queue(3, DropPolicy::DROP_NEWEST);
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_TRUE(queue.push(i));
+  }
+  EXPECT_FALSE(queue.push(3));
+  EXPECT_FALSE(queue.push(4));
+  EXPECT_EQ(queue.dropped(), 2u);
+  for (int expected : {0, 1, 2}) {
+    int item = -1;
+    ASSERT_TRUE(queue.pop(item));
+    EXPECT_EQ(item, expected);
+  }
+}
+
+TEST(PingQueue, WrapsAroundTheRing) {
+  PingQueue<int> queue(2, DropPolicy::DROP_OLDEST);
+  for (int i = 0; i < 7; ++i) {
+    queue.push(i);
+    int item = -1;
+    ASSERT_TRUE(queue.pop(item));
+    EXPECT_EQ(item, i);
+  }
+  EXPECT_EQ(queue.dropped(), 0u);
+}
+
+TEST(PingQueue, ReleasesPoppedPings) {
+  PingQueue<std::shared_ptr<int>> queue(2, DropPolicy::DROP_OLDEST);
+  auto ping = std::make_shared<int>(1);
+  queue.push(ping);
+  std::shared_ptr<int> item;
+  ASSERT_TRUE(queue.pop(item));
+  item.reset();
+  EXPECT_EQ(ping.use_count(), 1);  // The ring does not keep a reference
+}
+
+TEST(PingQueue, CloseDrainsThenStops) {
+  PingQueue<int> queue(4, DropPolicy::DROP_OLDEST);
+  queue.push(1);
+  queue.close();
+  EXPECT_FALSE(queue.push(2));  // Ignored once closed
+
+  int item = -1;
+  ASSERT_TRUE(queue.pop(item));
+  EXPECT_EQ(item, 1);
+  EXPECT_FALSE(queue.pop(item));
+}
+
+TEST(PingQueue, CloseWakesUpABlockedConsumer) {
+  PingQueue<int> queue(4, DropPolicy::DROP_OLDEST);
+  bool popped = true;
+  std::thread consumer([&] {
+    int item;
+    popped = queue.pop(item);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  queue.close();
+  consumer.join();
+  EXPECT_FALSE(popped);
+}
+
+TEST(PingQueue, HandsOverPingsBetweenThreads) {
+  const int n = 10000;
+  PingQueue<int> queue(8, DropPolicy::DROP_NEWEST);
+  std::thread producer([&] {
+    for (int i = 0; i < n; ++i) {
+      while (!queue.push(i)) {
+        std::this_thread::yield();  // Full, retried so that every ping goes through
+      }
+    }
+    queue.close();
+  });
+  int expected = 0;
+  int item;
+  while (queue.pop(item)) {
+    ASSERT_EQ(item, expected);
+    ++expected;
+  }
+  producer.join();
+  EXPECT_EQ(expected, n);
+}
+
+}  // namespace
@@ -0,0 +1,125 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <oculus_ros2/pipeline_stats.hpp>
+
+namespace {
+
+using Report = std::vector<std::pair<std::string, std::string>>;
+
+// Value of key in the report, empty if absent
+std::string value(const Report& report, const std::string& key) {
+  for (const std::pair<std::string, std::string>& entry : report) {
+    if (entry.first == key) {
+      return entry.second;
+    }
+  }
+  return "";
+}
+
+TEST(PipelineStats, EmptyWindow) {
+  const LatencyWindow window(16);
+  const LatencyWindow::Summary summary = window.summary();
+  EXPECT_EQ(summary.count, 0u);
+  EXPECT_EQ(summary.max, 0.);
+}
+
+TEST(PipelineStats, PercentilesOfAPartialWindow) {
+  LatencyWindow window(100);
+  for (int i = 10; i >= 1; --i) {  // Not sorted
+    window.add(i);
+  }
+  const LatencyWindow::Summary summary = window.summary();
+  EXPECT_EQ(summary.count, 10u);
+  EXPECT_EQ(summary.p50, 5.);
+  EXPECT_EQ(summary.p95, 10.);
+  EXPECT_EQ(summary.p99, 10.);
+  EXPECT_EQ(summary.max, 10.);
+}
+
+// Once full, the window keeps the last capacity samples
+TEST(PipelineStats, PercentilesOfAFullWindow) {
+  LatencyWindow window(100);
+  for (int i = 1; i <= 150; ++i) {
+    window.add(i);
+  }
+  const LatencyWindow::Summary summary = window.summary();
+  EXPECT_EQ(summary.count, 100u);
+  EXPECT_EQ(summary.p50, 100.);
+  EXPECT_EQ(summary.p95, 145.);
+  EXPECT_EQ(summary.p99, 149.);
+  EXPECT_EQ(summary.max, 150.);
+
+  const LatencyWindow::Summary relative = window.summary(true);
+  EXPECT_EQ(relative.p50, 49.);
+  EXPECT_EQ(relative.max, 99.);
+}
+
+TEST(PipelineStats, ReportStagesAndPingGaps) {
+  PipelineStats stats(64);
+  for (int i = 1; i <= 100; ++i) {
+    stats.record(PipelineStage::QUEUE, 1e-3 * i);
+  }
+  stats.record(PipelineStage::TRANSPORT, .010);
+  stats.record(PipelineStage::TRANSPORT, .012);
+  for (uint32_t ping_id : {1u, 2u, 5u, 6u, 4000000u, 4000001u}) {  // 3 and 4 lost, then a sonar restart
+    stats.recordPing(ping_id, 1000);
+  }
+
+  const Report report = stats.report();
+  EXPECT_EQ(value(report, "missing pings (ping_id gaps)"), "2");
+  EXPECT_EQ(value(report, "ping_id resets"), "1");
+  EXPECT_FALSE(value(report, "pings/s").empty());
+  // The last 64 samples: 37 to 100 ms
+  EXPECT_EQ(value(report, "queue p50 (ms)"), "68.000");
+  EXPECT_EQ(value(report, "queue p99 (ms)"), "100.000");
+  EXPECT_EQ(value(report, "queue max (ms)"), "100.000");
+  // Relative to the fastest transport, the sonar clock offset is unknown
+  EXPECT_EQ(value(report, "transport max (ms)"), "2.000");
+  // Stages without sample are left out
+  EXPECT_TRUE(value(report, "fan render p50 (ms)").empty());
+
+  // The windows are kept from one report to the other, the counters are reset
+  stats.record(PipelineStage::QUEUE, .2);
+  const Report next = stats.report();
+  EXPECT_EQ(value(next, "queue max (ms)"), "200.000");
+  EXPECT_EQ(value(next, "pings/s"), std::to_string(0.));
+  EXPECT_EQ(value(next, "missing pings (ping_id gaps)"), "2");
+}
+
+}  // namespace
@@ -0,0 +1,123 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+
+#include <oculus_ros2/sonar_clock.hpp>
+
+namespace {
+
+const uint64_t WRAP = uint64_t(1) << 32;  // us
+
+// Pings fired every period_us by a sonar clock running at (1 + drift) host seconds per second, received delay_ns later
+struct Sonar {
+  uint64_t date;  // Unwrapped sonar date (us)
+  int64_t host;  // Host time of the firing (ns)
+  double drift = 0.;
+  int64_t delay_ns = 5000000;
+
+  void advance(uint64_t elapsed_us) {
+    date += elapsed_us;
+    host += static_cast<int64_t>(1e3 * static_cast<double>(elapsed_us) * (1. + drift));
+  }
+  uint32_t firingDate() const { return static_cast<uint32_t>(date); }
+  int64_t reception() const { return host + delay_ns; }
+};
+
+TEST(SonarClock, FirstDateIsTheRawFiringDate) {
+  SonarClock clock;
+  EXPECT_FALSE(clock.initialized());
+  EXPECT_EQ(clock.update(123456789u, 1000000000), 123456789u);
+  EXPECT_TRUE(clock.initialized());
+  EXPECT_EQ(clock.resets(), 0u);
+}
+
+TEST(SonarClock, UnwrapsAcross32Bits) {
+  SonarClock clock;
+  Sonar sonar{WRAP - 2000000, 1000000000};  // 2 s before the wrap
+  for (int i = 0; i < 40; ++i) {
+    EXPECT_EQ(clock.update(sonar.firingDate(), sonar.reception()), sonar.date);
+    sonar.advance(100000);
+  }
+  EXPECT_GT(sonar.date, WRAP);
+  EXPECT_EQ(clock.resets(), 0u);
+}
+
+TEST(SonarClock, CountsTheWrapsMissedDuringASilence) {
+  SonarClock clock;
+  Sonar sonar{4000000000u, 1000000000};
+  EXPECT_EQ(clock.update(sonar.firingDate(), sonar.reception()), sonar.date);
+  sonar.advance(100000);
+  EXPECT_EQ(clock.update(sonar.firingDate(), sonar.reception()), sonar.date);
+  sonar.advance(2 * WRAP + 30000000);  // Standby of ~2h23
+  EXPECT_EQ(clock.update(sonar.firingDate(), sonar.reception()), sonar.date);
+  EXPECT_EQ(clock.resets(), 0u);
+}
+
+TEST(SonarClock, RestartsWithTheSonar) {
+  SonarClock clock;
+  Sonar sonar{3000000000u, 1000000000};
+  for (int i = 0; i < 10; ++i) {
+    clock.update(sonar.firingDate(), sonar.reception());
+    sonar.advance(100000);
+  }
+  // The sonar was power cycled: its clock starts again while the host time goes on
+  Sonar restarted{2000000, sonar.host + 5000000000};
+  EXPECT_EQ(clock.update(restarted.firingDate(), restarted.reception()), restarted.date);
+  EXPECT_EQ(clock.resets(), 1u);
+  restarted.advance(100000);
+  EXPECT_EQ(clock.update(restarted.firingDate(), restarted.reception()), restarted.date);
+  EXPECT_EQ(clock.resets(), 1u);
+}
+
+TEST(SonarClock, EstimatesTheFiringHostTime) {
+  SonarClock clock(1., 60);
+  Sonar sonar{WRAP - 10000000, 1000000000};
+  sonar.drift = 50e-6;
+  for (int i = 0; i < 1200; ++i) {  // 2 min at 10 Hz, across the wrap
+    // Jitter of the transport delay, the minimum being delay_ns
+    sonar.delay_ns = 5000000 + (i % 7) * 700000;
+    const uint64_t date = clock.update(sonar.firingDate(), sonar.reception());
+    ASSERT_EQ(date, sonar.date);
+    if (i > 100) {
+      // Late by the minimum transport delay, without the jitter
+      EXPECT_NEAR(static_cast<double>(clock.toHost(date) - sonar.host), 5e6, 2e5) << "ping " << i;
+    }
+    sonar.advance(100000);
+  }
+  EXPECT_NEAR(clock.drift(), 50e-6, 5e-6);
+  EXPECT_EQ(clock.resets(), 0u);
+}
+
+}  // namespace
@@ -0,0 +1,178 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include <oculus_ros2/sonar_config.hpp>
+
+namespace {
+
+SonarParameters defaultParameters() {
+  SonarParameters parameters{};
+  parameters.frequency_mode = 1;
+  parameters.ping_rate = pingRateNormal;
+  parameters.data_depth = 8;
+  parameters.gain_assist = false;
+  parameters.range = 5.;
+  parameters.gamma_correction = 153;
+  parameters.gain_percent = 50.;
+  parameters.sound_speed = 1500.;
+  parameters.use_salinity = false;
+  parameters.salinity = 0.;
+  return parameters;
+}
+
+std::vector<std::string> names(const std::vector<rclcpp::Parameter>& parameters) {
+  std::vector<std::string> result;
+  for (const rclcpp::Parameter& param : parameters) {
+    result.push_back(param.get_name());
+  }
+  return result;
+}
+
+TEST(SonarConfig, ChangesAreMergedByName) {
+  sonar_config::ParameterBatch batch(defaultParameters());
+  EXPECT_TRUE(batch.set({rclcpp::Parameter("range", 10.), rclcpp::Parameter("gain_percent", 60.)}).empty());
+  EXPECT_TRUE(batch.set({rclcpp::Parameter("range", 12.), rclcpp::Parameter("run", true)}).empty());
+  EXPECT_TRUE(batch.hasQueued());
+
+  // One entry per parameter, with its last value, in the order of the first change
+  const std::vector<rclcpp::Parameter> queued = batch.takeQueued();
+  EXPECT_EQ(names(queued), (std::vector<std::string>{"range", "gain_percent"}));
+  EXPECT_EQ(queued[0].as_double(), 12.);
+  EXPECT_FALSE(batch.hasQueued());
+  EXPECT_EQ(batch.parameters().range, 12.);
+  EXPECT_EQ(batch.parameters().gain_percent, 60.);
+}
+
+TEST(SonarConfig, UnknownParametersAreReturned) {
+  sonar_config::ParameterBatch batch(defaultParameters());
+  const std::vector<rclcpp::Parameter> unknown =
+      batch.set({rclcpp::Parameter("frame_id_size", 3), rclcpp::Parameter("nbeams", 1), rclcpp::Parameter("run", false)});
+  EXPECT_EQ(names(unknown), std::vector<std::string>{"frame_id_size"});
+  EXPECT_EQ(names(batch.takeQueued()), std::vector<std::string>{"nbeams"});
+}
+
+// The batch gives the config sent to the sonar, the fields which are not parameters come from the current config
+TEST(SonarConfig, BatchToConfig) {
+  sonar_config::ParameterBatch batch(defaultParameters());
+  batch.set({rclcpp::Parameter("frequency_mode", 2), rclcpp::Parameter("data_depth", 16), rclcpp::Parameter("nbeams", 1)});
+  batch.set({rclcpp::Parameter("gain_assist", true), rclcpp::Parameter("range", 30.), rclcpp::Parameter("sound_speed", 1480.)});
+  batch.set({rclcpp::Parameter("data_depth", 8)});
+
+  oculus::SonarDriver::PingConfig base{};
+  base.networkSpeed = 0xff;
+  base.flags = flagByte::SIMPLE_PING | flagByte::DATA_DEPTH;
+  const oculus::SonarDriver::PingConfig config = sonar_config::toConfig(batch.parameters(), base);
+  EXPECT_EQ(config.masterMode, 2);
+  EXPECT_EQ(config.pingRate, pingRateNormal);
+  EXPECT_EQ(config.networkSpeed, 0xff);
+  // Copies of the fields of the packed message, not references
+  EXPECT_EQ(static_cast<double>(config.range), 30.);
+  EXPECT_EQ(static_cast<double>(config.gainPercent), 50.);
+  EXPECT_EQ(static_cast<double>(config.speedOfSound), 1480.);
+  EXPECT_EQ(config.flags, flagByte::SIMPLE_PING | flagByte::NBEAMS | flagByte::GAIN_ASSIST);  // 8 bits again
+
+  batch.set({rclcpp::Parameter("use_salinity", true)});
+  EXPECT_EQ(static_cast<double>(sonar_config::toConfig(batch.parameters(), base).speedOfSound), 0.);  // Computed by the sonar
+
+  // And back: the parameters applied by the sonar
+  const SonarParameters applied = sonar_config::fromConfig(config, batch.parameters());
+  EXPECT_EQ(applied.frequency_mode, 2);
+  EXPECT_EQ(applied.nbeams, 1);
+  EXPECT_EQ(applied.data_depth, 8);
+  EXPECT_TRUE(applied.gain_assist);
+  EXPECT_EQ(applied.range, 30.);
+  EXPECT_TRUE(applied.use_salinity);
+}
+
+// The values set from the sonar go through the ROS parameters callback, but are not sent back to the sonar
+TEST(SonarConfig, SonarValuesAreNotQueued) {
+  sonar_config::ParameterBatch batch(defaultParameters());
+  batch.set({rclcpp::Parameter("gamma_correction", 100)});  // Queued by the user
+  SonarParameters sonar = defaultParameters();
+  sonar.range = 5.04;  // Rounded by the sonar, within half a step
+  sonar.gain_percent = 42.;
+  sonar.data_depth = 16;
+
+  int calls = 0;
+  const std::vector<rclcpp::Parameter> changed =
+      batch.applySonarValues(sonar, [&](const std::vector<rclcpp::Parameter>& parameters) {
+        ++calls;
+        EXPECT_TRUE(batch.applyingSonarValues());
+        EXPECT_TRUE(batch.set(parameters).empty());
+      });
+  EXPECT_EQ(calls, 1);
+  EXPECT_FALSE(batch.applyingSonarValues());
+  EXPECT_EQ(names(changed), (std::vector<std::string>{"gain_percent", "gamma_correction", "data_depth"}));
+  EXPECT_EQ(batch.parameters().range, 5.);
+  EXPECT_EQ(batch.parameters().gain_percent, 42.);
+  EXPECT_EQ(batch.parameters().gamma_correction, 153);
+  EXPECT_EQ(batch.parameters().data_depth, 16);
+  // Only the change of the user is left to send
+  EXPECT_EQ(names(batch.takeQueued()), std::vector<std::string>{"gamma_correction"});
+
+  EXPECT_TRUE(batch.applySonarValues(sonar, [&](const std::vector<rclcpp::Parameter>&) { ++calls; }).empty());
+  EXPECT_EQ(calls, 1);  // Nothing to set
+}
+
+// The sonar feedback is matched with the changed parameters by name
+TEST(SonarConfig, FeedbackMatchedByName) {
+  oculus::SonarDriver::PingConfig requested{};
+  requested.masterMode = 2;
+  requested.range = 30.;
+  requested.gainPercent = 50.;
+  requested.flags = flagByte::DATA_DEPTH;
+  oculus::SonarDriver::PingConfig feedback = requested;
+  feedback.range = 20.;  // Clamped by the sonar
+  feedback.gainPercent = 45.;  // Side effect
+  feedback.flags = 0;
+
+  const std::vector<rclcpp::Parameter> changed{rclcpp::Parameter("gain_assist", false), rclcpp::Parameter("range", 30.)};
+  const std::vector<sonar_config::Mismatch> mismatches = sonar_config::compareFeedback(changed, requested, feedback);
+  ASSERT_EQ(mismatches.size(), 3u);
+  EXPECT_EQ(mismatches[0].name, "data_depth");
+  EXPECT_EQ(mismatches[0].requested, 16.);
+  EXPECT_EQ(mismatches[0].applied, 8.);
+  EXPECT_FALSE(mismatches[0].changed);
+  EXPECT_EQ(mismatches[1].name, "range");
+  EXPECT_TRUE(mismatches[1].changed);
+  EXPECT_EQ(mismatches[2].name, "gain_percent");
+  EXPECT_FALSE(mismatches[2].changed);  // Not reported against the first changed parameter
+
+  EXPECT_TRUE(sonar_config::compareFeedback({}, requested, feedback).empty());  // Whole config
+}
+
+}  // namespace
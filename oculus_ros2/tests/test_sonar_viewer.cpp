@@ -0,0 +1,341 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <oculus_interfaces/msg/ping.hpp>
+#include <oculus_ros2/sonar_viewer.hpp>
+#include <rclcpp/rclcpp.hpp>
+#include <sensor_msgs/msg/image.hpp>
+
+// Heap allocations are counted by replacing the global allocation functions, the size of the largest one is kept.
+static std::atomic<std::size_t> allocation_count{0};
+static std::atomic<std::size_t> largest_allocation{0};
+
+void* operator new(std::size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  std::size_t largest = largest_allocation.load(std::memory_order_relaxed);
+  while (size > largest && !largest_allocation.compare_exchange_weak(largest, size)) {
+  }
+  if (void* p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+namespace {
+
+// Heap allocations made by f
+template <class F>
+std::size_t countAllocations(F&& f, std::size_t* largest = nullptr) {
+  largest_allocation = 0;
+  const std::size_t before = allocation_count.load();
+  f();
+  if (largest != nullptr) {
+    *largest = largest_allocation.load();
+  }
+  return allocation_count.load() - before;
+}
+
+// 8 bits ping with gains and a non uniform bearing table, the ping data starting with a (zeroed) sonar header
+oculus_interfaces::msg::Ping makePing(int n_beams, int n_ranges) {
+  const std::size_t header_size = 256;
+  oculus_interfaces::msg::Ping ping;
+  ping.n_beams = static_cast<uint16_t>(n_beams);
+  ping.n_ranges = static_cast<uint16_t>(n_ranges);
+  ping.sample_size = 1;
+  ping.has_gains = true;
+  ping.step = n_beams + 4;
+  ping.image_offset = header_size;
+  ping.master_mode = 1;
+  ping.range_resolution = 20. / n_ranges;
+  ping.header.frame_id = "sonar";
+  for (int i = 0; i < n_beams; ++i) {
+    const double x = 2. * i / (n_beams - 1) - 1.;
+    ping.bearings.push_back(static_cast<int16_t>(std::lround(6500. * std::sin(x * M_PI / 2.))));
+  }
+  ping.ping_data.resize(header_size + static_cast<std::size_t>(n_ranges) * ping.step);
+  for (int r = 0; r < n_ranges; ++r) {
+    uint8_t* row = ping.ping_data.data() + header_size + static_cast<std::size_t>(r) * ping.step;
+    const uint32_t gain = 1 + static_cast<uint32_t>(r) * 16;
+    std::memcpy(row, &gain, sizeof(gain));
+    for (int b = 0; b < n_beams; ++b) {
+      row[4 + b] = static_cast<uint8_t>((r * 31 + b * 7) ^ (b >> 3));
+    }
+  }
+  return ping;
+}
+
+class SonarViewerTest : public ::testing::Test {
+protected:
+  static void SetUpTestSuite() { rclcpp::init(0, nullptr); }
+  static void TearDownTestSuite() { rclcpp::shutdown(); }
+
+  std::shared_ptr<rclcpp::Node> makeNode(
+      const std::string& interpolation, std::vector<rclcpp::Parameter> parameters = std::vector<rclcpp::Parameter>()) {
+    rclcpp::NodeOptions options;
+    parameters.emplace_back("interpolation", interpolation);
+    options.parameter_overrides(parameters);
+    return std::make_shared<rclcpp::Node>("sonar_viewer_test", options);
+  }
+};
+
+// Without subscriber, publishFan only keeps the remap tables up to date
+TEST_F(SonarViewerTest, PublishFanWithoutSubscriberDoesNotAllocate) {
+  auto node = makeNode("cubic");
+  SonarViewer viewer(node.get());
+  const oculus_interfaces::msg::Ping ping = makePing(256, 300);
+  viewer.publishFan(ping);  // Builds the remap tables
+
+  EXPECT_EQ(countAllocations([&] { viewer.publishFan(ping); }), 0u);
+}
+
+// The fan is remapped straight from the ping buffer into the reused image, once the tables are built
+TEST_F(SonarViewerTest, RenderFanIntoReusedImageDoesNotAllocate) {
+  for (const std::string& interpolation : {"nearest", "bilinear", "area"}) {
+    auto node = makeNode(interpolation);
+    SonarViewer viewer(node.get());
+    const oculus_interfaces::msg::Ping ping = makePing(256, 300);
+    sensor_msgs::msg::Image image;
+    ASSERT_TRUE(viewer.renderFan(ping, image));  // Builds the remap tables and sizes the image
+
+    EXPECT_EQ(countAllocations([&] { ASSERT_TRUE(viewer.renderFan(ping, image)); }), 0u) << interpolation;
+  }
+}
+
+// cv::remap allocates a small buffer of coordinates per stripe of the image, never a copy of the ping or of the image
+TEST_F(SonarViewerTest, RenderFanCubicDoesNotCopyTheImage) {
+  auto node = makeNode("cubic");
+  SonarViewer viewer(node.get());
+  const oculus_interfaces::msg::Ping ping = makePing(512, 700);
+  sensor_msgs::msg::Image image;
+  ASSERT_TRUE(viewer.renderFan(ping, image));
+
+  std::size_t largest = 0;
+  countAllocations([&] { ASSERT_TRUE(viewer.renderFan(ping, image)); }, &largest);
+  EXPECT_LT(largest, std::min(image.data.size(), ping.ping_data.size()));
+}
+
+// A decreasing bearing table (beams numbered from the right) gives the same fan as the mirrored ping
+TEST_F(SonarViewerTest, DecreasingBearingsGiveTheMirroredFan) {
+  auto node = makeNode("bilinear");
+  SonarViewer viewer(node.get());
+  const oculus_interfaces::msg::Ping ping = makePing(128, 200);
+  oculus_interfaces::msg::Ping mirrored = ping;
+  std::reverse(mirrored.bearings.begin(), mirrored.bearings.end());
+  for (int r = 0; r < ping.n_ranges; ++r) {
+    uint8_t* samples = mirrored.ping_data.data() + ping.image_offset + static_cast<std::size_t>(r) * ping.step + 4;
+    std::reverse(samples, samples + ping.n_beams);
+  }
+
+  sensor_msgs::msg::Image image;
+  sensor_msgs::msg::Image mirrored_image;
+  ASSERT_TRUE(viewer.renderFan(ping, image));
+  ASSERT_TRUE(viewer.renderFan(mirrored, mirrored_image));
+  ASSERT_EQ(mirrored_image.data.size(), image.data.size());
+  int max_difference = 0;
+  for (std::size_t i = 0; i < image.data.size(); ++i) {
+    max_difference = std::max(max_difference, std::abs(image.data[i] - mirrored_image.data[i]));
+  }
+  EXPECT_LE(max_difference, 1);  // Interpolation weights rounded to 1/256
+}
+
+// Bytes after the image do not shift the rows, the image starts at image_offset
+TEST_F(SonarViewerTest, TrailingBytesDoNotShiftTheImage) {
+  auto node = makeNode("nearest");
+  SonarViewer viewer(node.get());
+  const oculus_interfaces::msg::Ping ping = makePing(128, 200);
+  oculus_interfaces::msg::Ping trailed = ping;
+  trailed.ping_data.resize(ping.ping_data.size() + 24, 255);
+
+  sensor_msgs::msg::Image image;
+  sensor_msgs::msg::Image trailed_image;
+  ASSERT_TRUE(viewer.renderFan(ping, image));
+  ASSERT_TRUE(viewer.renderFan(trailed, trailed_image));
+  EXPECT_TRUE(trailed_image.data == image.data);
+
+  trailed.image_offset = static_cast<uint32_t>(trailed.ping_data.size());  // No room left for the image
+  EXPECT_FALSE(viewer.renderFan(trailed, trailed_image));
+}
+
+// A bearing table which is neither increasing nor decreasing is replaced by the linear aperture
+TEST_F(SonarViewerTest, NonMonotonicBearingsUseTheAperture) {
+  const oculus_interfaces::msg::Ping ping = makePing(64, 100);
+  std::vector<int16_t> bearings = ping.bearings;
+  std::swap(bearings[10], bearings[11]);
+  FanGeometry geometry{64, 100, 1, 65., FanRemapCache::hashBearings(bearings.data(), 64)};
+  geometry.interpolation = fan_interpolation::Method::NEAREST;
+  const std::shared_ptr<const FanRemap> remap = FanRemapCache::build(geometry, bearings.data());
+  EXPECT_TRUE(remap->bearings_ignored);
+
+  geometry.bearings_hash = 0;
+  const std::shared_ptr<const FanRemap> linear = FanRemapCache::build(geometry);
+  EXPECT_FALSE(linear->bearings_ignored);
+  EXPECT_EQ(remap->table.cells, linear->table.cells);
+  EXPECT_EQ(remap->table.weights, linear->table.weights);
+}
+
+// Remap tables of the linear aperture (no bearing table) for a region of 64 beams and 100 ranges
+std::shared_ptr<const FanRemap> buildRegion(const FanRegion& region) {
+  FanGeometry geometry{64, 100, 1, 65., 0};
+  geometry.region = region;
+  geometry.interpolation = fan_interpolation::Method::NEAREST;
+  return FanRemapCache::build(geometry);
+}
+
+// A region larger than the ping is clipped to its ranges and to the aperture
+TEST(FanRemapCache, RegionIsClippedToTheFan) {
+  const std::shared_ptr<const FanRemap> whole = buildRegion(FanRegion());
+  FanRegion region;
+  region.min_range = -10.f;
+  region.max_range = 1000.f;
+  region.min_bearing = -3.f;
+  region.max_bearing = 3.f;
+  const std::shared_ptr<const FanRemap> clipped = buildRegion(region);
+  EXPECT_EQ(clipped->image_size, whole->image_size);
+  EXPECT_EQ(clipped->table.cells, whole->table.cells);
+  EXPECT_EQ(whole->image_size.height, 100);  // One pixel per range, the furthest point is straight ahead
+}
+
+// A fitted image is the bounding box of the region, rounded out to whole pixels
+TEST(FanRemapCache, FittedImageIsTheBoundingBoxOfTheRegion) {
+  FanRegion region;
+  region.min_range = 50.f;
+  region.max_range = 100.f;
+  region.min_bearing = 0.1f;
+  region.max_bearing = 0.5f;
+  const std::shared_ptr<const FanRemap> remap = buildRegion(region);
+  EXPECT_EQ(remap->image_size.width, std::ceil(100 * std::sin(0.5)) - std::floor(50 * std::sin(0.1)));
+  EXPECT_EQ(remap->image_size.height, std::ceil(100 * std::cos(0.1)) - std::floor(50 * std::cos(0.5)));
+
+  region.pixel_size = 2.f;
+  const std::shared_ptr<const FanRemap> coarse = buildRegion(region);
+  EXPECT_EQ(coarse->image_size.width, std::ceil(50 * std::sin(0.5)) - std::floor(25 * std::sin(0.1)));
+  EXPECT_EQ(coarse->image_size.height, std::ceil(50 * std::cos(0.1)) - std::floor(25 * std::cos(0.5)));
+}
+
+// A fixed size is kept and centered on the region, the pixels around it get the border value
+TEST(FanRemapCache, FixedSizeIsCenteredOnTheRegion) {
+  FanRegion region;
+  region.min_range = 50.f;
+  region.max_range = 100.f;
+  region.min_bearing = 0.1f;
+  region.max_bearing = 0.5f;
+  region.width = 100;
+  region.height = 50;
+  const std::shared_ptr<const FanRemap> remap = buildRegion(region);
+  ASSERT_EQ(remap->image_size, cv::Size(100, 50));
+  EXPECT_GE(remap->table.cells[25 * 100 + 50], 0);  // Center of the bounding box
+  EXPECT_LT(remap->table.cells[0], 0);
+  EXPECT_LT(remap->table.cells[49 * 100 + 99], 0);
+}
+
+// A ping without beams or ranges has no fan
+TEST(FanRemapCache, EmptyPingGivesAnEmptyImage) {
+  for (const FanGeometry& geometry : {FanGeometry{0, 100, 1, 65., 0}, FanGeometry{64, 0, 1, 65., 0}}) {
+    const std::shared_ptr<const FanRemap> remap = FanRemapCache::build(geometry);
+    EXPECT_TRUE(remap->image_size.empty());
+    EXPECT_TRUE(remap->table.cells.empty());
+  }
+}
+
+TEST_F(SonarViewerTest, EmptyPingIsRejected) {
+  auto node = makeNode("nearest");
+  SonarViewer viewer(node.get());
+  sensor_msgs::msg::Image image;
+  EXPECT_FALSE(viewer.renderFan(makePing(0, 100), image));
+  EXPECT_EQ(viewer.remapCacheMisses(), 0u);
+}
+
+// The image_* parameters give the region and size of the fan, a fixed size is kept whatever the region
+TEST_F(SonarViewerTest, FixedImageSizeIsKept) {
+  auto node = makeNode("bilinear",
+      {rclcpp::Parameter("image_min_range", 2.), rclcpp::Parameter("image_max_range", 15.),
+          rclcpp::Parameter("image_min_bearing", -20.), rclcpp::Parameter("image_max_bearing", 10.),
+          rclcpp::Parameter("image_width", 320), rclcpp::Parameter("image_height", 240)});
+  SonarViewer viewer(node.get());
+  sensor_msgs::msg::Image image;
+  ASSERT_TRUE(viewer.renderFan(makePing(128, 300), image));
+  EXPECT_EQ(image.width, 320u);
+  EXPECT_EQ(image.height, 240u);
+}
+
+// The region in ranges is rounded to 1/1024: a jitter of the range resolution keeps the remap tables, a change rebuilds them
+TEST_F(SonarViewerTest, RangeResolutionJitterKeepsTheRemapTables) {
+  auto node = makeNode("nearest", {rclcpp::Parameter("image_max_range", 10.), rclcpp::Parameter("image_resolution", 0.05)});
+  SonarViewer viewer(node.get());
+  oculus_interfaces::msg::Ping ping = makePing(128, 300);
+  const double range_resolution = ping.range_resolution;
+  sensor_msgs::msg::Image image;
+  ASSERT_TRUE(viewer.renderFan(ping, image));
+  for (const double jitter : {1e-6, -1e-6, 2e-7}) {
+    ping.range_resolution = range_resolution * (1. + jitter);
+    ASSERT_TRUE(viewer.renderFan(ping, image));
+  }
+  EXPECT_EQ(viewer.remapCacheMisses(), 1u);
+
+  ping.range_resolution = range_resolution * 1.01;
+  ASSERT_TRUE(viewer.renderFan(ping, image));
+  EXPECT_EQ(viewer.remapCacheMisses(), 2u);
+}
+
+}  // namespace
@@ -0,0 +1,280 @@
+/**
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, ENSTA-Bretagne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <oculus_ros2/temporal_filter.hpp>
+
+namespace {
+
+// Ping image: n_ranges rows of step bytes, the gain (if has_gains) then the samples.
+struct Ping {
+  temporal_filter::Geometry geometry;
+  std::vector<uint8_t> rows;
+
+  int gainSize() const { return geometry.has_gains ? 4 : 0; }
+
+  uint32_t gain(int r) const {
+    uint32_t value = 1;
+    if (geometry.has_gains) {
+      std::memcpy(&value, &rows[static_cast<std::size_t>(r) * geometry.step], sizeof(value));
+    }
+    return value;
+  }
+
+  double sample(int r, int b) const {
+    const uint8_t* p = &rows[static_cast<std::size_t>(r) * geometry.step + gainSize() + b * geometry.sample_size];
+    if (geometry.sample_size == 1) {
+      return *p;
+    }
+    uint16_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+  }
+
+  // Gain compensated value, as filtered
+  double value(int r, int b) const { return sample(r, b) / std::sqrt(static_cast<double>(gain(r))); }
+};
+
+temporal_filter::Geometry makeGeometry(int sample_size, bool has_gains) {
+  const int n_beams = 45;  // Not a multiple of the SIMD width
+  return temporal_filter::Geometry{30, n_beams, n_beams * sample_size + (has_gains ? 4 : 0) + 3, sample_size, has_gains, 1, 10.};
+}
+
+Ping randomPing(const temporal_filter::Geometry& geometry, std::mt19937& generator) {
+  Ping ping{geometry, std::vector<uint8_t>(static_cast<std::size_t>(geometry.n_ranges) * geometry.step, 0)};
+  const int max_value = geometry.sample_size == 1 ? 255 : 65535;
+  std::uniform_int_distribution<int> gain(1, 16);
+  std::uniform_int_distribution<int> sample(0, max_value / 4);  // Room for the gain changes
+  for (int r = 0; r < geometry.n_ranges; ++r) {
+    uint8_t* row = &ping.rows[static_cast<std::size_t>(r) * geometry.step];
+    if (geometry.has_gains) {
+      const uint32_t value = static_cast<uint32_t>(gain(generator));
+      std::memcpy(row, &value, sizeof(value));
+      row += 4;
+    }
+    for (int b = 0; b < geometry.n_beams; ++b) {
+      const int value = sample(generator);
+      if (geometry.sample_size == 1) {
+        row[b] = static_cast<uint8_t>(value);
+      } else {
+        const uint16_t value16 = static_cast<uint16_t>(value);
+        std::memcpy(row + 2 * b, &value16, sizeof(value16));
+      }
+    }
+  }
+  return ping;
+}
+
+// The filter works in float and rounds its output: one count of difference with the reference
+void expectFiltered(const Ping& filtered, const Ping& ping, const std::vector<double>& reference) {
+  const temporal_filter::Geometry& g = ping.geometry;
+  for (int r = 0; r < g.n_ranges; ++r) {
+    EXPECT_EQ(filtered.gain(r), ping.gain(r));
+    const double scale = std::sqrt(static_cast<double>(ping.gain(r)));
+    for (int b = 0; b < g.n_beams; ++b) {
+      const double expected = std::min(std::max(reference[r * g.n_beams + b] * scale, 0.), g.sample_size == 1 ? 255. : 65535.);
+      ASSERT_NEAR(filtered.sample(r, b), expected, .5 + 1e-3 * expected) << "cell (" << r << ", " << b << ")";
+    }
+  }
+}
+
+// Runs the filter on pings, and the reference (a function of the gain compensated pings so far) on the same pings
+template <class Reference>
+void expectReference(const temporal_filter::Parameters& parameters, Reference reference) {
+  for (int sample_size : {1, 2}) {
+    for (bool has_gains : {false, true}) {
+      SCOPED_TRACE(::testing::Message() << "sample size " << sample_size << " gains " << has_gains);
+      const temporal_filter::Geometry geometry = makeGeometry(sample_size, has_gains);
+      std::mt19937 generator(sample_size + 2 * has_gains);
+      temporal_filter::Filter filter(parameters);
+      std::vector<std::vector<double>> frames;
+      for (int i = 0; i < 12; ++i) {
+        const Ping ping = randomPing(geometry, generator);
+        std::vector<double> frame;
+        for (int r = 0; r < geometry.n_ranges; ++r) {
+          for (int b = 0; b < geometry.n_beams; ++b) {
+            frame.push_back(ping.value(r, b));
+          }
+        }
+        frames.push_back(frame);
+        Ping filtered = ping;
+        filter.apply(filtered.rows.data(), filtered.geometry);
+        if (i == 0) {  // Published as it is
+          EXPECT_TRUE(filtered.rows == ping.rows);
+        } else {
+          expectFiltered(filtered, ping, reference(frames));
+        }
+      }
+      EXPECT_EQ(filter.resets(), 0u);
+    }
+  }
+}
+
+TEST(TemporalFilter, ModeFromString) {
+  temporal_filter::Mode mode = temporal_filter::Mode::OFF;
+  EXPECT_TRUE(temporal_filter::modeFromString("ema", mode));
+  EXPECT_EQ(mode, temporal_filter::Mode::EMA);
+  EXPECT_TRUE(temporal_filter::modeFromString("median", mode));
+  EXPECT_EQ(mode, temporal_filter::Mode::MEDIAN);
+  EXPECT_TRUE(temporal_filter::modeFromString("speckle", mode));
+  EXPECT_EQ(mode, temporal_filter::Mode::SPECKLE);
+  EXPECT_TRUE(temporal_filter::modeFromString("off", mode));
+  EXPECT_EQ(mode, temporal_filter::Mode::OFF);
+  EXPECT_FALSE(temporal_filter::modeFromString("mean", mode));
+}
+
+TEST(TemporalFilter, EmaMatchesReference) {
+  temporal_filter::Parameters parameters;
+  parameters.mode = temporal_filter::Mode::EMA;
+  parameters.alpha = .3;
+  expectReference(parameters, [](const std::vector<std::vector<double>>& frames) {
+    std::vector<double> mean = frames.front();
+    for (std::size_t i = 1; i < frames.size(); ++i) {
+      for (std::size_t c = 0; c < mean.size(); ++c) {
+        mean[c] += .3 * (frames[i][c] - mean[c]);
+      }
+    }
+    return mean;
+  });
+}
+
+TEST(TemporalFilter, MedianMatchesReference) {
+  for (int frames_count : {3, 5, 9, 15}) {
+    SCOPED_TRACE(::testing::Message() << frames_count << " frames");
+    temporal_filter::Parameters parameters;
+    parameters.mode = temporal_filter::Mode::MEDIAN;
+    parameters.frames = frames_count;
+    expectReference(parameters, [frames_count](const std::vector<std::vector<double>>& frames) {
+      // The first ping fills the whole ring
+      std::vector<const std::vector<double>*> ring(frames_count, &frames.front());
+      for (std::size_t i = 1; i < frames.size(); ++i) {
+        ring[(i - 1) % frames_count] = &frames[i];
+      }
+      std::vector<double> median(frames.front().size());
+      std::vector<double> values(frames_count);
+      for (std::size_t c = 0; c < median.size(); ++c) {
+        for (int f = 0; f < frames_count; ++f) {
+          values[f] = (*ring[f])[c];
+        }
+        std::nth_element(values.begin(), values.begin() + frames_count / 2, values.end());
+        median[c] = values[frames_count / 2];
+      }
+      return median;
+    });
+  }
+}
+
+TEST(TemporalFilter, SpeckleMatchesReference) {
+  temporal_filter::Parameters parameters;
+  parameters.mode = temporal_filter::Mode::SPECKLE;
+  parameters.alpha = .25;
+  parameters.speckle = .3;
+  expectReference(parameters, [](const std::vector<std::vector<double>>& frames) {
+    std::vector<double> mean = frames.front();
+    std::vector<double> squares(mean.size());
+    std::transform(mean.begin(), mean.end(), squares.begin(), [](double x) { return x * x; });
+    std::vector<double> filtered = frames.front();
+    for (std::size_t i = 1; i < frames.size(); ++i) {
+      for (std::size_t c = 0; c < mean.size(); ++c) {
+        const double x = frames[i][c];
+        mean[c] += .25 * (x - mean[c]);
+        squares[c] += .25 * (x * x - squares[c]);
+        const double variance = std::max(squares[c] - mean[c] * mean[c], 0.);
+        const double k = variance > 0. ? std::max(variance - .09 * mean[c] * mean[c], 0.) / variance : 0.;
+        filtered[c] = mean[c] + k * (x - mean[c]);
+      }
+    }
+    return filtered;
+  });
+}
+
+TEST(TemporalFilter, MedianDropsASingleBrightPing) {
+  temporal_filter::Parameters parameters;
+  parameters.mode = temporal_filter::Mode::MEDIAN;
+  parameters.frames = 5;
+  temporal_filter::Filter filter(parameters);
+  const temporal_filter::Geometry geometry = makeGeometry(1, false);
+  Ping dark{geometry, std::vector<uint8_t>(static_cast<std::size_t>(geometry.n_ranges) * geometry.step, 10)};
+  Ping bright{geometry, std::vector<uint8_t>(dark.rows.size(), 250)};
+  for (Ping* ping : {&dark, &dark, &bright, &dark}) {
+    Ping filtered = *ping;
+    filter.apply(filtered.rows.data(), geometry);
+    EXPECT_EQ(filtered.sample(7, 11), 10.);
+  }
+}
+
+TEST(TemporalFilter, RestartsOnAGeometryChange) {
+  temporal_filter::Parameters parameters;
+  parameters.mode = temporal_filter::Mode::EMA;
+  temporal_filter::Filter filter(parameters);
+  std::mt19937 generator(1);
+  temporal_filter::Geometry geometry = makeGeometry(1, true);
+  for (int i = 0; i < 3; ++i) {
+    Ping ping = randomPing(geometry, generator);
+    filter.apply(ping.rows.data(), geometry);
+  }
+  geometry.range = 20.;
+  const Ping ping = randomPing(geometry, generator);
+  Ping filtered = ping;
+  filter.apply(filtered.rows.data(), geometry);
+  EXPECT_TRUE(filtered.rows == ping.rows);
+  EXPECT_EQ(filter.resets(), 1u);
+}
+
+TEST(TemporalFilter, LeavesUnsupportedPingsUnchanged) {
+  std::mt19937 generator(2);
+  for (temporal_filter::Mode mode : {temporal_filter::Mode::OFF, temporal_filter::Mode::EMA}) {
+    temporal_filter::Parameters parameters;
+    parameters.mode = mode;
+    temporal_filter::Filter filter(parameters);
+    temporal_filter::Geometry geometry = makeGeometry(1, false);
+    for (int i = 0; i < 2; ++i) {
+      Ping ping = randomPing(geometry, generator);
+      if (mode != temporal_filter::Mode::OFF) {
+        ping.geometry.step = geometry.n_beams - 1;  // Rows shorter than their samples
+      }
+      Ping filtered = ping;
+      filter.apply(filtered.rows.data(), ping.geometry);
+      EXPECT_TRUE(filtered.rows == ping.rows);
+    }
+  }
+}
+
+}  // namespace